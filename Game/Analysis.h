@@ -0,0 +1,122 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "../Models/Move.h"
+#include "Board.h"
+#include "Config.h"
+#include "History.h"
+#include "Search.h"
+#include "Snapshot.h"
+#include "Tt.h"
+
+// фоновый анализ для игрока-человека: пока он думает, поиск с итеративным углублением считает позицию в своем
+// потоке и после каждой итерации показывает на доске лучшие ходы с оценками (Board::show_analysis), так что
+// подсказки появляются сразу и уточняются, пока игрок ждет. Своя таблица транспозиций живет между ходами
+class Analysis
+{
+  public:
+    Analysis(Config *config, Board *board)
+        : config(config), board(board), tt(size_t(int((*config)("Game", "AnalysisHashMB"))), true), search(config, &tt)
+    {
+    }
+
+    ~Analysis()
+    {
+        stop();
+    }
+
+    // перечитать настройки (после перезапуска игры); clear - забыть таблицу при смене оценки
+    void reload()
+    {
+        search.reload();
+    }
+
+    void clear()
+    {
+        search.clear();
+    }
+
+    bool enabled() const
+    {
+        return (*config)("Game", "Analysis");
+    }
+
+    // начать анализ позиции mtx с ходом color; history - позиции партии до нее включительно
+    void start(const vector<vector<POS_T>> &mtx, const bool color, const HashHistory &history)
+    {
+        stop();
+        search.history = history;
+        search_limits limits;
+        limits.multi_pv = min(ANALYSIS_MAX_LINES, max(1, int((*config)("Game", "AnalysisLines"))));
+        analysis_overlay overlay;
+        for (POS_T i = 0; i < game_geometry::size; ++i)
+        {
+            for (POS_T j = 0; j < game_geometry::size; ++j)
+                overlay.mtx[i][j] = mtx[i][j];
+        }
+        search.clear_stop();
+        worker = thread([this, mtx, color, limits, overlay]() mutable {
+            search.go(mtx, color, limits, [&](const search_info &info) {
+                fill_hints(info, overlay);
+                board->show_analysis(overlay);
+            });
+        });
+    }
+
+    // остановить поиск и убрать подсказки
+    void stop()
+    {
+        if (!worker.joinable())
+            return;
+        search.stop();
+        worker.join();
+        board->clear_analysis();
+    }
+
+  private:
+    static void fill_hints(const search_info &info, analysis_overlay &overlay)
+    {
+        overlay.depth = info.depth;
+        overlay.count = min(int(info.lines.size()), ANALYSIS_MAX_LINES);
+        for (int k = 0; k < overlay.count; ++k)
+        {
+            const root_line &line = info.lines[size_t(k)];
+            analysis_hint &h = overlay.hints[k];
+            h.path[0][0] = line.turn.front().x;
+            h.path[0][1] = line.turn.front().y;
+            h.path_len = 1;
+            for (const auto &mv : line.turn)
+            {
+                if (h.path_len == ANALYSIS_MAX_PATH)
+                    break;
+                h.path[h.path_len][0] = mv.x2;
+                h.path[h.path_len][1] = mv.y2;
+                ++h.path_len;
+            }
+            score_text(line.score, h.score, sizeof(h.score));
+        }
+    }
+
+    // оценка для показа: отношение сил в логарифме (как у поиска) или ходы до выигрыша
+    static void score_text(const int score, char *out, const size_t size)
+    {
+        const int moves = max(0, min(SEARCH_MAX_PLY, (SEARCH_WIN - abs(score) + 1) / 2));
+        if (score >= SEARCH_WIN_BOUND)
+            snprintf(out, size, "#%d", moves);
+        else if (score <= -SEARCH_WIN_BOUND)
+            snprintf(out, size, "-#%d", moves);
+        else
+            snprintf(out, size, "%+.1f", score / 1000.0);
+    }
+
+  private:
+    Config *config;
+    Board *board;
+    TranspositionTable tt;
+    Search search;
+    thread worker;
+};
@@ -1,387 +1,761 @@
-﻿#pragma once
-#include <iostream>
-#include <fstream>
-#include <vector>
-
-#include "../Models/Move.h"
-#include "../Models/Project_path.h"
-
-#ifdef __APPLE__
-    #include <SDL2/SDL.h>
-    #include <SDL2/SDL_image.h>
-#else
-    #include <SDL.h>
-    #include <SDL_image.h>
-#endif
-
-using namespace std;
-
-class Board
-{
-public:
-    Board() = default;
-    Board(const unsigned int W, const unsigned int H) : W(W), H(H)
-    {
-    }
-
-    // draws start board
-    int start_draw()
-    {
-        if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
-        {
-            print_exception("SDL_Init can't init SDL2 lib");
-            return 1;
-        }
-        if (W == 0 || H == 0)
-        {
-            SDL_DisplayMode dm;
-            if (SDL_GetDesktopDisplayMode(0, &dm))
-            {
-                print_exception("SDL_GetDesktopDisplayMode can't get desctop display mode");
-                return 1;
-            }
-            W = min(dm.w, dm.h);
-            W -= W / 15;
-            H = W;
-        }
-        win = SDL_CreateWindow("Checkers", 0, H / 30, W, H, SDL_WINDOW_RESIZABLE);
-        if (win == nullptr)
-        {
-            print_exception("SDL_CreateWindow can't create window");
-            return 1;
-        }
-        ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-        if (ren == nullptr)
-        {
-            print_exception("SDL_CreateRenderer can't create renderer");
-            return 1;
-        }
-        board = IMG_LoadTexture(ren, board_path.c_str());
-        w_piece = IMG_LoadTexture(ren, piece_white_path.c_str());
-        b_piece = IMG_LoadTexture(ren, piece_black_path.c_str());
-        w_queen = IMG_LoadTexture(ren, queen_white_path.c_str());
-        b_queen = IMG_LoadTexture(ren, queen_black_path.c_str());
-        back = IMG_LoadTexture(ren, back_path.c_str());
-        replay = IMG_LoadTexture(ren, replay_path.c_str());
-        if (!board || !w_piece || !b_piece || !w_queen || !b_queen || !back || !replay)
-        {
-            print_exception("IMG_LoadTexture can't load main textures from " + textures_path);
-            return 1;
-        }
-        SDL_GetRendererOutputSize(ren, &W, &H);
-        make_start_mtx();
-        rerender();
-        return 0;
-    }
-
-	// перерисовка доски в начальное состояние
-    void redraw()
-    {
-        game_results = -1;
-        history_mtx.clear();
-        history_beat_series.clear();
-        make_start_mtx();
-        clear_active();
-        clear_highlight();
-    }
-
-	// передвинуть шашку с (x, y) на (x2, y2), если выбита шашка, то убрать ее с (xb, yb)
-    void move_piece(move_pos turn, const int beat_series = 0)
-    {
-        if (turn.xb != -1)
-        {
-            mtx[turn.xb][turn.yb] = 0;
-        }
-        move_piece(turn.x, turn.y, turn.x2, turn.y2, beat_series);
-    }
-
-	// передвинуть шашку с (i, j) на (i2, j2)
-    void move_piece(const POS_T i, const POS_T j, const POS_T i2, const POS_T j2, const int beat_series = 0)
-    {
-        if (mtx[i2][j2])
-        {
-            throw runtime_error("final position is not empty, can't move");
-        }
-        if (!mtx[i][j])
-        {
-            throw runtime_error("begin position is empty, can't move");
-        }
-        if ((mtx[i][j] == 1 && i2 == 0) || (mtx[i][j] == 2 && i2 == 7))
-            mtx[i][j] += 2;
-        mtx[i2][j2] = mtx[i][j];
-        drop_piece(i, j);
-        add_history(beat_series);
-    }
-
-	// убрать шашку с доски
-    void drop_piece(const POS_T i, const POS_T j)
-    {
-        mtx[i][j] = 0;
-        rerender();
-    }
-
-	// превращение шашки в дамку
-    void turn_into_queen(const POS_T i, const POS_T j)
-    {
-        if (mtx[i][j] == 0 || mtx[i][j] > 2)
-        {
-            throw runtime_error("can't turn into queen in this position");
-        }
-        mtx[i][j] += 2;
-        rerender();
-    }
-    vector<vector<POS_T>> get_board() const
-    {
-        return mtx;
-    }
-
-	// подсветка клеток, на которые можно сходить
-    void highlight_cells(vector<pair<POS_T, POS_T>> cells)
-    {
-        for (auto pos : cells)
-        {
-            POS_T x = pos.first, y = pos.second;
-            is_highlighted_[x][y] = 1;
-        }
-        rerender();
-    }
-
-	// убрать подсветку возможных ходов
-    void clear_highlight()
-    {
-        for (POS_T i = 0; i < 8; ++i)
-        {
-            is_highlighted_[i].assign(8, 0);
-        }
-        rerender();
-    }
-
-    // подсветка выбранной шашки
-    void set_active(const POS_T x, const POS_T y)
-    {
-        active_x = x;
-        active_y = y;
-        rerender();
-    }
-
-	// убрать подсветку выбранной шашки
-    void clear_active()
-    {
-        active_x = -1;
-        active_y = -1;
-        rerender();
-    }
-
-    bool is_highlighted(const POS_T x, const POS_T y)
-    {
-        return is_highlighted_[x][y];
-    }
-
-	// откат хода
-    void rollback()
-    {
-        auto beat_series = max(1, *(history_beat_series.rbegin()));
-        while (beat_series-- && history_mtx.size() > 1)
-        {
-            history_mtx.pop_back();
-            history_beat_series.pop_back();
-        }
-        mtx = *(history_mtx.rbegin());
-        clear_highlight();
-        clear_active();
-    }
-
-	// показ реузльтата игры
-    void show_final(const int res)
-    {
-        game_results = res;
-        rerender();
-    }
-
-    // use if window size changed
-    void reset_window_size()
-    {
-        SDL_GetRendererOutputSize(ren, &W, &H);
-        rerender();
-    }
-
-    void quit()
-    {
-        SDL_DestroyTexture(board);
-        SDL_DestroyTexture(w_piece);
-        SDL_DestroyTexture(b_piece);
-        SDL_DestroyTexture(w_queen);
-        SDL_DestroyTexture(b_queen);
-        SDL_DestroyTexture(back);
-        SDL_DestroyTexture(replay);
-        SDL_DestroyRenderer(ren);
-        SDL_DestroyWindow(win);
-        SDL_Quit();
-    }
-
-    ~Board()
-    {
-        if (win)
-            quit();
-    }
-
-private:
-    void add_history(const int beat_series = 0)
-    {
-        history_mtx.push_back(mtx);
-        history_beat_series.push_back(beat_series);
-    }
-    // function to make start matrix
-    void make_start_mtx()
-    {
-        for (POS_T i = 0; i < 8; ++i)
-        {
-            for (POS_T j = 0; j < 8; ++j)
-            {
-                mtx[i][j] = 0;
-                if (i < 3 && (i + j) % 2 == 1)
-                    mtx[i][j] = 2;
-                if (i > 4 && (i + j) % 2 == 1)
-                    mtx[i][j] = 1;
-            }
-        }
-        add_history();
-    }
-
-    // function that re-draw all the textures
-    void rerender()
-    {
-        // draw board
-        SDL_RenderClear(ren);
-        SDL_RenderCopy(ren, board, NULL, NULL);
-
-        // draw pieces
-        for (POS_T i = 0; i < 8; ++i)
-        {
-            for (POS_T j = 0; j < 8; ++j)
-            {
-                if (!mtx[i][j])
-                    continue;
-                int wpos = W * (j + 1) / 10 + W / 120;
-                int hpos = H * (i + 1) / 10 + H / 120;
-                SDL_Rect rect{ wpos, hpos, W / 12, H / 12 };
-
-                SDL_Texture* piece_texture;
-                if (mtx[i][j] == 1)
-                    piece_texture = w_piece;
-                else if (mtx[i][j] == 2)
-                    piece_texture = b_piece;
-                else if (mtx[i][j] == 3)
-                    piece_texture = w_queen;
-                else
-                    piece_texture = b_queen;
-
-                SDL_RenderCopy(ren, piece_texture, NULL, &rect);
-            }
-        }
-
-        // draw hilight
-        SDL_SetRenderDrawColor(ren, 0, 255, 0, 0);
-        const double scale = 2.5;
-        SDL_RenderSetScale(ren, scale, scale);
-        for (POS_T i = 0; i < 8; ++i)
-        {
-            for (POS_T j = 0; j < 8; ++j)
-            {
-                if (!is_highlighted_[i][j])
-                    continue;
-                SDL_Rect cell{ int(W * (j + 1) / 10 / scale), int(H * (i + 1) / 10 / scale), int(W / 10 / scale),
-                              int(H / 10 / scale) };
-                SDL_RenderDrawRect(ren, &cell);
-            }
-        }
-
-        // draw active
-        if (active_x != -1)
-        {
-            SDL_SetRenderDrawColor(ren, 255, 0, 0, 0);
-            SDL_Rect active_cell{ int(W * (active_y + 1) / 10 / scale), int(H * (active_x + 1) / 10 / scale),
-                                 int(W / 10 / scale), int(H / 10 / scale) };
-            SDL_RenderDrawRect(ren, &active_cell);
-        }
-        SDL_RenderSetScale(ren, 1, 1);
-
-        // draw arrows
-        SDL_Rect rect_left{ W / 40, H / 40, W / 15, H / 15 };
-        SDL_RenderCopy(ren, back, NULL, &rect_left);
-        SDL_Rect replay_rect{ W * 109 / 120, H / 40, W / 15, H / 15 };
-        SDL_RenderCopy(ren, replay, NULL, &replay_rect);
-
-        // draw result
-        if (game_results != -1)
-        {
-            string result_path = draw_path;
-            if (game_results == 1)
-                result_path = white_path;
-            else if (game_results == 2)
-                result_path = black_path;
-            SDL_Texture* result_texture = IMG_LoadTexture(ren, result_path.c_str());
-            if (result_texture == nullptr)
-            {
-                print_exception("IMG_LoadTexture can't load game result picture from " + result_path);
-                return;
-            }
-            SDL_Rect res_rect{ W / 5, H * 3 / 10, W * 3 / 5, H * 2 / 5 };
-            SDL_RenderCopy(ren, result_texture, NULL, &res_rect);
-            SDL_DestroyTexture(result_texture);
-        }
-
-        SDL_RenderPresent(ren);
-        // next rows for mac os
-        SDL_Delay(10);
-        SDL_Event windowEvent;
-        SDL_PollEvent(&windowEvent);
-    }
-
-    void print_exception(const string& text) {
-        ofstream fout(project_path + "log.txt", ios_base::app);
-        fout << "Error: " << text << ". "<< SDL_GetError() << endl;
-        fout.close();
-    }
-
-  public:
-    int W = 0;
-    int H = 0;
-    // history of boards
-    vector<vector<vector<POS_T>>> history_mtx;
-
-  private:
-    SDL_Window *win = nullptr;
-    SDL_Renderer *ren = nullptr;
-    // textures
-    SDL_Texture *board = nullptr;
-    SDL_Texture *w_piece = nullptr;
-    SDL_Texture *b_piece = nullptr;
-    SDL_Texture *w_queen = nullptr;
-    SDL_Texture *b_queen = nullptr;
-    SDL_Texture *back = nullptr;
-    SDL_Texture *replay = nullptr;
-    // texture files names
-    const string textures_path = project_path + "Textures/";
-    const string board_path = textures_path + "board.png";
-    const string piece_white_path = textures_path + "piece_white.png";
-    const string piece_black_path = textures_path + "piece_black.png";
-    const string queen_white_path = textures_path + "queen_white.png";
-    const string queen_black_path = textures_path + "queen_black.png";
-    const string white_path = textures_path + "white_wins.png";
-    const string black_path = textures_path + "black_wins.png";
-    const string draw_path = textures_path + "draw.png";
-    const string back_path = textures_path + "back.png";
-    const string replay_path = textures_path + "replay.png";
-    // coordinates of chosen cell
-    int active_x = -1, active_y = -1;
-    // game result if exist
-    int game_results = -1;
-    // matrix of possible moves
-    vector<vector<bool>> is_highlighted_ = vector<vector<bool>>(8, vector<bool>(8, 0));
-    // matrix of possible moves
-    // 1 - white, 2 - black, 3 - white queen, 4 - black queen
-    vector<vector<POS_T>> mtx = vector<vector<POS_T>>(8, vector<POS_T>(8, 0));
-    // series of beats for each move
-    vector<int> history_beat_series;
-};
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "../Models/Geometry.h"
+#include "../Models/Move.h"
+#include "../Models/Project_path.h"
+#include "Snapshot.h"
+#include "Trace.h"
+
+#ifdef __APPLE__
+    #include <SDL2/SDL.h>
+    #include <SDL2/SDL_image.h>
+#else
+    #include <SDL.h>
+    #include <SDL_image.h>
+#endif
+
+// текстуры, собранные Tools/atlas.cpp в Textures/Atlas.h, встраиваются в программу и не читаются с диска;
+// без атласа (или с -DCHECKERS_ATLAS=0) картинки загружаются из Textures/*.png
+#ifndef CHECKERS_ATLAS
+#if defined(__has_include) && __has_include("../Textures/Atlas.h")
+#define CHECKERS_ATLAS 1
+#else
+#define CHECKERS_ATLAS 0
+#endif
+#endif
+#if CHECKERS_ATLAS
+#include "../Textures/Atlas.h"
+#endif
+
+using namespace std;
+
+class Board
+{
+    // спрайт: текстура и прямоугольник в ней (место в атласе или вся картинка)
+    struct sprite
+    {
+        SDL_Texture *tex = nullptr;
+        SDL_Rect src{0, 0, 0, 0};
+    };
+
+public:
+    Board() = default;
+    Board(const unsigned int W, const unsigned int H, const unsigned int anim_ms = 0)
+        : W(int(W)), H(int(H)), anim_ms(int(anim_ms))
+    {
+    }
+
+    // draws start board
+    int start_draw()
+    {
+        if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
+        {
+            print_exception("SDL_Init can't init SDL2 lib");
+            return 1;
+        }
+        if (W == 0 || H == 0)
+        {
+            SDL_DisplayMode dm;
+            if (SDL_GetDesktopDisplayMode(0, &dm))
+            {
+                print_exception("SDL_GetDesktopDisplayMode can't get desctop display mode");
+                return 1;
+            }
+            const int side = min(dm.w, dm.h) - min(dm.w, dm.h) / 15;
+            W = side;
+            H = side;
+        }
+        win = SDL_CreateWindow("Checkers", 0, H / 30, W, H, SDL_WINDOW_RESIZABLE);
+        if (win == nullptr)
+        {
+            print_exception("SDL_CreateWindow can't create window");
+            return 1;
+        }
+        make_start_mtx();
+        rerender();
+        // рендерер и текстуры создаются и используются только в потоке отрисовки
+        promise<int> ready;
+        future<int> started = ready.get_future();
+        running = true;
+        render_thread = thread(&Board::render_loop, this, &ready);
+        const int res = started.get();
+        if (res)
+        {
+            running = false;
+            render_thread.join();
+        }
+        return res;
+    }
+
+	// перерисовка доски в начальное состояние
+    void redraw()
+    {
+        game_results = -1;
+        history_mtx.clear();
+        history_beat_series.clear();
+        history_turns.clear();
+        // незаконченные анимации прошлой партии не показываются
+        ++epoch;
+        make_start_mtx();
+        clear_active();
+        clear_highlight();
+    }
+
+	// передвинуть шашку с (x, y) на (x2, y2), если выбита шашка, то убрать ее с (xb, yb)
+    void move_piece(move_pos turn, const int beat_series = 0)
+    {
+        // перемещение анимирует поток отрисовки, поток игры его не ждет
+        animate(turn);
+        if (turn.xb != -1)
+        {
+            mtx[turn.xb][turn.yb] = 0;
+        }
+        move_piece(turn.x, turn.y, turn.x2, turn.y2, beat_series);
+        // запоминаем ход вместе с побитой шашкой
+        history_turns.back() = turn;
+    }
+
+	// передвинуть шашку с (i, j) на (i2, j2)
+    void move_piece(const POS_T i, const POS_T j, const POS_T i2, const POS_T j2, const int beat_series = 0)
+    {
+        if (mtx[i2][j2])
+        {
+            throw runtime_error("final position is not empty, can't move");
+        }
+        if (!mtx[i][j])
+        {
+            throw runtime_error("begin position is empty, can't move");
+        }
+        if ((mtx[i][j] == 1 && i2 == game_geometry::promotion_row(0)) ||
+            (mtx[i][j] == 2 && i2 == game_geometry::promotion_row(1)))
+            mtx[i][j] += 2;
+        mtx[i2][j2] = mtx[i][j];
+        drop_piece(i, j);
+        add_history(beat_series, move_pos(i, j, i2, j2));
+    }
+
+	// убрать шашку с доски
+    void drop_piece(const POS_T i, const POS_T j)
+    {
+        mtx[i][j] = 0;
+        rerender();
+    }
+
+	// превращение шашки в дамку
+    void turn_into_queen(const POS_T i, const POS_T j)
+    {
+        if (mtx[i][j] == 0 || mtx[i][j] > 2)
+        {
+            throw runtime_error("can't turn into queen in this position");
+        }
+        mtx[i][j] += 2;
+        rerender();
+    }
+    vector<vector<POS_T>> get_board() const
+    {
+        return mtx;
+    }
+
+	// подсветка клеток, на которые можно сходить
+    void highlight_cells(vector<pair<POS_T, POS_T>> cells)
+    {
+        for (auto pos : cells)
+        {
+            POS_T x = pos.first, y = pos.second;
+            is_highlighted_[x][y] = 1;
+        }
+        rerender();
+    }
+
+	// убрать подсветку возможных ходов
+    void clear_highlight()
+    {
+        for (POS_T i = 0; i < game_geometry::size; ++i)
+        {
+            is_highlighted_[i].assign(game_geometry::size, 0);
+        }
+        rerender();
+    }
+
+    // подсветка выбранной шашки
+    void set_active(const POS_T x, const POS_T y)
+    {
+        active_x = x;
+        active_y = y;
+        rerender();
+    }
+
+	// убрать подсветку выбранной шашки
+    void clear_active()
+    {
+        active_x = -1;
+        active_y = -1;
+        rerender();
+    }
+
+    bool is_highlighted(const POS_T x, const POS_T y)
+    {
+        return is_highlighted_[x][y];
+    }
+
+	// откат хода
+    void rollback()
+    {
+        auto beat_series = max(1, *(history_beat_series.rbegin()));
+        while (beat_series-- && history_mtx.size() > 1)
+        {
+            history_mtx.pop_back();
+            history_beat_series.pop_back();
+            history_turns.pop_back();
+        }
+        ++epoch;
+        mtx = *(history_mtx.rbegin());
+        clear_highlight();
+        clear_active();
+    }
+
+	// показ реузльтата игры
+    void show_final(const int res)
+    {
+        game_results = res;
+        rerender();
+    }
+
+    // подсказки анализа; пишет их один поток за раз (поток анализа, после его остановки - поток игры)
+    void show_analysis(const analysis_overlay &overlay)
+    {
+        analysis.back() = overlay;
+        analysis.publish();
+    }
+
+    void clear_analysis()
+    {
+        analysis.back().count = 0;
+        analysis.publish();
+    }
+
+    // use if window size changed (поток отрисовки сам берет новый размер, кадр просто перерисовывается)
+    void reset_window_size()
+    {
+        rerender();
+    }
+
+    void quit()
+    {
+        running = false;
+        if (render_thread.joinable())
+            render_thread.join();
+        SDL_DestroyWindow(win);
+        win = nullptr;
+        SDL_Quit();
+    }
+
+    ~Board()
+    {
+        if (win)
+            quit();
+    }
+
+private:
+    void add_history(const int beat_series = 0, const move_pos turn = move_pos(-1, -1, -1, -1))
+    {
+        history_mtx.push_back(mtx);
+        history_beat_series.push_back(beat_series);
+        history_turns.push_back(turn);
+    }
+    // function to make start matrix
+    void make_start_mtx()
+    {
+        for (POS_T i = 0; i < game_geometry::size; ++i)
+        {
+            for (POS_T j = 0; j < game_geometry::size; ++j)
+            {
+                mtx[i][j] = 0;
+                if (i < game_geometry::size / 2 - 1 && (i + j) % 2 == 1)
+                    mtx[i][j] = 2;
+                if (i > game_geometry::size / 2 && (i + j) % 2 == 1)
+                    mtx[i][j] = 1;
+            }
+        }
+        add_history();
+    }
+
+    // публикация снимка доски для потока отрисовки
+    void rerender()
+    {
+        fill_snapshot(frames.back());
+        frames.publish();
+    }
+
+    void fill_snapshot(board_snapshot &snap) const
+    {
+        snap.highlighted = 0;
+        for (POS_T i = 0; i < game_geometry::size; ++i)
+        {
+            for (POS_T j = 0; j < game_geometry::size; ++j)
+            {
+                snap.mtx[i][j] = mtx[i][j];
+                if (is_highlighted_[i][j])
+                    snap.highlighted |= uint64_t(1) << (i * game_geometry::size + j);
+            }
+        }
+        snap.active_x = active_x;
+        snap.active_y = active_y;
+        snap.game_results = game_results;
+    }
+
+    // событие хода для анимации; при переполненной очереди ход просто появляется без анимации
+    void animate(const move_pos &turn)
+    {
+        if (anim_ms <= 0 || !running)
+            return;
+        move_event e;
+        fill_snapshot(e.before);
+        e.hop = turn;
+        e.epoch = epoch;
+        events.push(e);
+    }
+
+    int init_render()
+    {
+        ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+        if (ren == nullptr)
+        {
+            print_exception("SDL_CreateRenderer can't create renderer");
+            return 1;
+        }
+        if (!load_main_textures())
+        {
+            free_render();
+            return 1;
+        }
+        int w, h;
+        SDL_GetRendererOutputSize(ren, &w, &h);
+        W = w;
+        H = h;
+        return 0;
+    }
+
+#if CHECKERS_ATLAS
+    // доска, шашки и кнопки - одна текстура атласа, загружаемая одним вызовом
+    bool load_main_textures()
+    {
+        TRACE_SCOPE("load atlas", "render");
+        SDL_Texture *tex = atlas_texture(atlas_main_size, atlas_main_rle, sizeof(atlas_main_rle) / sizeof(uint32_t));
+        if (tex == nullptr)
+        {
+            print_exception("SDL_CreateTexture can't create texture atlas");
+            return false;
+        }
+        sprite *all[] = {&board, &w_piece, &b_piece, &w_queen, &b_queen, &back, &replay};
+        for (int k = 0; k < 7; ++k)
+            *all[k] = atlas_sprite(tex, atlas_main_rects[k]);
+        return true;
+    }
+
+    // картинки результата раскладываются из атласа при первом показе
+    bool load_result(const int res)
+    {
+        if (results[res].tex)
+            return true;
+        if (result_failed)
+            return false;
+        TRACE_SCOPE("load result texture", "render");
+        SDL_Texture *tex =
+            atlas_texture(atlas_result_size, atlas_result_rle, sizeof(atlas_result_rle) / sizeof(uint32_t));
+        if (tex == nullptr)
+        {
+            print_exception("SDL_CreateTexture can't create game result atlas");
+            result_failed = true;
+            return false;
+        }
+        for (int k = 0; k < 3; ++k)
+            results[k] = atlas_sprite(tex, atlas_result_rects[k]);
+        return true;
+    }
+
+    // текстура из встроенного атласа: серии повторов разворачиваются в пиксели ARGB
+    SDL_Texture *atlas_texture(const int size[2], const uint32_t *rle, const size_t rle_len)
+    {
+        vector<uint32_t> pixels(size_t(size[0]) * size[1], 0);
+        size_t p = 0;
+        for (size_t k = 0; k + 1 < rle_len && p < pixels.size(); k += 2)
+        {
+            const size_t run = min<size_t>(rle[k], pixels.size() - p);
+            fill_n(pixels.begin() + p, run, rle[k + 1]);
+            p += run;
+        }
+        SDL_Texture *tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, size[0], size[1]);
+        if (tex == nullptr)
+            return nullptr;
+        textures.push_back(tex);
+        SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+        SDL_UpdateTexture(tex, NULL, pixels.data(), size[0] * 4);
+        return tex;
+    }
+
+    static sprite atlas_sprite(SDL_Texture *tex, const int rect[4])
+    {
+        return {tex, {rect[0], rect[1], rect[2], rect[3]}};
+    }
+#else
+    bool load_main_textures()
+    {
+        board = load_sprite(board_path);
+        w_piece = load_sprite(piece_white_path);
+        b_piece = load_sprite(piece_black_path);
+        w_queen = load_sprite(queen_white_path);
+        b_queen = load_sprite(queen_black_path);
+        back = load_sprite(back_path);
+        replay = load_sprite(replay_path);
+        if (!board.tex || !w_piece.tex || !b_piece.tex || !w_queen.tex || !b_queen.tex || !back.tex || !replay.tex)
+        {
+            print_exception("IMG_LoadTexture can't load main textures from " + textures_path);
+            return false;
+        }
+        return true;
+    }
+
+    // картинка результата загружается с диска при первом показе
+    bool load_result(const int res)
+    {
+        if (results[res].tex)
+            return true;
+        if (result_failed)
+            return false;
+        const string result_path = res == 1 ? white_path : res == 2 ? black_path : draw_path;
+        TRACE_SCOPE("load result texture", "render");
+        results[res] = load_sprite(result_path);
+        if (results[res].tex == nullptr)
+        {
+            // ошибка пишется один раз
+            print_exception("IMG_LoadTexture can't load game result picture from " + result_path);
+            result_failed = true;
+            return false;
+        }
+        return true;
+    }
+
+    sprite load_sprite(const string &path)
+    {
+        sprite res;
+        res.tex = IMG_LoadTexture(ren, path.c_str());
+        if (res.tex)
+        {
+            textures.push_back(res.tex);
+            SDL_QueryTexture(res.tex, NULL, NULL, &res.src.w, &res.src.h);
+        }
+        return res;
+    }
+#endif
+
+    void copy(const sprite &s, const SDL_Rect *dst)
+    {
+        SDL_RenderCopy(ren, s.tex, &s.src, dst);
+    }
+
+    void free_render()
+    {
+        for (SDL_Texture *t : textures)
+            SDL_DestroyTexture(t);
+        textures.clear();
+        if (ren)
+            SDL_DestroyRenderer(ren);
+        ren = nullptr;
+    }
+
+    // поток отрисовки: анимирует события ходов по очереди, затем показывает последний снимок;
+    // кадры выводятся с частотой обновления экрана (vsync), без изменений поток спит
+    void render_loop(promise<int> *ready)
+    {
+        const int res = init_render();
+        ready->set_value(res);
+        if (res)
+            return;
+        move_event anim;
+        bool animating = false, dirty = true;
+        auto anim_start = chrono::steady_clock::now();
+        while (running)
+        {
+            if (frames.update())
+                dirty = true;
+            if (analysis.update())
+                dirty = true;
+            int w, h;
+            SDL_GetRendererOutputSize(ren, &w, &h);
+            if (w != W || h != H)
+            {
+                W = w;
+                H = h;
+                dirty = true;
+            }
+            while (!animating && events.pop(anim))
+            {
+                animating = anim.epoch == epoch;
+                anim_start = chrono::steady_clock::now();
+            }
+            if (animating)
+            {
+                // отставшая очередь ходов проигрывается быстрее
+                const double duration = double(anim_ms) / double(1 + events.size());
+                const double t = chrono::duration<double, milli>(chrono::steady_clock::now() - anim_start).count() /
+                                 duration;
+                if (t >= 1 || anim.epoch != epoch)
+                {
+                    animating = false;
+                    dirty = true;
+                    continue;
+                }
+                draw(anim.before, &anim.hop, t);
+            }
+            else if (dirty)
+            {
+                draw(frames.front(), nullptr, 0);
+                dirty = false;
+            }
+            else
+                SDL_Delay(IDLE_MS);
+        }
+        free_render();
+    }
+
+    // кадр по снимку; hop - перемещение в доле t пути (шашка с клетки hop.x, hop.y рисуется в пути,
+    // побитая шашка постепенно исчезает)
+    void draw(const board_snapshot &snap, const move_pos *hop, const double t)
+    {
+        TRACE_ROOT("frame", "render");
+        const int W = this->W, H = this->H;
+        // draw board
+        SDL_RenderClear(ren);
+        copy(board, NULL);
+
+        // draw pieces
+        for (POS_T i = 0; i < game_geometry::size; ++i)
+        {
+            for (POS_T j = 0; j < game_geometry::size; ++j)
+            {
+                if (!snap.mtx[i][j] || (hop && i == hop->x && j == hop->y))
+                    continue;
+                const sprite &piece = piece_sprite(snap.mtx[i][j]);
+                const bool fading = hop && i == hop->xb && j == hop->yb;
+                if (fading)
+                    SDL_SetTextureAlphaMod(piece.tex, Uint8(255 * (1 - t)));
+                SDL_Rect rect{piece_x(j, W), piece_y(i, H), W / 12, H / 12};
+                copy(piece, &rect);
+                if (fading)
+                    SDL_SetTextureAlphaMod(piece.tex, 255);
+            }
+        }
+        if (hop)
+        {
+            // плавный старт и остановка
+            const double s = t * t * (3 - 2 * t);
+            SDL_Rect rect{int(piece_x(hop->y, W) + (piece_x(hop->y2, W) - piece_x(hop->y, W)) * s),
+                          int(piece_y(hop->x, H) + (piece_y(hop->x2, H) - piece_y(hop->x, H)) * s), W / 12, H / 12};
+            copy(piece_sprite(snap.mtx[hop->x][hop->y]), &rect);
+        }
+
+        // draw hilight
+        SDL_SetRenderDrawColor(ren, 0, 255, 0, 0);
+        const double scale = 2.5;
+        SDL_RenderSetScale(ren, scale, scale);
+        for (POS_T i = 0; i < game_geometry::size; ++i)
+        {
+            for (POS_T j = 0; j < game_geometry::size; ++j)
+            {
+                if (!(snap.highlighted >> (i * game_geometry::size + j) & 1))
+                    continue;
+                SDL_Rect cell{ int(W * (j + 1) / 10 / scale), int(H * (i + 1) / 10 / scale), int(W / 10 / scale),
+                              int(H / 10 / scale) };
+                SDL_RenderDrawRect(ren, &cell);
+            }
+        }
+
+        // draw active
+        if (snap.active_x != -1)
+        {
+            SDL_SetRenderDrawColor(ren, 255, 0, 0, 0);
+            SDL_Rect active_cell{ int(W * (snap.active_y + 1) / 10 / scale), int(H * (snap.active_x + 1) / 10 / scale),
+                                 int(W / 10 / scale), int(H / 10 / scale) };
+            SDL_RenderDrawRect(ren, &active_cell);
+        }
+        SDL_RenderSetScale(ren, 1, 1);
+
+        // подсказки анализа только для показанной позиции и не во время анимации
+        if (!hop)
+            draw_analysis(snap, analysis.front());
+
+        // draw arrows
+        SDL_Rect rect_left{ W / 40, H / 40, W / 15, H / 15 };
+        copy(back, &rect_left);
+        SDL_Rect replay_rect{ W * 109 / 120, H / 40, W / 15, H / 15 };
+        copy(replay, &replay_rect);
+
+        // draw result
+        if (snap.game_results != -1 && load_result(snap.game_results))
+        {
+            SDL_Rect res_rect{ W / 5, H * 3 / 10, W * 3 / 5, H * 2 / 5 };
+            copy(results[snap.game_results], &res_rect);
+        }
+
+        TRACE_SCOPE("present", "render");
+        SDL_RenderPresent(ren);
+    }
+
+    // ходы анализа линиями через клетки серии, оценки - в конечной клетке, сверху - глубина поиска
+    void draw_analysis(const board_snapshot &snap, const analysis_overlay &a)
+    {
+        if (!a.count || memcmp(snap.mtx, a.mtx, sizeof(a.mtx)) != 0)
+            return;
+        static const Uint8 colors[ANALYSIS_MAX_LINES][3] = {{0, 160, 255}, {0, 200, 140}, {255, 190, 0}, {200, 90, 255}};
+        const int W = this->W, H = this->H;
+        const int px = max(1, W / 260);
+        const double scale = 2.5;
+        SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
+        // лучший ход рисуется последним, поверх остальных
+        for (int k = a.count - 1; k >= 0; --k)
+        {
+            const analysis_hint &h = a.hints[k];
+            if (h.path_len < 2)
+                continue;
+            SDL_SetRenderDrawColor(ren, colors[k][0], colors[k][1], colors[k][2], 255);
+            SDL_RenderSetScale(ren, scale, scale);
+            for (int p = 0; p + 1 < h.path_len; ++p)
+                SDL_RenderDrawLine(ren, int((W * (h.path[p][1] + 1) / 10 + W / 20) / scale),
+                                   int((H * (h.path[p][0] + 1) / 10 + H / 20) / scale),
+                                   int((W * (h.path[p + 1][1] + 1) / 10 + W / 20) / scale),
+                                   int((H * (h.path[p + 1][0] + 1) / 10 + H / 20) / scale));
+            SDL_RenderSetScale(ren, 1, 1);
+            const int x = W * (h.path[h.path_len - 1][1] + 1) / 10, y = H * (h.path[h.path_len - 1][0] + 1) / 10;
+            SDL_Rect back_rect{x, y, int(strlen(h.score)) * 4 * px + px, 7 * px};
+            SDL_SetRenderDrawColor(ren, 0, 0, 0, 160);
+            SDL_RenderFillRect(ren, &back_rect);
+            SDL_SetRenderDrawColor(ren, colors[k][0], colors[k][1], colors[k][2], 255);
+            draw_text(h.score, x + px, y + px, px);
+        }
+        const string depth = "d" + to_string(a.depth);
+        SDL_SetRenderDrawColor(ren, 255, 255, 255, 255);
+        draw_text(depth.c_str(), W / 2 - int(depth.size()) * 2 * px * 2, H / 40, px * 2);
+        SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_NONE);
+    }
+
+    // текст шрифтом 3x5 из прямоугольников размера px (цифры, "+", "-", ".", "#", "d")
+    void draw_text(const char *text, int x, const int y, const int px)
+    {
+        static const char chars[] = "0123456789+-.#d";
+        static const uint16_t glyphs[] = {0x7b6f, 0x2c97, 0x73e7, 0x73cf, 0x5bc9, 0x79cf, 0x79ef, 0x7249,
+                                          0x7bef, 0x7bcf, 0x5d0,  0x1c0,  0x2,    0x5f7d, 0x13ef};
+        for (; *text; ++text, x += 4 * px)
+        {
+            const char *c = strchr(chars, *text);
+            if (!c)
+                continue;
+            const uint16_t g = glyphs[c - chars];
+            for (int bit = 0; bit < 15; ++bit)
+            {
+                if (!(g >> (14 - bit) & 1))
+                    continue;
+                SDL_Rect r{x + bit % 3 * px, y + bit / 3 * px, px, px};
+                SDL_RenderFillRect(ren, &r);
+            }
+        }
+    }
+
+    const sprite &piece_sprite(const POS_T type) const
+    {
+        if (type == 1)
+            return w_piece;
+        if (type == 2)
+            return b_piece;
+        if (type == 3)
+            return w_queen;
+        return b_queen;
+    }
+
+    static int piece_x(const int j, const int W)
+    {
+        return W * (j + 1) / 10 + W / 120;
+    }
+
+    static int piece_y(const int i, const int H)
+    {
+        return H * (i + 1) / 10 + H / 120;
+    }
+
+    void print_exception(const string& text) {
+        TRACE_SCOPE("log", "io");
+        ofstream fout(project_path + "log.txt", ios_base::app);
+        fout << "Error: " << text << ". "<< SDL_GetError() << endl;
+        fout.close();
+    }
+
+  public:
+    // размер области отрисовки, обновляется потоком отрисовки
+    atomic<int> W{0};
+    atomic<int> H{0};
+    // history of boards
+    vector<vector<vector<POS_T>>> history_mtx;
+    // series of beats for each move
+    vector<int> history_beat_series;
+    // move that led to each board of history (first board - start position)
+    vector<move_pos> history_turns;
+
+  private:
+    SDL_Window *win = nullptr;
+    SDL_Renderer *ren = nullptr;
+    // textures
+    sprite board;
+    sprite w_piece;
+    sprite b_piece;
+    sprite w_queen;
+    sprite b_queen;
+    sprite back;
+    sprite replay;
+    // картинки результата по номеру результата партии
+    sprite results[3];
+    bool result_failed = false;
+    // все созданные текстуры, освобождаются потоком отрисовки
+    vector<SDL_Texture *> textures;
+    // texture files names
+    const string textures_path = project_path + "Textures/";
+    const string board_path = textures_path + "board.png";
+    const string piece_white_path = textures_path + "piece_white.png";
+    const string piece_black_path = textures_path + "piece_black.png";
+    const string queen_white_path = textures_path + "queen_white.png";
+    const string queen_black_path = textures_path + "queen_black.png";
+    const string white_path = textures_path + "white_wins.png";
+    const string black_path = textures_path + "black_wins.png";
+    const string draw_path = textures_path + "draw.png";
+    const string back_path = textures_path + "back.png";
+    const string replay_path = textures_path + "replay.png";
+    // длительность анимации одного перемещения, 0 - без анимации
+    int anim_ms = 0;
+    // пауза потока отрисовки без изменений на доске
+    static const int IDLE_MS = 4;
+    thread render_thread;
+    atomic<bool> running{false};
+    // номер эпохи: откат и перезапуск отменяют еще не показанные анимации
+    atomic<uint32_t> epoch{0};
+    TripleBuffer<board_snapshot> frames;
+    TripleBuffer<analysis_overlay> analysis;
+    SpscQueue<move_event, 256> events;
+    // coordinates of chosen cell
+    int active_x = -1, active_y = -1;
+    // game result if exist
+    int game_results = -1;
+    // matrix of possible moves
+    vector<vector<bool>> is_highlighted_ =
+        vector<vector<bool>>(game_geometry::size, vector<bool>(game_geometry::size, 0));
+    // matrix of possible moves
+    // 1 - white, 2 - black, 3 - white queen, 4 - black queen
+    vector<vector<POS_T>> mtx = vector<vector<POS_T>>(game_geometry::size, vector<POS_T>(game_geometry::size, 0));
+};
@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include <fstream>
+#include <string>
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
 
@@ -22,11 +23,17 @@ class Config
     }
 
     // метод для получения настройки по папке и имени
-    auto operator()(const string &setting_dir, const string &setting_name) const
+    auto operator()(const std::string &setting_dir, const std::string &setting_name) const
     {
         return config[setting_dir][setting_name];
     }
 
+    // замена настройки только в памяти (параметры инструментов из командной строки), файл не меняется
+    void set(const std::string &setting_dir, const std::string &setting_name, const json &value)
+    {
+        config[setting_dir][setting_name] = value;
+    }
+
   private:
     json config;
 };
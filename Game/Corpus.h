@@ -0,0 +1,525 @@
+﻿#pragma once
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "../Models/Fen.h"
+#include "../Models/GameRecord.h"
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// компактный бинарный формат корпуса партий:
+//   заголовок: "CKGC", uint32 версия
+//   партии подряд: uint8 результат (0 - ничья, 1 - белые, 2 - черные, 3 - не закончена), uint8 флаги
+//     (бит 0 - своя начальная позиция), uint16 число перемещений,
+//     [при флаге: 4 x uint32 маски позиции, uint8 чей ход], затем по uint16 на перемещение:
+//     биты 0-4 - откуда, 5-9 - куда, бит 10 - следующее перемещение продолжает тот же ход
+//   индекс: uint64 смещение каждой партии
+//   окончание: uint64 число партий, uint64 смещение индекса, "CKGI"
+// побитые шашки не хранятся, они восстанавливаются при декодировании
+const uint32_t CORPUS_VERSION = 1;
+const size_t CORPUS_HEADER_SIZE = 8;
+const size_t CORPUS_FOOTER_SIZE = 20;
+
+// перемещение по файлу с 64-битными смещениями (long на Windows 32-битный, корпус бывает больше 2 ГБ)
+inline int file_seek(std::FILE *file, const uint64_t off, const int origin)
+{
+#ifdef _WIN32
+    return _fseeki64(file, int64_t(off), origin);
+#else
+    return fseeko(file, off_t(off), origin);
+#endif
+}
+
+inline uint64_t file_tell(std::FILE *file)
+{
+#ifdef _WIN32
+    return uint64_t(_ftelli64(file));
+#else
+    return uint64_t(ftello(file));
+#endif
+}
+
+// файл, отображенный в память только для чтения
+class MappedFile
+{
+  public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    // sequential - файл будет читаться подряд, иначе вразнобой (подсказка системе); пустой файл не отображается
+    bool open(const std::string &path, const bool sequential)
+    {
+        close();
+#ifdef _WIN32
+        handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             nullptr, OPEN_EXISTING,
+                             sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (handle == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+        size_bytes = size_t(size.QuadPart);
+        mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+            ptr = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!ptr)
+        {
+            close();
+            return false;
+        }
+        return true;
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        size_bytes = size_t(st.st_size);
+        void *p = mmap(nullptr, size_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+        {
+            size_bytes = 0;
+            return false;
+        }
+        madvise(p, size_bytes, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        ptr = static_cast<const uint8_t *>(p);
+        return true;
+#endif
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (ptr)
+            UnmapViewOfFile(ptr);
+        if (mapping)
+            CloseHandle(mapping);
+        if (handle != INVALID_HANDLE_VALUE)
+            CloseHandle(handle);
+        mapping = nullptr;
+        handle = INVALID_HANDLE_VALUE;
+#else
+        if (ptr)
+            munmap(const_cast<uint8_t *>(ptr), size_bytes);
+#endif
+        ptr = nullptr;
+        size_bytes = 0;
+    }
+
+    const uint8_t *data() const
+    {
+        return ptr;
+    }
+
+    size_t size() const
+    {
+        return size_bytes;
+    }
+
+  private:
+    const uint8_t *ptr = nullptr;
+    size_t size_bytes = 0;
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+// запись корпуса: партии дописываются в конец, индекс переписывается при закрытии
+class CorpusWriter
+{
+  public:
+    CorpusWriter() = default;
+    CorpusWriter(const CorpusWriter &) = delete;
+    CorpusWriter &operator=(const CorpusWriter &) = delete;
+
+    ~CorpusWriter()
+    {
+        close();
+    }
+
+    // открыть файл; существующий корпус продолжается (без индекса - после прохода по записям).
+    // Существующий файл, который не читается как корпус этой версии, не трогается: false
+    bool open(const std::string &path)
+    {
+        close();
+        offsets.clear();
+        file = std::fopen(path.c_str(), "r+b");
+        if (file)
+        {
+            if (load_index())
+                return true;
+            std::fclose(file);
+            file = nullptr;
+            offsets.clear();
+            return false;
+        }
+        file = std::fopen(path.c_str(), "w+b");
+        if (!file)
+            return false;
+        write_header();
+        return true;
+    }
+
+    bool is_open() const
+    {
+        return file != nullptr;
+    }
+
+    size_t size() const
+    {
+        return offsets.size();
+    }
+
+    // дописать партию
+    void add(const game_record &game)
+    {
+        if (!file)
+            return;
+        std::vector<uint8_t> buf;
+        encode(game, buf);
+        file_seek(file, end, SEEK_SET);
+        std::fwrite(buf.data(), 1, buf.size(), file);
+        offsets.push_back(end);
+        end += buf.size();
+    }
+
+    // записать индекс и закрыть файл
+    void close()
+    {
+        if (!file)
+            return;
+        flush_index();
+        std::fclose(file);
+        file = nullptr;
+    }
+
+    // записать индекс, не закрывая файл (после этого файл читается CorpusReader)
+    void flush_index()
+    {
+        if (!file)
+            return;
+        file_seek(file, end, SEEK_SET);
+        for (uint64_t off : offsets)
+            write_u64(off);
+        write_u64(offsets.size());
+        write_u64(end);
+        std::fwrite("CKGI", 1, 4, file);
+        std::fflush(file);
+    }
+
+    // кодирование партии в байты записи
+    static void encode(const game_record &game, std::vector<uint8_t> &buf)
+    {
+        size_t hops = 0;
+        for (const auto &turn : game.turns)
+            hops += turn.size();
+        buf.clear();
+        buf.push_back(uint8_t(game.result == -1 ? 3 : game.result));
+        buf.push_back(uint8_t(game.custom_start ? 1 : 0));
+        put16(buf, uint16_t(hops));
+        if (game.custom_start)
+        {
+            for (uint32_t m : {game.start.wm, game.start.bm, game.start.wk, game.start.bk})
+                for (int b = 0; b < 4; ++b)
+                    buf.push_back(uint8_t(m >> (8 * b)));
+            buf.push_back(uint8_t(game.start_color));
+        }
+        for (const auto &turn : game.turns)
+        {
+            for (size_t k = 0; k < turn.size(); ++k)
+            {
+                const auto &mv = turn[k];
+                uint16_t code = uint16_t(square_index(mv.x, mv.y) | (square_index(mv.x2, mv.y2) << 5));
+                if (k + 1 < turn.size())
+                    code |= 1 << 10;
+                put16(buf, code);
+            }
+        }
+    }
+
+  private:
+    void write_header()
+    {
+        std::fwrite("CKGC", 1, 4, file);
+        write_u32(CORPUS_VERSION);
+        end = CORPUS_HEADER_SIZE;
+    }
+
+    // индекс существующего файла; false - файл не корпус или другой версии
+    bool load_index()
+    {
+        file_seek(file, 0, SEEK_END);
+        const uint64_t size = file_tell(file);
+        // пустой файл (создан, но заголовок не записан) начинается как новый корпус
+        if (size == 0)
+        {
+            write_header();
+            return true;
+        }
+        char magic[4];
+        uint32_t version = 0;
+        file_seek(file, 0, SEEK_SET);
+        if (size < CORPUS_HEADER_SIZE || std::fread(magic, 1, 4, file) != 4 || std::memcmp(magic, "CKGC", 4) != 0 ||
+            std::fread(&version, 4, 1, file) != 1 || version != CORPUS_VERSION)
+            return false;
+        if (size < CORPUS_HEADER_SIZE + CORPUS_FOOTER_SIZE)
+            return scan_records(size);
+        uint64_t count = 0, index_off = 0;
+        file_seek(file, size - CORPUS_FOOTER_SIZE, SEEK_SET);
+        if (std::fread(&count, 8, 1, file) != 1 || std::fread(&index_off, 8, 1, file) != 1 ||
+            std::fread(magic, 1, 4, file) != 4 || std::memcmp(magic, "CKGI", 4) != 0 ||
+            index_off + count * 8 + CORPUS_FOOTER_SIZE != size)
+            return scan_records(size);
+        offsets.resize(size_t(count));
+        file_seek(file, index_off, SEEK_SET);
+        if (count && std::fread(offsets.data(), 8, size_t(count), file) != count)
+            return scan_records(size);
+        end = index_off;
+        return true;
+    }
+
+    // восстановление индекса проходом по записям (файл не был закрыт, индекс не записан)
+    bool scan_records(const uint64_t size)
+    {
+        offsets.clear();
+        uint64_t pos = CORPUS_HEADER_SIZE;
+        uint8_t head[4];
+        while (pos + 4 <= size)
+        {
+            file_seek(file, pos, SEEK_SET);
+            if (std::fread(head, 1, 4, file) != 4 || head[0] > 3)
+                break;
+            const uint64_t len = 4 + ((head[1] & 1) ? 17 : 0) + 2 * uint64_t(head[2] | (head[3] << 8));
+            if (pos + len > size)
+                break;
+            offsets.push_back(pos);
+            pos += len;
+        }
+        // недописанный хвост будет перезаписан
+        end = pos;
+        return true;
+    }
+
+    static void put16(std::vector<uint8_t> &buf, const uint16_t v)
+    {
+        buf.push_back(uint8_t(v));
+        buf.push_back(uint8_t(v >> 8));
+    }
+
+    void write_u32(const uint32_t v)
+    {
+        std::fwrite(&v, 4, 1, file);
+    }
+
+    void write_u64(const uint64_t v)
+    {
+        std::fwrite(&v, 8, 1, file);
+    }
+
+    std::FILE *file = nullptr;
+    std::vector<uint64_t> offsets;
+    uint64_t end = 0;
+};
+
+// чтение корпуса через отображение файла в память: партии не загружаются целиком,
+// а декодируются по одной при обращении
+class CorpusReader
+{
+  public:
+    CorpusReader() = default;
+    CorpusReader(const CorpusReader &) = delete;
+    CorpusReader &operator=(const CorpusReader &) = delete;
+
+    ~CorpusReader()
+    {
+        close();
+    }
+
+    bool open(const std::string &path)
+    {
+        close();
+        // партии читаются подряд
+        if (file.open(path, true))
+        {
+            data = file.data();
+            size_bytes = file.size();
+        }
+        uint32_t version = 0;
+        if (data && size_bytes >= CORPUS_HEADER_SIZE)
+            std::memcpy(&version, data + 4, 4);
+        if (!data || size_bytes < CORPUS_HEADER_SIZE || std::memcmp(data, "CKGC", 4) != 0 ||
+            version != CORPUS_VERSION)
+        {
+            close();
+            return false;
+        }
+        // индекс из окончания файла копируется: CorpusWriter дописывает следующую партию поверх старого индекса,
+        // пока файл открыт здесь (фоновое обновление PositionIndex). Без индекса (запись прервана) -
+        // последовательный проход
+        offsets.clear();
+        records_end = size_bytes;
+        if (size_bytes >= CORPUS_HEADER_SIZE + CORPUS_FOOTER_SIZE &&
+            std::memcmp(data + size_bytes - 4, "CKGI", 4) == 0)
+        {
+            uint64_t n, off;
+            std::memcpy(&n, data + size_bytes - CORPUS_FOOTER_SIZE, 8);
+            std::memcpy(&off, data + size_bytes - CORPUS_FOOTER_SIZE + 8, 8);
+            if (off >= CORPUS_HEADER_SIZE && off <= size_bytes && n <= (size_bytes - off) / 8 &&
+                off + n * 8 + CORPUS_FOOTER_SIZE == size_bytes)
+            {
+                records_end = size_t(off);
+                offsets.resize(size_t(n));
+                for (size_t i = 0; i < offsets.size(); ++i)
+                {
+                    uint64_t o;
+                    std::memcpy(&o, data + records_end + 8 * i, 8);
+                    offsets[i] = o < records_end ? size_t(o) : records_end;
+                }
+                count = offsets.size();
+                return true;
+            }
+        }
+        for (size_t pos = CORPUS_HEADER_SIZE; pos + 4 <= size_bytes;)
+        {
+            const size_t len = record_size(pos);
+            if (!len || pos + len > size_bytes)
+                break;
+            offsets.push_back(pos);
+            pos += len;
+        }
+        count = offsets.size();
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        data = nullptr;
+        size_bytes = 0;
+        records_end = 0;
+        count = 0;
+        offsets.clear();
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    // результат партии без декодирования ходов (-1 и для записи за пределами файла)
+    int result(const size_t i) const
+    {
+        const size_t pos = offset(i);
+        if (pos + 4 > records_end)
+            return -1;
+        const uint8_t r = data[pos];
+        return r == 3 ? -1 : r;
+    }
+
+    // декодирование партии i; побитые шашки восстанавливаются проигрыванием ходов. Запись, выходящая
+    // за пределы файла (испорченный индекс), не читается - false
+    bool get(const size_t i, game_record &game) const
+    {
+        size_t pos = offset(i);
+        game.turns.clear();
+        game.tags.clear();
+        if (pos + 4 > records_end || !record_size(pos) || pos + record_size(pos) > records_end)
+        {
+            game.result = -1;
+            game.custom_start = false;
+            game.start = start_position();
+            game.start_color = 0;
+            return false;
+        }
+        game.result = result(i);
+        game.custom_start = data[pos + 1] & 1;
+        const size_t hops = get16(pos + 2);
+        pos += 4;
+        game.start = start_position();
+        game.start_color = 0;
+        if (game.custom_start)
+        {
+            uint32_t m[4];
+            for (int k = 0; k < 4; ++k)
+                std::memcpy(&m[k], data + pos + 4 * k, 4);
+            game.start.wm = m[0];
+            game.start.bm = m[1];
+            game.start.wk = m[2];
+            game.start.bk = m[3];
+            game.start_color = data[pos + 16];
+            pos += 17;
+        }
+        auto mtx = unpack_board(game.start);
+        bool new_turn = true;
+        for (size_t k = 0; k < hops; ++k, pos += 2)
+        {
+            const uint16_t code = get16(pos);
+            const move_pos hop = make_hop(mtx, code & 31, (code >> 5) & 31);
+            if (hop.x == -1)
+                return false;
+            apply_hop(mtx, hop);
+            if (new_turn)
+                game.turns.emplace_back();
+            game.turns.back().push_back(hop);
+            new_turn = !((code >> 10) & 1);
+        }
+        return true;
+    }
+
+  private:
+    size_t offset(const size_t i) const
+    {
+        return offsets[i];
+    }
+
+    uint16_t get16(const size_t pos) const
+    {
+        return uint16_t(data[pos] | (data[pos + 1] << 8));
+    }
+
+    // длина записи, начинающейся с pos (0, если запись неполная)
+    size_t record_size(const size_t pos) const
+    {
+        if (data[pos] > 3)
+            return 0;
+        return 4 + ((data[pos + 1] & 1) ? 17 : 0) + 2 * size_t(get16(pos + 2));
+    }
+
+    MappedFile file;
+    const uint8_t *data = nullptr;
+    size_t size_bytes = 0;
+    // конец записей партий (начало индекса или конец файла без индекса)
+    size_t records_end = 0;
+    size_t count = 0;
+    // смещения партий: копия индекса файла или найденные проходом по файлу
+    std::vector<size_t> offsets;
+};
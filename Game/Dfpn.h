@@ -0,0 +1,418 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "../Models/Bitboard.h"
+#include "../Models/Move.h"
+#include "Config.h"
+#include "History.h"
+#include "Movegen.h"
+#include "Rules.h"
+#include "Trace.h"
+
+// решатель окончаний поиском по числам доказательства (df-pn): доказывает выигрыш или проигрыш ходящей стороны
+// без оценочной функции. Ничья по правилу ходов без продвижения и любое повторение позиции на пути считаются
+// неудачей нападающего, поэтому доказанный выигрыш не зависит от правил ничьей. Повторение зависит от пути,
+// поэтому в ключ узла входят позиции пути, которые еще могут повториться (после последнего необратимого хода):
+// доказательство из таблицы используется только при том же окне пути (иначе - взаимодействие графа и истории, GHI)
+
+// бесконечное число доказательства/опровержения
+const uint32_t DFPN_INF = 1u << 30;
+// предельная длина пути, дальше - опровержение
+const int DFPN_MAX_PLY = 400;
+
+struct dfpn_limits
+{
+    int64_t nodes = 0;
+    int time_ms = 0;
+};
+
+struct dfpn_result
+{
+    int outcome = 0; // 1 - выигрыш ходящей стороны, -1 - проигрыш, 0 - не доказано (ничья или не хватило лимитов)
+    std::vector<std::vector<move_pos>> line; // доказанная линия от корня, лучшая защита - самая трудная для опровержения
+    int64_t nodes = 0;
+    int64_t proven = 0;    // узлов с доказанным выигрышем нападающего
+    int64_t disproven = 0; // узлов с доказанной невозможностью выигрыша
+    int time_ms = 0;
+};
+
+// таблица чисел доказательства с ограниченной памятью: корзины по 4 записи, вытесняется запись
+// с наименьшей работой; доступ из потоков решателя через полосы мьютексов
+class DfpnTable
+{
+  public:
+    // deferred - память выделяется при первом решении (reserve), а не сразу
+    explicit DfpnTable(const size_t mb = 64, const bool deferred = false) : mb(mb)
+    {
+        if (!deferred)
+            resize(mb);
+    }
+
+    // выделить таблицу, если она еще не выделена
+    void reserve()
+    {
+        if (!buckets)
+            resize(mb);
+    }
+
+    // размер в мегабайтах (округляется вниз до степени двойки корзин)
+    void resize(const size_t size_mb)
+    {
+        mb = size_mb;
+        size_t n = 1;
+        while (n * 2 * WAYS * sizeof(entry) <= (mb << 20))
+            n *= 2;
+        buckets = n;
+        table.reset(new entry[buckets * WAYS]);
+        clear();
+    }
+
+    void clear()
+    {
+        std::fill(table.get(), table.get() + buckets * WAYS, entry());
+    }
+
+    bool probe(const uint64_t key, uint32_t &pn, uint32_t &dn, uint64_t *work = nullptr)
+    {
+        const size_t b = key & (buckets - 1);
+        std::lock_guard<std::mutex> lock(locks[b % LOCKS]);
+        for (size_t k = b * WAYS; k < (b + 1) * WAYS; ++k)
+        {
+            if (table[k].key == key && table[k].work)
+            {
+                pn = table[k].pn;
+                dn = table[k].dn;
+                if (work)
+                    *work = table[k].work;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void store(const uint64_t key, const uint32_t pn, const uint32_t dn, const uint64_t work)
+    {
+        const size_t b = key & (buckets - 1);
+        std::lock_guard<std::mutex> lock(locks[b % LOCKS]);
+        entry *victim = &table[b * WAYS];
+        for (size_t k = b * WAYS; k < (b + 1) * WAYS; ++k)
+        {
+            if (table[k].key == key)
+            {
+                victim = &table[k];
+                break;
+            }
+            if (table[k].work < victim->work)
+                victim = &table[k];
+        }
+        *victim = {key, pn, dn, std::max<uint64_t>(1, work)};
+    }
+
+  private:
+    struct entry
+    {
+        uint64_t key = 0;
+        uint32_t pn = 1, dn = 1;
+        uint64_t work = 0; // узлов, просмотренных под записью; 0 - пусто
+    };
+
+    static const size_t WAYS = 4;
+    static const size_t LOCKS = 1024;
+
+    std::unique_ptr<entry[]> table;
+    size_t buckets = 0;
+    size_t mb;
+    std::mutex locks[LOCKS];
+};
+
+// df-pn на масках для правил Rules. Узел ИЛИ - ходит нападающий (нужен один доказанный ход), узел И - защищающийся
+// (доказаны должны быть все ходы). Потоки ищут от корня в общей таблице, узлы, которые сейчас ищут другие потоки,
+// выбираются с надбавкой, чтобы потоки расходились по разным ветвям
+template <class Rules> class BasicDfpn
+{
+  public:
+    typedef Movegen<8, Rules> movegen;
+
+    BasicDfpn(Config *config, DfpnTable *table) : table(table), config(config), busy(new std::atomic<uint8_t>[BUSY])
+    {
+        for (size_t k = 0; k < BUSY; ++k)
+            busy[k] = 0;
+        reload();
+    }
+
+    void reload()
+    {
+        no_progress_limit = (*config)("Game", "NoProgressLimit");
+    }
+
+    // доказательство выигрыша, а затем проигрыша ходящей стороны; history - позиции партии до корня
+    dfpn_result solve(const bitboard_pos &root, const bool color, const HashHistory &history, const dfpn_limits &limits,
+                      const int threads = 1)
+    {
+        TRACE_SCOPE("dfpn", "search");
+        table->reserve();
+        start = std::chrono::steady_clock::now();
+        // stop, пришедший до начала решения, не теряется
+        stopped = false;
+        if (stop_requested)
+            stopped = true;
+        nodes = proven = disproven = 0;
+        node_limit = limits.nodes;
+        time_limit_ms = limits.time_ms;
+        HashHistory path = history;
+        path.track_windows();
+        if (path.empty() || path.last_key() != position_hash(root, color))
+            path.push(root, color);
+
+        dfpn_result res;
+        for (const bool attacker : {color, !color})
+        {
+            const uint64_t key = node_key(root, color, path, attacker == color);
+            std::vector<std::thread> pool;
+            for (int t = 1; t < threads; ++t)
+                pool.emplace_back([&]() { solve_root(root, color, attacker, path, key); });
+            solve_root(root, color, attacker, path, key);
+            for (auto &th : pool)
+                th.join();
+            uint32_t pn = 1, dn = 1;
+            table->probe(key, pn, dn);
+            if (pn == 0)
+            {
+                res.outcome = attacker == color ? 1 : -1;
+                res.line = proof_line(root, color, attacker, path);
+                break;
+            }
+            if (stopped)
+                break;
+        }
+        res.nodes = nodes;
+        res.proven = proven;
+        res.disproven = disproven;
+        res.time_ms = elapsed_ms();
+        return res;
+    }
+
+    // остановка из другого потока; действует и на solve, который еще не начался
+    void stop()
+    {
+        stop_requested = true;
+        stopped = true;
+    }
+
+    // снять запрос остановки перед запуском solve в другом потоке
+    void clear_stop()
+    {
+        stop_requested = false;
+    }
+
+  private:
+    struct child
+    {
+        bitboard_pos pos;
+        uint64_t key;
+        bool draw; // повторение, ходы без продвижения или предел пути - опровержение
+    };
+
+    void solve_root(const bitboard_pos &root, const bool color, const bool attacker, const HashHistory &history,
+                    const uint64_t key)
+    {
+        HashHistory path = history;
+        uint32_t pn = 1, dn = 1;
+        while (!stopped && !(table->probe(key, pn, dn) && (pn == 0 || dn == 0)))
+            mid(root, color, attacker, DFPN_INF - 1, DFPN_INF - 1, 0, path);
+    }
+
+    // ключ узла: позиция (канонически, отражение с переставленными цветами - тот же узел), тип узла,
+    // число ходов без продвижения (от него зависит ничья по правилу) и позиции пути, которые узел может повторить
+    uint64_t node_key(const bitboard_pos &pos, const bool color, const HashHistory &path, const bool or_node) const
+    {
+        bool flipped;
+        uint64_t key = canonical_hash(pos, color, flipped) ^ (or_node ? 0x6A09E667F3BCC909ull : 0);
+        if (no_progress_limit > 0)
+            key ^= uint64_t(path.quiet_plies() + 1) * 0x9E3779B97F4A7C15ull;
+        key += path.window_hash(flipped);
+        // перемешивание: без него ключи отраженных узлов скапливаются в одних корзинах и счетчиках занятости
+        key = (key ^ (key >> 31)) * 0xBF58476D1CE4E5B9ull;
+        return key ^ (key >> 29);
+    }
+
+    static uint32_t add(const uint32_t a, const uint32_t b)
+    {
+        return std::min(DFPN_INF, a + b);
+    }
+
+    std::atomic<uint8_t> &busy_of(const uint64_t key)
+    {
+        return busy[(key >> 20) & (BUSY - 1)];
+    }
+
+    // числа узла по таблице: draw и отсутствие ходов дают точные значения, новый узел - (1, 1)
+    void child_numbers(const child &c, uint32_t &pn, uint32_t &dn)
+    {
+        if (c.draw)
+        {
+            pn = DFPN_INF;
+            dn = 0;
+        }
+        else if (!table->probe(c.key, pn, dn))
+            pn = dn = 1;
+    }
+
+    // поиск от узла, пока его числа меньше порогов; возвращает число просмотренных узлов
+    uint64_t mid(const bitboard_pos &pos, const bool color, const bool attacker, const uint32_t th_pn,
+                 const uint32_t th_dn, const int ply, HashHistory &path)
+    {
+        const bool or_node = color == attacker;
+        const uint64_t key = node_key(pos, color, path, or_node);
+        if ((++nodes & 1023) == 0 && out_of_limits())
+            stopped = true;
+        std::vector<std::vector<move_pos>> turns;
+        movegen::full_turns(pos, color, turns);
+        // нет ходов - ходящий проиграл
+        if (turns.empty())
+        {
+            table->store(key, or_node ? DFPN_INF : 0, or_node ? 0 : DFPN_INF, 1);
+            ++(or_node ? disproven : proven);
+            return 1;
+        }
+        std::vector<child> children(turns.size());
+        for (size_t k = 0; k < turns.size(); ++k)
+        {
+            children[k].pos = movegen::make_turn(pos, turns[k]);
+            history_guard guard(path, children[k].pos, !color);
+            children[k].key = node_key(children[k].pos, !color, path, !or_node);
+            children[k].draw = ply + 1 >= DFPN_MAX_PLY || path.is_draw(1, no_progress_limit);
+        }
+
+        ++busy_of(key);
+        uint64_t work = 1;
+        uint32_t pn = 1, dn = 1;
+        while (true)
+        {
+            // числа узла по детям и лучший ребенок с учетом потоков, которые уже ищут в нем
+            pn = or_node ? DFPN_INF : 0;
+            dn = or_node ? 0 : DFPN_INF;
+            size_t best = 0;
+            uint32_t best_value = DFPN_INF + 1, second = DFPN_INF, best_pn = 1, best_dn = 1;
+            for (size_t k = 0; k < children.size(); ++k)
+            {
+                uint32_t cpn, cdn;
+                child_numbers(children[k], cpn, cdn);
+                const uint32_t value = add(or_node ? cpn : cdn, busy_of(children[k].key).load());
+                if (or_node)
+                {
+                    pn = std::min(pn, cpn);
+                    dn = add(dn, cdn);
+                }
+                else
+                {
+                    pn = add(pn, cpn);
+                    dn = std::min(dn, cdn);
+                }
+                if (value < best_value)
+                {
+                    second = best_value;
+                    best_value = value;
+                    best = k;
+                    best_pn = cpn;
+                    best_dn = cdn;
+                }
+                else
+                    second = std::min(second, value);
+            }
+            if (stopped || pn == 0 || dn == 0 || pn >= th_pn || dn >= th_dn)
+                break;
+            // пороги ребенка, второй по значению ребенок ограничивает лучший с запасом 1/4 (1 + epsilon)
+            const uint32_t limit = add(second, second / 4 + 1);
+            uint32_t child_pn, child_dn;
+            if (or_node)
+            {
+                child_pn = std::min(th_pn, limit);
+                child_dn = add(th_dn - dn, best_dn);
+            }
+            else
+            {
+                child_dn = std::min(th_dn, limit);
+                child_pn = add(th_pn - pn, best_pn);
+            }
+            history_guard guard(path, children[best].pos, !color);
+            work += mid(children[best].pos, !color, attacker, child_pn, child_dn, ply + 1, path);
+        }
+        --busy_of(key);
+        table->store(key, pn, dn, work);
+        if (pn == 0)
+            ++proven;
+        else if (dn == 0)
+            ++disproven;
+        return work;
+    }
+
+    // линия доказательства: нападающий выбирает доказанный ход с наименьшей работой,
+    // защищающийся - ход с наибольшей работой (дольше всего сопротивляется)
+    std::vector<std::vector<move_pos>> proof_line(bitboard_pos pos, bool color, const bool attacker, HashHistory path)
+    {
+        std::vector<std::vector<move_pos>> line;
+        std::vector<std::vector<move_pos>> turns;
+        for (int ply = 0; ply < DFPN_MAX_PLY; ++ply)
+        {
+            movegen::full_turns(pos, color, turns);
+            int best = -1;
+            uint64_t best_work = 0;
+            for (size_t k = 0; k < turns.size(); ++k)
+            {
+                const bitboard_pos next = movegen::make_turn(pos, turns[k]);
+                history_guard guard(path, next, !color);
+                uint32_t pn, dn;
+                uint64_t work = 0;
+                if (path.is_draw(1, no_progress_limit) || !table->probe(node_key(next, !color, path, color != attacker), pn, dn, &work) ||
+                    pn != 0)
+                    continue;
+                if (best == -1 || (color == attacker ? work < best_work : work > best_work))
+                {
+                    best = int(k);
+                    best_work = work;
+                }
+            }
+            if (best == -1)
+                break;
+            line.push_back(turns[size_t(best)]);
+            pos = movegen::make_turn(pos, turns[size_t(best)]);
+            color = !color;
+            path.push(pos, color);
+        }
+        return line;
+    }
+
+    bool out_of_limits() const
+    {
+        return (node_limit && nodes >= node_limit) || (time_limit_ms && elapsed_ms() >= time_limit_ms);
+    }
+
+    int elapsed_ms() const
+    {
+        return int(
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    static const size_t BUSY = 1 << 16;
+
+    DfpnTable *table;
+    Config *config;
+    std::unique_ptr<std::atomic<uint8_t>[]> busy;
+    int no_progress_limit = 0;
+    std::atomic<bool> stopped{false};
+    std::atomic<bool> stop_requested{false};
+    std::atomic<int64_t> nodes{0}, proven{0}, disproven{0};
+    int64_t node_limit = 0;
+    int time_limit_ms = 0;
+    std::chrono::steady_clock::time_point start;
+};
+
+typedef BasicDfpn<russian_rules> Dfpn;
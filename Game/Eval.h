@@ -0,0 +1,379 @@
+﻿#pragma once
+#include <algorithm>
+#include <fstream>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <nlohmann/json.hpp>
+
+#include "../Models/Bitboard.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #define CHECKERS_X86
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define CHECKERS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+    #define CHECKERS_TARGET_AVX2
+#endif
+
+const int INF = 1e9;
+
+// целочисленные признаки одной стороны
+struct side_features
+{
+    int32_t men = 0;       // число пешек
+    int32_t kings = 0;     // число дамок
+    int32_t advance = 0;   // сумма продвижения пешек (в строках)
+    int32_t back_rank = 0; // пешки, оставшиеся на своей первой строке
+    int32_t center = 0;    // фигуры в центральном квадрате 4x4
+    uint32_t men_mask = 0; // маска пешек: продвижение в оценке складывается по пешкам, как в исходной calc_score
+};
+
+struct eval_features
+{
+    side_features w, b;
+};
+
+// веса признаков, вес пешки всегда равен 1
+struct eval_weights
+{
+    double king = 4;
+    double advance = 0;
+    double back_rank = 0;
+    double center = 0;
+};
+
+// оценка позиций: признаки считаются точно в целых числах (скалярно или пачкой на AVX2),
+// поэтому итоговая оценка не зависит от выбранного пути вычисления
+class Eval
+{
+  public:
+    Eval() = default;
+    explicit Eval(const eval_weights &weights) : weights(weights)
+    {
+    }
+
+    // веса для режимов BotScoringType из settings.json
+    static eval_weights weights_for(const std::string &scoring_mode)
+    {
+        eval_weights res;
+        // "Tuned" начинает с тех же весов, пока не загружен файл весов
+        if (scoring_mode == "NumberAndPotential" || scoring_mode == "Tuned")
+        {
+            res.king = 5;
+            res.advance = 0.05;
+        }
+        return res;
+    }
+
+    // загрузка весов из файла, записанного Tools/tuner.cpp; при ошибке веса не меняются
+    static bool load_weights(const std::string &path, eval_weights &res)
+    {
+        std::ifstream fin(path);
+        if (!fin)
+            return false;
+        try
+        {
+            nlohmann::json j;
+            fin >> j;
+            eval_weights loaded;
+            loaded.king = j["King"];
+            loaded.advance = j["Advance"];
+            loaded.back_rank = j["BackRank"];
+            loaded.center = j["Center"];
+            res = loaded;
+            return true;
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+
+    // запись весов в файл
+    static bool save_weights(const std::string &path, const eval_weights &w)
+    {
+        nlohmann::json j;
+        j["King"] = w.king;
+        j["Advance"] = w.advance;
+        j["BackRank"] = w.back_rank;
+        j["Center"] = w.center;
+        std::ofstream fout(path, std::ios_base::trunc);
+        fout << j.dump(2) << std::endl;
+        return bool(fout);
+    }
+
+    // признаки одной позиции
+    static eval_features features(const bitboard_pos &pos)
+    {
+        eval_features f;
+        f.w.men = popcount32(pos.wm);
+        f.w.kings = popcount32(pos.wk);
+        f.w.advance = 7 * f.w.men - row_sum(pos.wm);
+        f.w.back_rank = popcount32(pos.wm & row_mask(7));
+        f.w.center = popcount32((pos.wm | pos.wk) & center_mask());
+        f.w.men_mask = pos.wm;
+        f.b.men = popcount32(pos.bm);
+        f.b.kings = popcount32(pos.bk);
+        f.b.advance = row_sum(pos.bm);
+        f.b.back_rank = popcount32(pos.bm & row_mask(0));
+        f.b.center = popcount32((pos.bm | pos.bk) & center_mask());
+        f.b.men_mask = pos.bm;
+        return f;
+    }
+
+    // признаки пачки позиций, AVX2 выбирается во время выполнения
+    static void features_batch(const bitboard_pos *pos, const size_t n, eval_features *out)
+    {
+        static const auto impl = has_avx2() ? features_batch_avx2 : features_batch_scalar;
+        impl(pos, n, out);
+    }
+
+    // оценка позиции для игрока first_bot_color (true - черные): отношение сил сторон
+    double score(const eval_features &f, const bool first_bot_color) const
+    {
+        return score(f, men_score(f.w.men_mask, true), men_score(f.b.men_mask, false), first_bot_color);
+    }
+
+    double score(const bitboard_pos &pos, const bool first_bot_color) const
+    {
+        return score(features(pos), first_bot_color);
+    }
+
+    // оценка пачки листьев одного узла: признаки и вклад пешек считаются по 8 позиций на AVX2
+    void score_batch(const bitboard_pos *pos, const size_t n, const bool first_bot_color, double *out) const
+    {
+        static const auto men_impl = has_avx2() ? men_batch_avx2 : men_batch_scalar;
+        const size_t chunk = 64;
+        eval_features f[chunk];
+        double w_men[chunk], b_men[chunk];
+        for (size_t from = 0; from < n; from += chunk)
+        {
+            const size_t cnt = std::min(chunk, n - from);
+            features_batch(pos + from, cnt, f);
+            men_impl(pos + from, cnt, weights.advance, w_men, b_men);
+            for (size_t k = 0; k < cnt; ++k)
+                out[from + k] = score(f[k], w_men[k], b_men[k], first_bot_color);
+        }
+    }
+
+    // поддерживает ли процессор (и ОС) AVX2
+    static bool has_avx2()
+    {
+#if defined(CHECKERS_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] >> 27) & 1, avx = (info[2] >> 28) & 1;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] >> 5) & 1;
+#elif defined(CHECKERS_X86)
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+
+  private:
+    // w_men, b_men - вклад пешек сторон (men_score)
+    double score(const eval_features &f, const double w_men, const double b_men, const bool first_bot_color) const
+    {
+        const side_features &me = first_bot_color ? f.b : f.w;
+        const side_features &op = first_bot_color ? f.w : f.b;
+        // у соперника не осталось шашек, избегаем деления на ноль
+        if (op.men + op.kings == 0)
+            return INF;
+        if (me.men + me.kings == 0)
+            return 0;
+        return side_score(me, first_bot_color ? b_men : w_men) / side_score(op, first_bot_color ? w_men : b_men);
+    }
+
+    double side_score(const side_features &s, const double men) const
+    {
+        return men + weights.king * s.kings + weights.back_rank * s.back_rank + weights.center * s.center;
+    }
+
+    // вклад пешек стороны (white - белые): пешки с продвижением складываются по одной в порядке клеток, так же
+    // как в исходной calc_score, поэтому при нулевых весах остальных признаков оценка совпадает с ней до бита
+    double men_score(const uint32_t men_mask, const bool white) const
+    {
+        return men_score(men_mask, white, weights.advance);
+    }
+
+    static double men_score(const uint32_t men_mask, const bool white, const double advance)
+    {
+        double men = 0;
+        for (uint32_t m = men_mask; m; m &= m - 1)
+        {
+            const int row = square_row(lowest_bit(m));
+            men += 1;
+            men += advance * (white ? 7 - row : row);
+        }
+        return men;
+    }
+
+    static void men_batch_scalar(const bitboard_pos *pos, const size_t n, const double advance, double *w_out,
+                                 double *b_out)
+    {
+        for (size_t k = 0; k < n; ++k)
+        {
+            w_out[k] = men_score(pos[k].wm, true, advance);
+            b_out[k] = men_score(pos[k].bm, false, advance);
+        }
+    }
+
+    // сумма номеров строк всех установленных битов
+    static int row_sum(const uint32_t m)
+    {
+        return popcount32(m & row_bit_mask(0)) + 2 * popcount32(m & row_bit_mask(1)) +
+               4 * popcount32(m & row_bit_mask(2));
+    }
+
+    static void features_batch_scalar(const bitboard_pos *pos, const size_t n, eval_features *out)
+    {
+        for (size_t k = 0; k < n; ++k)
+            out[k] = features(pos[k]);
+    }
+
+#ifdef CHECKERS_X86
+    // число битов в каждом 32-битном слове: таблица по полубайтам + суммирование байтов
+    CHECKERS_TARGET_AVX2 static __m256i popcount_epi32(const __m256i v)
+    {
+        const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1,
+                                             2, 2, 3, 2, 3, 3, 4);
+        const __m256i low = _mm256_set1_epi8(0x0F);
+        const __m256i lo = _mm256_and_si256(v, low);
+        const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+        const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+        const __m256i pairs = _mm256_maddubs_epi16(cnt, _mm256_set1_epi8(1));
+        return _mm256_madd_epi16(pairs, _mm256_set1_epi16(1));
+    }
+
+    CHECKERS_TARGET_AVX2 static __m256i masked_popcount(const __m256i v, const uint32_t mask)
+    {
+        return popcount_epi32(_mm256_and_si256(v, _mm256_set1_epi32(int(mask))));
+    }
+
+    CHECKERS_TARGET_AVX2 static __m256i row_sum_epi32(const __m256i v)
+    {
+        const __m256i r0 = masked_popcount(v, row_bit_mask(0));
+        const __m256i r1 = masked_popcount(v, row_bit_mask(1));
+        const __m256i r2 = masked_popcount(v, row_bit_mask(2));
+        return _mm256_add_epi32(r0, _mm256_add_epi32(_mm256_slli_epi32(r1, 1), _mm256_slli_epi32(r2, 2)));
+    }
+
+    // по 8 позиций за раз, хвост считается скалярно
+    CHECKERS_TARGET_AVX2 static void features_batch_avx2(const bitboard_pos *pos, const size_t n, eval_features *out)
+    {
+        const __m256i idx = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+        alignas(32) int32_t lanes[10][8];
+        size_t k = 0;
+        for (; k + 8 <= n; k += 8)
+        {
+            const int *base = reinterpret_cast<const int *>(pos + k);
+            const __m256i wm = _mm256_i32gather_epi32(base + 0, idx, 4);
+            const __m256i bm = _mm256_i32gather_epi32(base + 1, idx, 4);
+            const __m256i wk = _mm256_i32gather_epi32(base + 2, idx, 4);
+            const __m256i bk = _mm256_i32gather_epi32(base + 3, idx, 4);
+
+            const __m256i w_men = popcount_epi32(wm);
+            const __m256i b_men = popcount_epi32(bm);
+            const __m256i w_adv = _mm256_sub_epi32(_mm256_mullo_epi32(w_men, _mm256_set1_epi32(7)), row_sum_epi32(wm));
+            _mm256_store_si256((__m256i *)lanes[0], w_men);
+            _mm256_store_si256((__m256i *)lanes[1], popcount_epi32(wk));
+            _mm256_store_si256((__m256i *)lanes[2], w_adv);
+            _mm256_store_si256((__m256i *)lanes[3], masked_popcount(wm, row_mask(7)));
+            _mm256_store_si256((__m256i *)lanes[4], masked_popcount(_mm256_or_si256(wm, wk), center_mask()));
+            _mm256_store_si256((__m256i *)lanes[5], b_men);
+            _mm256_store_si256((__m256i *)lanes[6], popcount_epi32(bk));
+            _mm256_store_si256((__m256i *)lanes[7], row_sum_epi32(bm));
+            _mm256_store_si256((__m256i *)lanes[8], masked_popcount(bm, row_mask(0)));
+            _mm256_store_si256((__m256i *)lanes[9], masked_popcount(_mm256_or_si256(bm, bk), center_mask()));
+
+            for (int l = 0; l < 8; ++l)
+            {
+                eval_features &f = out[k + l];
+                f.w = {lanes[0][l], lanes[1][l], lanes[2][l], lanes[3][l], lanes[4][l], pos[k + l].wm};
+                f.b = {lanes[5][l], lanes[6][l], lanes[7][l], lanes[8][l], lanes[9][l], pos[k + l].bm};
+            }
+        }
+        features_batch_scalar(pos + k, n - k, out + k);
+    }
+
+    // men_score для 8 позиций: каждая дорожка делает те же сложения в том же порядке, что и скалярный цикл
+    // (строки по возрастанию, в строке - по пешке), поэтому результат совпадает до бита. В строке r дорожки
+    // с числом пешек больше s прибавляют 1 и вес строки, остальные оставляют сумму без изменений
+    CHECKERS_TARGET_AVX2 static void men_batch_avx2(const bitboard_pos *pos, const size_t n, const double advance,
+                                                    double *w_out, double *b_out)
+    {
+        const __m256i idx = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+        const __m256d one = _mm256_set1_pd(1);
+        size_t k = 0;
+        for (; k + 8 <= n; k += 8)
+        {
+            const int *base = reinterpret_cast<const int *>(pos + k);
+            const __m256i wm = _mm256_i32gather_epi32(base + 0, idx, 4);
+            const __m256i bm = _mm256_i32gather_epi32(base + 1, idx, 4);
+            // суммы белых и черных для позиций 0..3 и 4..7
+            __m256d w_lo = _mm256_setzero_pd(), w_hi = w_lo, b_lo = w_lo, b_hi = w_lo;
+            for (int row = 0; row < 8; ++row)
+            {
+                const __m256i w_cnt = masked_popcount(wm, row_mask(row));
+                const __m256i b_cnt = masked_popcount(bm, row_mask(row));
+                const __m256d wc_lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(w_cnt));
+                const __m256d wc_hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(w_cnt, 1));
+                const __m256d bc_lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(b_cnt));
+                const __m256d bc_hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(b_cnt, 1));
+                const __m256d w_adv = _mm256_set1_pd(advance * (7 - row));
+                const __m256d b_adv = _mm256_set1_pd(advance * row);
+                for (int s = 0; s < 4; ++s)
+                {
+                    const __m256d slot = _mm256_set1_pd(s);
+                    const __m256d w_lo_on = _mm256_cmp_pd(wc_lo, slot, _CMP_GT_OQ);
+                    const __m256d w_hi_on = _mm256_cmp_pd(wc_hi, slot, _CMP_GT_OQ);
+                    const __m256d b_lo_on = _mm256_cmp_pd(bc_lo, slot, _CMP_GT_OQ);
+                    const __m256d b_hi_on = _mm256_cmp_pd(bc_hi, slot, _CMP_GT_OQ);
+                    // ни в одной дорожке нет s+1 пешек в строке - дальше в ней тоже
+                    const __m256d any = _mm256_or_pd(_mm256_or_pd(w_lo_on, w_hi_on), _mm256_or_pd(b_lo_on, b_hi_on));
+                    if (!_mm256_movemask_pd(any))
+                        break;
+                    w_lo = _mm256_blendv_pd(w_lo, _mm256_add_pd(_mm256_add_pd(w_lo, one), w_adv), w_lo_on);
+                    w_hi = _mm256_blendv_pd(w_hi, _mm256_add_pd(_mm256_add_pd(w_hi, one), w_adv), w_hi_on);
+                    b_lo = _mm256_blendv_pd(b_lo, _mm256_add_pd(_mm256_add_pd(b_lo, one), b_adv), b_lo_on);
+                    b_hi = _mm256_blendv_pd(b_hi, _mm256_add_pd(_mm256_add_pd(b_hi, one), b_adv), b_hi_on);
+                }
+            }
+            _mm256_storeu_pd(w_out + k, w_lo);
+            _mm256_storeu_pd(w_out + k + 4, w_hi);
+            _mm256_storeu_pd(b_out + k, b_lo);
+            _mm256_storeu_pd(b_out + k + 4, b_hi);
+        }
+        men_batch_scalar(pos + k, n - k, advance, w_out + k, b_out + k);
+    }
+#else
+    static void features_batch_avx2(const bitboard_pos *pos, const size_t n, eval_features *out)
+    {
+        features_batch_scalar(pos, n, out);
+    }
+
+    static void men_batch_avx2(const bitboard_pos *pos, const size_t n, const double advance, double *w_out,
+                               double *b_out)
+    {
+        men_batch_scalar(pos, n, advance, w_out, b_out);
+    }
+#endif
+
+  public:
+    eval_weights weights;
+};
@@ -3,18 +3,38 @@
 #include <thread>
 
 #include "../Models/Project_path.h"
+#include "Analysis.h"
 #include "Board.h"
 #include "Config.h"
+#include "Corpus.h"
+#include "Dfpn.h"
 #include "Hand.h"
+#include "History.h"
 #include "Logic.h"
+#include "Mcts.h"
+#include "Pdn.h"
+#include "PositionIndex.h"
+#include "Search.h"
+#include "Timeman.h"
+#include "Trace.h"
+#include "Tt.h"
 
 class Game
 {
   public:
-    Game() : board(config("WindowSize", "Width"), config("WindowSize", "Hight")), hand(&board), logic(&board, &config)
+    Game()
+        : board(config("WindowSize", "Width"), config("WindowSize", "Hight"), config("WindowSize", "AnimationMS")),
+          hand(&board), logic(&config),
+          mcts(&config), tt(size_t(int(config("Bot", "HashMB"))), true), search(&config, &tt),
+          solver_table(size_t(int(config("Bot", "SolverHashMB"))), true), solver(&config, &solver_table),
+          analysis(&config, &board)
     {
+        search_eval = eval_settings();
         ofstream fout(project_path + "log.txt", ios_base::trunc);
         fout.close();
+        log_eval_error();
+        // трасса Chrome trace events, пустое имя файла - без трассировки
+        Tracer::instance().start(project_path + string(config("Game", "TraceFile")), config("Game", "TraceSampleRate"));
     }
 
     // to start checkers
@@ -25,8 +45,20 @@ class Game
 		// перезапуск игры
         if (is_replay)
         {
-            logic = Logic(&board, &config);
             config.reload();
+            logic.reload();
+            log_eval_error();
+            mcts.reload();
+            // таблицы поиска переживают перезапуск, пока не поменялась оценка
+            search.reload();
+            solver.reload();
+            analysis.reload();
+            if (eval_settings() != search_eval)
+            {
+                search.clear();
+                analysis.clear();
+                search_eval = eval_settings();
+            }
             board.redraw();
         }
         // первая игра
@@ -35,24 +67,40 @@ class Game
             board.start_draw();
         }
         is_replay = false;
+        clock.reset(int(config("Game", "TimeBaseMS")), int(config("Game", "TimeIncrementMS")),
+                    config("Game", "TimeMovesPerPeriod"));
 
         int turn_num = -1;
         bool is_quit = false;
+        bool is_draw = false;
+        bool is_flag = false;
         const int Max_turns = config("Game", "MaxNumTurns");
         // цикл игры
         while (++turn_num < Max_turns)
         {
             beat_series = 0;
+            // ничья по повторению позиции или по ходам без продвижения
+            sync_history();
+            if (history.is_draw(int(config("Game", "RepetitionLimit")) - 1, config("Game", "NoProgressLimit")))
+            {
+                is_draw = true;
+                break;
+            }
             // поиск возможных ходов
-            logic.find_turns(turn_num % 2);
+            logic.find_turns(turn_num % 2, board.get_board());
             if (logic.turns.empty())
                 break;
             // установка максмального уровня просчета ходов для бота
             logic.Max_depth = config("Bot", string((turn_num % 2) ? "Black" : "White") + string("BotLevel"));
+            clock.start_turn();
 			// ход игрока
             if (!config("Bot", string("Is") + string((turn_num % 2) ? "Black" : "White") + string("Bot")))
             {
+                // пока игрок думает, фоновый анализ показывает лучшие ходы
+                if (analysis.enabled())
+                    analysis.start(board.get_board(), turn_num % 2, history);
                 auto resp = player_turn(turn_num % 2);
+                analysis.stop();
 				// выход из игры
                 if (resp == Response::QUIT)
                 {
@@ -80,19 +128,35 @@ class Game
                     board.rollback();
                     --turn_num;
                     beat_series = 0;
+                    // отмотанный ход не списывается с часов
+                    continue;
                 }
             }
 			// ход бота
             else
                 bot_turn(turn_num % 2);
+            // просрочка времени: проигрывает сторона, которая ходила
+            if (!clock.finish_turn(turn_num % 2))
+            {
+                is_flag = true;
+                break;
+            }
         }
 		// время конца игры
         auto end = chrono::steady_clock::now();
 		// запись времени игры в лог новой строкой
-        ofstream fout(project_path + "log.txt", ios_base::app);
-        fout << "Game time: " << (int)chrono::duration<double, milli>(end - start).count() << " millisec\n";
-        fout.close();
+        {
+            TRACE_ROOT("log", "io");
+            ofstream fout(project_path + "log.txt", ios_base::app);
+            fout << "Game time: " << (int)chrono::duration<double, milli>(end - start).count() << " millisec\n";
+            if (is_flag)
+                fout << (turn_num % 2 ? "Black" : "White") << " lost on time\n";
+            fout.close();
+        }
 
+        // прерванная партия записывается без результата
+        if (is_replay || is_quit)
+            save_game(-1);
         // при перезапуске отрендерить еще раз
         if (is_replay)
             return play();
@@ -101,7 +165,7 @@ class Game
             return 0;
         int res = 2;
 		// если превышено максимальное число ходов, то ничья
-        if (turn_num == Max_turns)
+        if (turn_num == Max_turns || is_draw)
         {
             res = 0;
         }
@@ -110,6 +174,7 @@ class Game
         {
             res = 1;
         }
+        save_game(res);
         // отображение победителя
         board.show_final(res);
         // ждем хода пользователя
@@ -127,40 +192,224 @@ class Game
     // ход бота
     void bot_turn(const bool color)
     {
+        TRACE_ROOT("bot turn", "game");
         auto start = chrono::steady_clock::now();
 
         auto delay_ms = config("Bot", "BotDelayMS");
         // new thread for equal delay for each turn
 		// задержка перед ходом бота
         thread th(SDL_Delay, delay_ms);
-		// поиск лучших ходов
-        auto turns = logic.find_best_turns(color);
-        // выход из задержки перед ходом
-        th.join();
-        bool is_first = true;
-        // making moves
-        for (auto turn : turns)
+        // с часами задержка не списывается со времени бота: часы идут с ее окончания
+        if (clock.enabled())
+        {
+            th.join();
+            clock.start_turn();
+        }
+        // с часами время на ход распределяется по оставшемуся времени (AlphaBeta - не глубже своего уровня)
+        const time_budget budget = clock_budget(color);
+        // мало фигур - сначала решатель: доказанный выигрыш играется без поиска
+        vector<move_pos> turns = solver_turn(color, budget);
+        const bool solved = !turns.empty();
+		// поиск лучших ходов выбранным движком
+        const string engine = config("Bot", "Engine");
+        const bool use_mcts = !solved && engine == "MCTS", use_search = !solved && engine == "Search";
+        if (use_mcts)
+            turns = mcts.find_best_turns(board.get_board(), color,
+                                         clock.enabled() ? budget.soft_ms : int(config("Bot", "MoveTimeMS")),
+                                         history);
+        else if (use_search)
         {
-			// задержка между ходами в серии
-            if (!is_first)
+            // таблица транспозиций, история и ожидаемая линия остаются от прошлых ходов
+            search.history = history;
+            search_limits limits;
+            limits.depth = int(config("Bot", string(color ? "Black" : "White") + "BotLevel")) + 1;
+            limits.move_time_ms = config("Bot", "MoveTimeMS");
+            if (clock.enabled())
             {
-                SDL_Delay(delay_ms);
+                limits.depth = SEARCH_MAX_PLY - 1;
+                limits.move_time_ms = budget.hard_ms;
+                limits.soft_time_ms = budget.soft_ms;
             }
-            is_first = false;
+            turns = search.go(board.get_board(), color, limits);
+        }
+        else if (!solved)
+        {
+            // поиск знает позиции партии, чтобы не повторять их
+            logic.history = history;
+            logic.move_time_ms = clock.enabled() ? budget.hard_ms : 0;
+            logic.soft_time_ms = clock.enabled() ? budget.soft_ms : 0;
+            turns = logic.find_best_turns(board.get_board(), color);
+        }
+        // выход из задержки перед ходом
+        if (th.joinable())
+        {
+            TRACE_SCOPE("bot delay", "game");
+            th.join();
+        }
+        // making moves (серию взятий анимирует поток отрисовки, здесь ходы делаются сразу)
+        for (auto turn : turns)
+        {
 			// количество побитых шашек в серии
             beat_series += (turn.xb != -1);
             board.move_piece(turn, beat_series);
         }
 
         auto end = chrono::steady_clock::now();
+        TRACE_SCOPE("log", "io");
         ofstream fout(project_path + "log.txt", ios_base::app);
 		// запись времени хода бота в лог новой строкой
-        fout << "Bot turn time: " << (int)chrono::duration<double, milli>(end - start).count() << " millisec\n";
+        fout << "Bot turn time: " << (int)chrono::duration<double, milli>(end - start).count() << " millisec";
+        if (use_mcts)
+            fout << ", MCTS playouts: " << mcts.last_playouts;
+        if (!solved && !use_mcts && !use_search && clock.enabled())
+            fout << ", depth: " << logic.last_depth;
+        if (use_search)
+            fout << ", depth: " << search.last.depth << ", nodes: " << search.node_count()
+                 << (search.last.predicted ? ", predicted" : "");
+        if (solved)
+            fout << ", proven win in " << (solver_result.line.size() + 1) / 2 << ", solver nodes: " << solver_result.nodes;
+        if (clock.enabled())
+            fout << ", clock before turn: " << clock.remaining_ms(color) << " ms";
+        fout << "\n";
         fout.close();
     }
 
+    // время на ход бота по часам партии
+    time_budget clock_budget(const bool color)
+    {
+        if (!clock.enabled())
+            return time_budget();
+        const bitboard_pos pos = pack_board(board.get_board());
+        vector<vector<move_pos>> turns;
+        Movegen<8>::full_turns(pos, color, turns);
+        return allocate_time(clock.remaining_ms(color), clock.increment_ms(), clock.moves_to_go(color),
+                             popcount32(pos.wm | pos.bm | pos.wk | pos.bk), int(turns.size()));
+    }
+
+    // ход решателя, если выигрыш доказан за SolverTimeMS (с часами - не дольше половины времени на ход)
+    vector<move_pos> solver_turn(const bool color, const time_budget &budget)
+    {
+        const int max_pieces = config("Bot", "SolverPieces");
+        const bitboard_pos pos = pack_board(board.get_board());
+        if (max_pieces <= 0 || popcount32(pos.wm | pos.bm | pos.wk | pos.bk) > max_pieces)
+            return {};
+        dfpn_limits limits;
+        limits.time_ms = config("Bot", "SolverTimeMS");
+        if (clock.enabled())
+            limits.time_ms = max(1, min(limits.time_ms, budget.soft_ms / 2));
+        int threads = config("Bot", "SolverThreads");
+        if (threads <= 0)
+            threads = max(1, int(thread::hardware_concurrency()));
+        solver_result = solver.solve(pos, color, history, limits, threads);
+        if (solver_result.outcome != 1 || solver_result.line.empty())
+            return {};
+        return solver_result.line[0];
+    }
+
+    // история позиций партии по истории доски: позиции на границах ходов (серия взятий - один ход)
+    void sync_history()
+    {
+        history.clear();
+        bool color = 0;
+        for (size_t k = 0; k < board.history_mtx.size(); ++k)
+        {
+            if (k + 1 < board.history_mtx.size() && board.history_beat_series[k + 1] > 1)
+                continue;
+            history.push(pack_board(board.history_mtx[k]), color);
+            color = !color;
+        }
+    }
+
+    // запись партии в PdnFile и в бинарный корпус CorpusFile (пустые имена отключают запись)
+    void save_game(const int result)
+    {
+        TRACE_ROOT("save game", "io");
+        game_record game;
+        game.start = start_position();
+        // история доски хранит перемещения, ход - серия перемещений, начинающаяся с beat_series <= 1
+        for (size_t k = 1; k < board.history_turns.size(); ++k)
+        {
+            if (game.turns.empty() || board.history_beat_series[k] <= 1)
+                game.turns.emplace_back();
+            game.turns.back().push_back(board.history_turns[k]);
+        }
+        if (game.turns.empty())
+            return;
+        game.result = result;
+        game.tags["White"] = player_name(0);
+        game.tags["Black"] = player_name(1);
+
+        const string pdn_file = config("Game", "PdnFile");
+        if (!pdn_file.empty())
+        {
+            ofstream fout(project_path + pdn_file, ios_base::app);
+            Pdn::write(fout, game);
+        }
+        const string corpus_file = config("Game", "CorpusFile");
+        if (!corpus_file.empty())
+        {
+            {
+                CorpusWriter corpus;
+                if (corpus.open(project_path + corpus_file))
+                    corpus.add(game);
+                else
+                {
+                    // существующий файл не корпус (или другой версии) - он не перезаписывается
+                    ofstream fout(project_path + "log.txt", ios_base::app);
+                    fout << "Can't open corpus " << corpus_file << ", game not saved to it\n";
+                }
+            }
+            update_position_index(project_path + corpus_file);
+        }
+    }
+
+    // индекс позиций корпуса (Game/PositionIndexFile): новые партии дописываются сегментом в фоновом потоке
+    // индекса (вместе со слиянием), так что конец партии не ждет индексации
+    void update_position_index(const string &corpus_path)
+    {
+        const string index_file = config("Game", "PositionIndexFile");
+        if (index_file.empty())
+            return;
+        if (index_file != position_index_file)
+        {
+            position_index_file = index_file;
+            position_index_ok = position_index.open(project_path + index_file);
+        }
+        if (position_index_ok)
+            position_index.update_async(corpus_path);
+    }
+
+    // веса Tuned или сеть NNUE не загрузились - бот играет с оценкой по умолчанию, это пишется в лог
+    void log_eval_error()
+    {
+        if (logic.eval_error.empty())
+            return;
+        ofstream fout(project_path + "log.txt", ios_base::app);
+        fout << "Error: " << logic.eval_error << "\n";
+    }
+
+    // настройки, от которых зависят оценки в таблице транспозиций
+    string eval_settings()
+    {
+        return string(config("Bot", "BotScoringType")) + "|" + string(config("Bot", "WeightsFile")) + "|" +
+               string(config("Bot", "NnueFile"));
+    }
+
+    string player_name(const bool color)
+    {
+        const string side = color ? "Black" : "White";
+        if (!config("Bot", "Is" + side + "Bot"))
+            return "Human";
+        if (config("Bot", "Engine") == "MCTS")
+            return "Bot MCTS " + to_string(int(config("Bot", "MoveTimeMS"))) + " ms";
+        if (config("Bot", "Engine") == "Search")
+            return "Bot search level " + to_string(int(config("Bot", side + "BotLevel")));
+        return "Bot level " + to_string(int(config("Bot", side + "BotLevel")));
+    }
+
     Response player_turn(const bool color)
     {
+        TRACE_ROOT("player turn", "game");
         // return 1 if quit
         vector<pair<POS_T, POS_T>> cells;
         for (auto turn : logic.turns)
@@ -238,7 +487,7 @@ class Game
         beat_series = 1;
         while (true)
         {
-            logic.find_turns(pos.x2, pos.y2);
+            logic.find_turns(pos.x2, pos.y2, board.get_board());
             if (!logic.have_beats)
                 break;
 
@@ -286,6 +535,25 @@ class Game
     Board board;
     Hand hand;
     Logic logic;
+    Mcts mcts;
+    // поиск с итеративным углублением (Engine "Search") и его таблица, общие для всех ходов и партий сессии;
+    // таблицы выделяются при первом поиске, чтобы не занимать память при игре альфа-бета
+    TranspositionTable tt;
+    Search search;
+    // решатель окончаний и его таблица (Bot/SolverPieces)
+    DfpnTable solver_table;
+    Dfpn solver;
+    dfpn_result solver_result;
+    // подсказки для игрока (Game/Analysis), своя таблица транспозиций
+    Analysis analysis;
+    string search_eval;
     int beat_series;
+    HashHistory history;
+    // часы партии (Game/TimeBaseMS), без них боты играют на фиксированной глубине или времени
+    GameClock clock;
+    // индекс позиций корпуса партий, открывается при первом сохранении партии
+    PositionIndex position_index;
+    string position_index_file;
+    bool position_index_ok = false;
     bool is_replay = false;
 };
@@ -4,6 +4,7 @@
 #include "../Models/Move.h"
 #include "../Models/Response.h"
 #include "Board.h"
+#include "Trace.h"
 
 // methods for hands
 class Hand
@@ -15,6 +16,7 @@ class Hand
 	// получение координат клетки, на которую кликнул игрок
     tuple<Response, POS_T, POS_T> get_cell() const
     {
+        TRACE_SCOPE("input wait", "input");
         SDL_Event windowEvent;
         Response resp = Response::OK;
         int x = -1, y = -1;
@@ -31,21 +33,21 @@ class Hand
                 case SDL_MOUSEBUTTONDOWN:
                     x = windowEvent.motion.x;
                     y = windowEvent.motion.y;
-                    // определение индексов клетки / кнопки
-                    xc = int(y / (board->H / 10) - 1);
-                    yc = int(x / (board->W / 10) - 1);
+                    // определение индексов клетки / кнопки: окно - доска и поле в клетку вокруг нее
+                    xc = int(y / (board->H / (game_geometry::size + 2)) - 1);
+                    yc = int(x / (board->W / (game_geometry::size + 2)) - 1);
 					// нажата кнопка отката хода
                     if (xc == -1 && yc == -1 && board->history_mtx.size() > 1)
                     {
                         resp = Response::BACK;
                     }
 					// нажата кнопка перезапуска игры
-                    else if (xc == -1 && yc == 8)
+                    else if (xc == -1 && yc == game_geometry::size)
                     {
                         resp = Response::REPLAY;
                     }
 					// выбрана клетка на доске
-                    else if (xc >= 0 && xc < 8 && yc >= 0 && yc < 8)
+                    else if (game_geometry::on_board(xc, yc))
                     {
                         resp = Response::CELL;
                     }
@@ -73,6 +75,7 @@ class Hand
     // ожидание действия игрока
     Response wait() const
     {
+        TRACE_ROOT("input wait", "input");
         SDL_Event windowEvent;
         Response resp = Response::OK;
         while (true)
@@ -93,10 +96,10 @@ class Hand
                 case SDL_MOUSEBUTTONDOWN: {
                     int x = windowEvent.motion.x;
                     int y = windowEvent.motion.y;
-                    int xc = int(y / (board->H / 10) - 1);
-                    int yc = int(x / (board->W / 10) - 1);
+                    int xc = int(y / (board->H / (game_geometry::size + 2)) - 1);
+                    int yc = int(x / (board->W / (game_geometry::size + 2)) - 1);
 					// нажата кнопка перезапуска игры
-                    if (xc == -1 && yc == 8)
+                    if (xc == -1 && yc == game_geometry::size)
                         resp = Response::REPLAY;
                 }
                 break;
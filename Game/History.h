@@ -0,0 +1,135 @@
+﻿#pragma once
+#include <stdint.h>
+#include <vector>
+
+#include "../Models/Bitboard.h"
+#include "../Models/Zobrist.h"
+
+// история позиций партии и текущего пути поиска для правил ничьей:
+// повторение позиции и ходы без продвижения (только дамками, без взятий)
+class HashHistory
+{
+  public:
+    void clear()
+    {
+        entries.clear();
+    }
+
+    // накапливать хеши окон обратимых ходов для window_hash (нужны решателю, поиску - нет)
+    void track_windows()
+    {
+        windows = true;
+        for (size_t k = 0; k < entries.size(); ++k)
+            update_window(k);
+    }
+
+    // позиция после очередного хода (или начальная); color - чей ход в ней
+    void push(const bitboard_pos &pos, const bool color)
+    {
+        const int q = entries.empty() ? 0 : reversible(entries.back().pos, pos) ? entries.back().quiet + 1 : 0;
+        entries.push_back({position_hash(pos, color), q, pos, color, {0, 0}});
+        if (windows)
+            update_window(entries.size() - 1);
+    }
+
+    void pop()
+    {
+        entries.pop_back();
+    }
+
+    bool empty() const
+    {
+        return entries.empty();
+    }
+
+    uint64_t last_key() const
+    {
+        return entries.back().key;
+    }
+
+    // сколько раз последняя позиция встречалась раньше (повторение возможно только после обратимых ходов)
+    int repetitions() const
+    {
+        int cnt = 0;
+        const size_t n = entries.size();
+        const entry &last = entries.back();
+        for (size_t k = 4; k <= size_t(last.quiet) && k < n; k += 2)
+            cnt += entries[n - 1 - k].key == last.key;
+        return cnt;
+    }
+
+    // число обратимых ходов подряд перед последней позицией
+    int quiet_plies() const
+    {
+        return entries.empty() ? 0 : entries.back().quiet;
+    }
+
+    // хеш позиций перед последней, которые еще могут повториться (после последнего необратимого хода);
+    // flipped - позиции берутся отраженными flip_colors, как в canonical_hash. Результат поиска, в котором
+    // повторение - ничья, зависит от пути только через эти позиции. Только после track_windows
+    uint64_t window_hash(const bool flipped) const
+    {
+        if (entries.size() < 2 || !entries.back().quiet)
+            return 0;
+        return entries[entries.size() - 2].window[flipped];
+    }
+
+    // ничья: позиция повторилась repeat_limit раз или no_progress обратимых ходов подряд (0 - правило выключено)
+    bool is_draw(const int repeat_limit, const int no_progress) const
+    {
+        return (no_progress > 0 && quiet_plies() >= no_progress) || (repeat_limit > 0 && repetitions() >= repeat_limit);
+    }
+
+  private:
+    // ход дамкой без взятия: шашки не двигались, число фигур не изменилось
+    static bool reversible(const bitboard_pos &before, const bitboard_pos &after)
+    {
+        return before.wm == after.wm && before.bm == after.bm &&
+               popcount32(before.wk | before.bk) == popcount32(after.wk | after.bk);
+    }
+
+    // хеш окна накапливается с начала серии обратимых ходов: для позиций как есть и для отражений
+    void update_window(const size_t k)
+    {
+        entry &e = entries[k];
+        const bool cont = k > 0 && e.quiet;
+        e.window[0] = (cont ? entries[k - 1].window[0] : 0) + mix(e.key);
+        e.window[1] = (cont ? entries[k - 1].window[1] : 0) + mix(position_hash(flip_colors(e.pos), !e.color));
+    }
+
+    static uint64_t mix(uint64_t x)
+    {
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    struct entry
+    {
+        uint64_t key;
+        // обратимых ходов подряд перед позицией
+        int quiet;
+        bitboard_pos pos;
+        bool color;
+        // сумма перемешанных хешей позиций с начала серии обратимых ходов по эту включительно (как есть, отражений)
+        uint64_t window[2];
+    };
+    std::vector<entry> entries;
+    bool windows = false;
+};
+
+// позиция в истории на время обхода узла поиска
+struct history_guard
+{
+    history_guard(HashHistory &history, const bitboard_pos &pos, const bool color) : history(history)
+    {
+        history.push(pos, color);
+    }
+
+    ~history_guard()
+    {
+        history.pop();
+    }
+
+    HashHistory &history;
+};
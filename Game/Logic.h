@@ -1,59 +1,99 @@
 ﻿#pragma once
+#include <algorithm>
+#include <chrono>
+#include <ctime>
 #include <random>
+#include <string>
 #include <vector>
 
+#include "../Models/Bitboard.h"
 #include "../Models/Move.h"
-#include "Board.h"
 #include "Config.h"
-
-const int INF = 1e9;
+#include "Eval.h"
+#include "History.h"
+#include "Nnue.h"
+#include "Trace.h"
+
+using namespace std;
+
+// выборочный поиск уровня O2 (оценки - отношения сил, поэтому запасы - множители)
+// ProbCut: с этой глубины до листьев ветка сначала проверяется поиском на O2_PROBCUT_REDUCTION мельче
+const size_t O2_PROBCUT_DEPTH = 5;
+const size_t O2_PROBCUT_REDUCTION = 2;
+const double O2_PROBCUT_MARGIN = 1.25;
+// futility pruning: тихие ходы за два хода до листьев при оценке хуже границы окна с этим запасом
+const double O2_FUTILITY_MARGIN = 1.2;
+// сокращение на один ход тихих ходов после первых O2_LMR_MOVES (по оценке после хода)
+const size_t O2_LMR_MOVES = 3;
 
 class Logic
 {
   public:
-    Logic(Board *board, Config *config) : board(board), config(config)
+    Logic(Config *config) : config(config)
+    {
+        reload();
+    }
+
+    // перечитать настройки бота (после перезапуска игры), загруженные веса заменяются
+    void reload()
     {
         rand_eng = std::default_random_engine (
             !((*config)("Bot", "NoRandom")) ? unsigned(time(0)) : 0);
         scoring_mode = (*config)("Bot", "BotScoringType");
         optimization = (*config)("Bot", "Optimization");
+        no_progress_limit = (*config)("Game", "NoProgressLimit");
+        eval = Eval(Eval::weights_for(scoring_mode));
+        // подобранные веса загружаются при старте из файла WeightsFile; без него остаются веса NumberAndPotential,
+        // и об этом сообщается в eval_error
+        eval_error.clear();
+        if (scoring_mode == "Tuned")
+        {
+            const string weights_file = (*config)("Bot", "WeightsFile");
+            if (!Eval::load_weights(project_path + weights_file, eval.weights))
+                eval_error = "can't load evaluation weights from " + weights_file + ", Tuned uses NumberAndPotential weights";
+        }
+        // сеть NNUE загружается из NnueFile; без файла (или с испорченным) - сеть по материалу, а не сеть
+        // прошлой загрузки, и об этом сообщается в eval_error
+        use_nnue = scoring_mode == "NNUE";
+        if (use_nnue)
+        {
+            const string nnue_file = (*config)("Bot", "NnueFile");
+            if (!nnue.load(project_path + nnue_file))
+            {
+                nnue.init_material();
+                eval_error = "can't load network from " + nnue_file + ", NNUE uses the material network";
+            }
+        }
     }
 
-    vector<move_pos> find_best_turns(const bool color)
+    // лучшая серия ходов цвета color в позиции mtx. Каждый поиск начинается заново: таблицы транспозиций
+    // и ожидаемой линии у AlphaBeta нет, их между ходами сохраняет Search (Engine "Search")
+    vector<move_pos> find_best_turns(const vector<vector<POS_T>> &mtx, const bool color)
     {
-        // Сбрасываем внутренние структуры, но используем их иначе
-        next_move.clear();
-        next_best_state.clear();
-
-        // Гарантируем наличие корневого состояния
-        next_best_state.push_back(-1);
-        next_move.emplace_back(-1, -1, -1, -1);
-
-        // Стартуем подбор лучшей линии хода для текущего игрока
-        // В качестве "корня" передаём текущую доску и state = 0
-        find_first_best_turn(board->get_board(), color, -1, -1, /*state=*/0, /*alpha=*/-1.0);
-
-        // Восстанавливаем найденную линию ходов из next_*
-        vector<move_pos> line;
-        int st = 0;
-        while (st != -1 && st < (int)next_move.size())
-        {
-            const auto mv = next_move[st];
-            if (mv.x == -1) break;
-            line.push_back(mv);
-            st = next_best_state[st];
-        }
-        return line;
+        TRACE_SCOPE_ARG("find_best_turns", "search", Max_depth);
+        // аккумулятор NNUE корня пересчитывается полностью, дальше - только обновления по ходам
+        if (use_nnue)
+            nnue_stack.assign(1, nnue.refresh(pack_board(mtx)));
+
+        // поиск считает серию взятий одним ходом, перемещения серии восстанавливаются только для лучшего хода
+        compound_move best;
+        if (move_time_ms > 0)
+            last_score = find_first_best_turn_timed(mtx, color, best);
+        else
+            last_score = find_first_best_turn(mtx, color, best);
+        if (best.x == -1)
+            return {};
+        return turn_path(mtx, color, best);
     }
 
-private:
     vector<vector<POS_T>> make_turn(vector<vector<POS_T>> mtx, move_pos turn) const
     {
         // убираем побитую шашку
         if (turn.xb != -1)
             mtx[turn.xb][turn.yb] = 0;
         // превращаем шашку в дамку
-        if ((mtx[turn.x][turn.y] == 1 && turn.x2 == 0) || (mtx[turn.x][turn.y] == 2 && turn.x2 == 7))
+        if ((mtx[turn.x][turn.y] == 1 && turn.x2 == game_geometry::promotion_row(0)) ||
+            (mtx[turn.x][turn.y] == 2 && turn.x2 == game_geometry::promotion_row(1)))
             mtx[turn.x][turn.y] += 2;
 		// передвигаем шашку на новое место
         mtx[turn.x2][turn.y2] = mtx[turn.x][turn.y];
@@ -62,156 +102,284 @@ private:
         return mtx;
     }
 
-    // подсчет очков бота для оценки текущей расстановки
-    double calc_score(const vector<vector<POS_T>> &mtx, const bool first_bot_color) const
+    // полный ход: побитые шашки снимаются все сразу
+    vector<vector<POS_T>> make_turn(vector<vector<POS_T>> mtx, const compound_move &turn) const
+    {
+        const POS_T type = mtx[turn.x][turn.y];
+        for (uint32_t m = turn.captured; m; m &= m - 1)
+        {
+            const int sq = lowest_bit(m);
+            mtx[square_row(sq)][square_col(sq)] = 0;
+        }
+        mtx[turn.x][turn.y] = 0;
+        mtx[turn.x2][turn.y2] = type + (turn.promotes ? 2 : 0);
+        return mtx;
+    }
+
+    // все полные ходы цвета color одним перемещением каждый; серии взятий, приводящие к одной позиции, -
+    // один ход; порядок - как у find_turns (первые перемещения перемешаны)
+    vector<compound_move> find_compound_turns(const vector<vector<POS_T>> &mtx, const bool color)
     {
-        // color - who is max player
-        double w = 0, wq = 0, b = 0, bq = 0;
-        for (POS_T i = 0; i < 8; ++i)
+        vector<compound_move> res;
+        find_turns(color, mtx);
+        if (!have_beats)
         {
-            for (POS_T j = 0; j < 8; ++j)
+            for (const auto &mv : turns)
             {
-                w += (mtx[i][j] == 1); // пешка белых
-				wq += (mtx[i][j] == 3); // дамка белых
-				b += (mtx[i][j] == 2); // пешка черных
-				bq += (mtx[i][j] == 4); // дамка черных
-                if (scoring_mode == "NumberAndPotential")
-                {
-                    w += 0.05 * (mtx[i][j] == 1) * (7 - i); // насколько далеко пешка белых от дамки
-					b += 0.05 * (mtx[i][j] == 2) * (i); // насколько далеко пешка черных от дамки
-                }
+                const POS_T type = mtx[mv.x][mv.y];
+                compound_move turn;
+                turn.x = mv.x;
+                turn.y = mv.y;
+                turn.x2 = mv.x2;
+                turn.y2 = mv.y2;
+                turn.promotes = (type == 1 && mv.x2 == game_geometry::promotion_row(0)) ||
+                                (type == 2 && mv.x2 == game_geometry::promotion_row(1));
+                res.push_back(turn);
             }
+            return res;
         }
-        // мы считаем очки для черных
-        if (!first_bot_color)
+        const auto first = turns;
+        vector<vector<POS_T>> board = mtx;
+        for (const auto &mv : first)
         {
-            swap(b, w);
-            swap(bq, wq);
+            compound_move turn;
+            turn.x = mv.x;
+            turn.y = mv.y;
+            collect_captures(board, mv, turn, res);
         }
-        
-		// если у белых нет шашек, то избегаем деления на ноль
-        if (w + wq == 0)
-            return INF;
-        if (b + bq == 0)
-            return 0;
-        int q_coef = 4;
-        if (scoring_mode == "NumberAndPotential")
+        return res;
+    }
+
+    // полный ход, который дает серия перемещений series из позиции mtx
+    compound_move compound_of(vector<vector<POS_T>> mtx, const vector<move_pos> &series) const
+    {
+        compound_move turn;
+        if (series.empty())
+            return turn;
+        turn.x = series.front().x;
+        turn.y = series.front().y;
+        const POS_T type = mtx[turn.x][turn.y];
+        for (const auto &mv : series)
         {
-            // усиливаем коэффициент дамки
-            q_coef = 5;
+            if (mv.xb != -1)
+                turn.captured |= uint32_t(1) << square_index(mv.xb, mv.yb);
+            mtx = make_turn(mtx, mv);
         }
-        return (b + bq * q_coef) / (w + wq * q_coef);
+        turn.x2 = series.back().x2;
+        turn.y2 = series.back().y2;
+        turn.promotes = mtx[turn.x2][turn.y2] != type;
+        return turn;
     }
 
-    double find_first_best_turn(std::vector<std::vector<POS_T>> mtx,
-        const bool color,
-        const POS_T x,
-        const POS_T y,
-        size_t state,
-        double alpha /*= -1*/)
+    // перемещения серии для полного хода turn (для показа на доске и записи партии)
+    vector<move_pos> turn_path(const vector<vector<POS_T>> &mtx, const bool color, const compound_move &turn)
     {
-        // Убедимся, что для текущего узла есть плейсхолдеры
-        if (state >= next_move.size())
+        for (const auto &series : find_full_turns(mtx, color))
         {
-            next_best_state.push_back(-1);
-            next_move.emplace_back(-1, -1, -1, -1);
+            if (compound_of(mtx, series) == turn)
+                return series;
         }
+        return {};
+    }
 
-        // Получаем список доступных ходов:
-        // если x,y заданы - продолжаем бить той же шашкой, иначе ищем по цвету
-        if (x != -1) find_turns(x, y, mtx);
-        else         find_turns(color, mtx);
+    // все полные ходы цвета color: серия взятий одной шашкой считается одним ходом
+    vector<vector<move_pos>> find_full_turns(const vector<vector<POS_T>> &mtx, const bool color)
+    {
+        vector<vector<move_pos>> res;
+        vector<move_pos> series;
+        collect_full_turns(mtx, color, -1, -1, series, res);
+        return res;
+    }
 
-        const auto local_turns = turns;
-        const bool forced_beat = have_beats;
+    // статическая оценка позиции для игрока color в единицах calc_score
+    double evaluate(const vector<vector<POS_T>> &mtx, const bool color) const
+    {
+        return evaluate(pack_board(mtx), color);
+    }
+
+    double evaluate(const bitboard_pos &pos, const bool color) const
+    {
+        if (use_nnue)
+            return nnue.score(nnue.refresh(pos), color);
+        return eval.score(pos, color);
+    }
 
-        // Если побитий нет и это не корневой "пустой" ход продолжения -
-        // передаём ход оппоненту на обычный рекурсивный просчёт
-        if (!forced_beat && x != -1)
+private:
+    // продолжение серии взятий перемещением hop на доске mtx; законченные серии добавляются в res,
+    // доска возвращается в исходное состояние
+    void collect_captures(vector<vector<POS_T>> &mtx, const move_pos &hop, compound_move turn,
+                          vector<compound_move> &res)
+    {
+        const POS_T type = mtx[hop.x][hop.y], beaten = mtx[hop.xb][hop.yb];
+        POS_T new_type = type;
+        if ((type == 1 && hop.x2 == game_geometry::promotion_row(0)) ||
+            (type == 2 && hop.x2 == game_geometry::promotion_row(1)))
+            new_type += 2;
+        mtx[hop.xb][hop.yb] = 0;
+        mtx[hop.x][hop.y] = 0;
+        mtx[hop.x2][hop.y2] = new_type;
+        turn.x2 = hop.x2;
+        turn.y2 = hop.y2;
+        turn.captured |= uint32_t(1) << square_index(hop.xb, hop.yb);
+        turn.promotes = turn.promotes || new_type != type;
+
+        find_turns(hop.x2, hop.y2, mtx);
+        if (!have_beats)
         {
-            return find_best_turns_rec(mtx, 1 - color, /*depth=*/0, alpha);
+            if (find(res.begin(), res.end(), turn) == res.end())
+                res.push_back(turn);
         }
-
-        // Если совсем нет ходов — оценим позицию как проигранную/выигранную на этом уровне
-        if (local_turns.empty())
+        else
         {
-            return 0.0; // при продолжении цепочки побитий отсутствие ходов => конец цепи
+            const auto next = turns;
+            for (const auto &mv : next)
+                collect_captures(mtx, mv, turn, res);
         }
 
-        double best_score = -1.0;
-        int    best_next_state = -1;
-        move_pos best_move(-1, -1, -1, -1);
+        mtx[hop.x2][hop.y2] = 0;
+        mtx[hop.x][hop.y] = type;
+        mtx[hop.xb][hop.yb] = beaten;
+    }
 
-        // Перебираем все ходы из текущего положения
-        for (const auto& mv : local_turns)
+    void collect_full_turns(const vector<vector<POS_T>> &mtx, const bool color, const POS_T x, const POS_T y,
+                            vector<move_pos> &series, vector<vector<move_pos>> &res)
+    {
+        if (x != -1) find_turns(x, y, mtx);
+        else         find_turns(color, mtx);
+        // серия взятий закончилась
+        if (x != -1 && !have_beats)
         {
-            // Готовим дочернее состояние для восстановления линии
-            const size_t child_state = next_move.size();
-            next_best_state.push_back(-1);
-            next_move.emplace_back(-1, -1, -1, -1);
-
-            const auto next_mtx = make_turn(mtx, mv);
-
-            double score;
+            res.push_back(series);
+            return;
+        }
+        const auto local_turns = turns;
+        const bool forced_beat = have_beats;
+        for (const auto &mv : local_turns)
+        {
+            series.push_back(mv);
             if (forced_beat)
-            {
-                // Продолжаем цепочку побитий той же шашкой (ход того же цвета, глубина не растёт)
-                score = find_first_best_turn(next_mtx, color, mv.x2, mv.y2, child_state, best_score);
-            }
+                collect_full_turns(make_turn(mtx, mv), color, mv.x2, mv.y2, series, res);
             else
-            {
-                // Обычный ход: передаём ход сопернику и считаем дальнейший расклад
-                score = find_best_turns_rec(next_mtx, 1 - color, /*depth=*/0, /*alpha=*/best_score);
-            }
+                res.push_back(series);
+            series.pop_back();
+        }
+    }
+
+    // подсчет очков бота для оценки текущей расстановки
+    double calc_score(const vector<vector<POS_T>> &mtx, const bool first_bot_color) const
+    {
+        // first_bot_color - who is max player
+        if (use_nnue)
+            return nnue.score(nnue_stack.back(), first_bot_color);
+        return eval.score(pack_board(mtx), first_bot_color);
+    }
+
+    // make/unmake для аккумулятора NNUE вокруг рекурсивного спуска
+    void nnue_make(const vector<vector<POS_T>> &mtx, const compound_move &turn)
+    {
+        if (!use_nnue)
+            return;
+        nnue_stack.push_back(nnue_stack.back());
+        nnue.apply_move(nnue_stack.back(), mtx, turn);
+    }
+
+    void nnue_unmake()
+    {
+        if (use_nnue)
+            nnue_stack.pop_back();
+    }
 
+    // корень: лучший полный ход цвета color; 0, если ходов нет
+    double find_first_best_turn(const vector<vector<POS_T>> &mtx, const bool color, compound_move &best)
+    {
+        const auto local_turns = find_compound_turns(mtx, color);
+        double best_score = local_turns.empty() ? 0.0 : -1.0;
+        for (size_t k = 0; k < local_turns.size(); ++k)
+        {
+            const auto &mv = local_turns[k];
+            TRACE_SCOPE_ARG("root move", "search", k);
+            nnue_make(mtx, mv);
+            // лучшая оценка среди уже просчитанных ходов корня отсекает явных аутсайдеров
+            const double score =
+                find_best_turns_rec(make_turn(mtx, mv), 1 - color, /*depth=*/0, size_t(Max_depth), best_score);
+            nnue_unmake();
             if (score > best_score)
             {
                 best_score = score;
-                best_move = mv;
-                best_next_state = forced_beat ? int(child_state) : -1;
-
-                // Пишем лучший на текущий момент результат в корень состояния
-                next_move[state] = best_move;
-                next_best_state[state] = best_next_state;
-
-                // Простейшее "псевдо"-альфа: для ускорения отсекаем явные аутсайдеры
-                if (optimization != "O0" && alpha >= 0.0 && best_score > alpha)
-                    alpha = best_score;
+                best = mv;
             }
         }
+        return best_score;
+    }
 
+    // итеративное углубление до Max_depth во время move_time_ms: итерация, прерванная по времени, отбрасывается,
+    // новая не начинается после половины soft_time_ms. Первая итерация досчитывается всегда
+    double find_first_best_turn_timed(const vector<vector<POS_T>> &mtx, const bool color, compound_move &best)
+    {
+        const auto start = chrono::steady_clock::now();
+        deadline = start + chrono::milliseconds(move_time_ms);
+        const int max_depth = Max_depth;
+        double best_score = 0;
+        last_depth = 0;
+        for (int depth = 1; depth <= max_depth; ++depth)
+        {
+            compound_move turn;
+            Max_depth = depth;
+            timed = depth > 1;
+            out_of_time = false;
+            const double score = find_first_best_turn(mtx, color, turn);
+            if (out_of_time)
+                break;
+            best = turn;
+            best_score = score;
+            last_depth = depth;
+            if (soft_time_ms > 0 &&
+                chrono::steady_clock::now() - start >= chrono::milliseconds(soft_time_ms / 2))
+                break;
+        }
+        Max_depth = max_depth;
+        timed = false;
         return best_score;
     }
 
-    double find_best_turns_rec(std::vector<std::vector<POS_T>> mtx,
+    double find_best_turns_rec(const std::vector<std::vector<POS_T>> &mtx,
         const bool color,
         const size_t depth,
+        const size_t horizon,
         double alpha = -1,
-        double beta = INF + 1,
-        const POS_T x = -1,
-        const POS_T y = -1)
+        double beta = INF + 1)
+    {
+        // время хода вышло - итерация отбрасывается, оценка не важна
+        if (timed && (out_of_time || ((++time_checks & 255) == 0 && chrono::steady_clock::now() >= deadline)))
+        {
+            out_of_time = true;
+            return 1.0;
+        }
+        // повторение позиции на пути или в партии и ходы без продвижения - ничья (равенство сил), и в листьях тоже
+        history_guard guard(history, pack_board(mtx), color);
+        if (history.is_draw(1, no_progress_limit))
+            return 1.0;
+        return find_best_turns_node(mtx, color, depth, horizon, alpha, beta);
+    }
+
+    // horizon - глубина листьев этой ветки (Max_depth, меньше - в сокращенных ветках O2)
+    double find_best_turns_node(const std::vector<std::vector<POS_T>> &mtx,
+        const bool color,
+        const size_t depth,
+        const size_t horizon,
+        double alpha,
+        double beta)
     {
         // Лист: достигнута максимальная глубина — оцениваем позицию
-        if (depth == static_cast<size_t>(Max_depth))
+        if (depth >= horizon)
         {
             // Соответствие исходному контракту оценки:
             // кто является "макс"-игроком определяется parity(depth) и color
             return calc_score(mtx, (depth % 2 == color));
         }
 
-        // Генерируем ходы: продолжение цепочки для конкретной шашки или общий поиск по цвету
-        if (x != -1) find_turns(x, y, mtx);
-        else         find_turns(color, mtx);
-
-        const bool forced_beat = have_beats;
-        const auto local_turns = turns;
-
-        // Если мы находимся в режиме продолжения конкретной шашки (x!=-1),
-        // но побитий нет — ход переходит сопернику, глубина увеличивается.
-        if (!forced_beat && x != -1)
-        {
-            return find_best_turns_rec(mtx, 1 - color, depth + 1, alpha, beta);
-        }
+        // полные ходы: серия взятий - один ход, ход всегда переходит сопернику
+        const auto local_turns = find_compound_turns(mtx, color);
 
         // Нет ходов вообще — терминальное состояние: победа/поражение по ходу
         if (local_turns.empty())
@@ -223,24 +391,106 @@ private:
         // Чётная глубина — минимизатор, нечётная — максимизатор (как и раньше).
         double best_min = INF + 1.0;
         double best_max = -1.0;
+        const bool max_layer = depth % 2;
+        // оценки детей - для бота (цвет бота одинаков во всем дереве)
+        const bool bot_color = (depth + 1) % 2 == size_t(1 - color);
+        const size_t remaining = horizon - depth;
+        // O2: выборочный поиск (ProbCut, futility pruning, сокращения поздних тихих ходов)
+        const bool selective = optimization == "O2";
+        const bool forced_beat = local_turns.front().captured != 0;
+
+        // ProbCut: если поиск на O2_PROBCUT_REDUCTION мельче уверенно выходит за границу окна, ветка отсекается
+        if (selective && remaining >= O2_PROBCUT_DEPTH)
+        {
+            const size_t shallow = horizon - O2_PROBCUT_REDUCTION;
+            if (max_layer && beta <= INF)
+            {
+                const double bound = beta * O2_PROBCUT_MARGIN;
+                const double val = find_best_turns_node(mtx, color, depth, shallow, bound, INF + 1);
+                if (val >= bound)
+                    return val;
+            }
+            else if (!max_layer && alpha > 0)
+            {
+                const double bound = alpha / O2_PROBCUT_MARGIN;
+                const double val = find_best_turns_node(mtx, color, depth, shallow, -1, bound);
+                if (val <= bound)
+                    return val;
+            }
+        }
+
+        // Если все дочерние позиции - листья, оцениваем их одной пачкой (взятия тоже)
+        const bool leaf_children = remaining == 1;
+        if (leaf_children)
+        {
+            leaf_scores.resize(local_turns.size());
+            score_children(mtx, local_turns, bot_color, leaf_scores.data());
+            // листья пачки не проходят find_best_turns_rec, поэтому ничья проверяется здесь; повторить позицию
+            // и продлить серию без продвижения может только ход дамкой без взятия
+            const bitboard_pos parent = pack_board(mtx);
+            for (size_t k = 0; k < local_turns.size(); ++k)
+            {
+                const auto &mv = local_turns[k];
+                if (mv.captured || mtx[mv.x][mv.y] < 3)
+                    continue;
+                history_guard guard(history, make_compound_move(parent, mv), 1 - color);
+                if (history.is_draw(1, no_progress_limit))
+                    leaf_scores[k] = 1.0;
+            }
+        }
 
-        for (const auto& mv : local_turns)
+        // O2: ходы упорядочиваются по оценке позиции после хода (лучшие для ходящего - первыми),
+        // чтобы сокращались действительно поздние ходы
+        vector<size_t> order;
+        if (selective && remaining >= 3 && local_turns.size() > 1)
         {
-            const auto next_mtx = make_turn(mtx, mv);
+            order.resize(local_turns.size());
+            for (size_t k = 0; k < order.size(); ++k)
+                order[k] = k;
+            vector<double> child(local_turns.size());
+            score_children(mtx, local_turns, bot_color, child.data());
+            stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+                return max_layer ? child[a] > child[b] : child[a] < child[b];
+            });
+        }
+        // статическая оценка для futility pruning за два хода до листьев
+        const bool futility = selective && remaining == 2 && !forced_beat;
+        const double static_score = futility ? calc_score(mtx, bot_color) : 0.0;
+
+        for (size_t k = 0; k < local_turns.size(); ++k)
+        {
+            const size_t idx = order.empty() ? k : order[k];
+            const auto &mv = local_turns[idx];
+            // тихий ход: не взятие, не превращение и не выход шашки на предпоследнюю строку
+            const bool quiet = !forced_beat && !mv.promotes && !promotion_threat(mtx, mv);
             double val;
 
-            if (forced_beat || x != -1)
+            if (leaf_children)
+            {
+                val = leaf_scores[idx];
+            }
+            else if (futility && quiet &&
+                     (max_layer ? static_score * O2_FUTILITY_MARGIN <= alpha
+                                : static_score >= beta * O2_FUTILITY_MARGIN))
             {
-                // Если есть обязательные побития или мы продолжаем цепочку,
-                // ход остаётся за тем же цветом и глубина не меняется.
-                val = find_best_turns_rec(next_mtx, color, depth,
-                    alpha, beta, mv.x2, mv.y2);
+                // тихий ход не успеет сдвинуть оценку за границу окна
+                val = static_score;
             }
             else
             {
-                // Обычный ход: передаём очередь сопернику и увеличиваем глубину.
-                val = find_best_turns_rec(next_mtx, 1 - color, depth + 1,
-                    alpha, beta);
+                // передаём очередь сопернику и увеличиваем глубину
+                nnue_make(mtx, mv);
+                const auto child = make_turn(mtx, mv);
+                if (selective && quiet && remaining >= 3 && k >= O2_LMR_MOVES)
+                {
+                    val = find_best_turns_rec(child, 1 - color, depth + 1, horizon - 1, alpha, beta);
+                    // сокращенный поиск нашел улучшение - ход пересчитывается на полную глубину
+                    if (max_layer ? val > alpha : val < beta)
+                        val = find_best_turns_rec(child, 1 - color, depth + 1, horizon, alpha, beta);
+                }
+                else
+                    val = find_best_turns_rec(child, 1 - color, depth + 1, horizon, alpha, beta);
+                nnue_unmake();
             }
 
             // Обновляем экстремумы
@@ -269,28 +519,44 @@ private:
         return (depth % 2 ? best_max : best_min);
     }
 
-public:
-    // поиск хода для цвета игрока
-    void find_turns(const bool color)
+    // оценки позиций после каждого хода для игрока bot_color (пачкой на масках или обновлением NNUE)
+    void score_children(const vector<vector<POS_T>> &mtx, const vector<compound_move> &moves, const bool bot_color,
+                        double *out)
     {
-        find_turns(color, board->get_board());
+        if (use_nnue)
+        {
+            for (size_t k = 0; k < moves.size(); ++k)
+            {
+                nnue_accumulator acc = nnue_stack.back();
+                nnue.apply_move(acc, mtx, moves[k]);
+                out[k] = nnue.score(acc, bot_color);
+            }
+            return;
+        }
+        const bitboard_pos parent = pack_board(mtx);
+        leaf_pos.clear();
+        for (const auto &mv : moves)
+            leaf_pos.push_back(make_compound_move(parent, mv));
+        eval.score_batch(leaf_pos.data(), leaf_pos.size(), bot_color, out);
     }
 
-	// поиска хода для шашки в позиции (x, y)
-    void find_turns(const POS_T x, const POS_T y)
+    // шашка выходит на строку перед превращением
+    static bool promotion_threat(const vector<vector<POS_T>> &mtx, const compound_move &mv)
     {
-        find_turns(x, y, board->get_board());
+        const POS_T type = mtx[mv.x][mv.y];
+        return (type == 1 && mv.x2 == game_geometry::promotion_row(0) + 1) ||
+               (type == 2 && mv.x2 == game_geometry::promotion_row(1) - 1);
     }
 
-private:
+public:
     // поиск хода для цвета игрока
     void find_turns(const bool color, const vector<vector<POS_T>> &mtx)
     {
         vector<move_pos> res_turns;
         bool have_beats_before = false;
-        for (POS_T i = 0; i < 8; ++i)
+        for (POS_T i = 0; i < game_geometry::size; ++i)
         {
-            for (POS_T j = 0; j < 8; ++j)
+            for (POS_T j = 0; j < game_geometry::size; ++j)
             {
                 if (mtx[i][j] && mtx[i][j] % 2 != color)
                 {
@@ -328,7 +594,7 @@ private:
             {
                 for (POS_T j = y - 2; j <= y + 2; j += 4)
                 {
-                    if (i < 0 || i > 7 || j < 0 || j > 7)
+                    if (!game_geometry::on_board(i, j))
                         continue;
                     POS_T xb = (x + i) / 2, yb = (y + j) / 2;
                     if (mtx[i][j] || !mtx[xb][yb] || mtx[xb][yb] % 2 == type % 2)
@@ -344,7 +610,7 @@ private:
                 for (POS_T j = -1; j <= 1; j += 2)
                 {
                     POS_T xb = -1, yb = -1;
-                    for (POS_T i2 = x + i, j2 = y + j; i2 != 8 && j2 != 8 && i2 != -1 && j2 != -1; i2 += i, j2 += j)
+                    for (POS_T i2 = x + i, j2 = y + j; game_geometry::on_board(i2, j2); i2 += i, j2 += j)
                     {
                         if (mtx[i2][j2])
                         {
@@ -379,7 +645,7 @@ private:
                 POS_T i = ((type % 2) ? x - 1 : x + 1);
                 for (POS_T j = y - 1; j <= y + 1; j += 2)
                 {
-                    if (i < 0 || i > 7 || j < 0 || j > 7 || mtx[i][j])
+                    if (!game_geometry::on_board(i, j) || mtx[i][j])
                         continue;
                     turns.emplace_back(x, y, i, j);
                 }
@@ -391,7 +657,7 @@ private:
             {
                 for (POS_T j = -1; j <= 1; j += 2)
                 {
-                    for (POS_T i2 = x + i, j2 = y + j; i2 != 8 && j2 != 8 && i2 != -1 && j2 != -1; i2 += i, j2 += j)
+                    for (POS_T i2 = x + i, j2 = y + j; game_geometry::on_board(i2, j2); i2 += i, j2 += j)
                     {
                         if (mtx[i2][j2])
                             break;
@@ -410,6 +676,18 @@ private:
     bool have_beats;
 	// максимальный уровень просчета ходов
     int Max_depth;
+    // оценка найденного хода последнего find_best_turns (в единицах calc_score для ходившего)
+    double last_score = 0;
+    // время на ход (с часами партии), 0 - поиск на полную глубину Max_depth без ограничения времени;
+    // soft_time_ms - рассчитанное время, после половины которого следующая итерация не начинается
+    int move_time_ms = 0;
+    int soft_time_ms = 0;
+    // глубина, досчитанная последним find_best_turns с ограничением времени
+    int last_depth = 0;
+    // ошибка загрузки оценки при последнем reload, пусто - ошибок нет
+    string eval_error;
+    // позиции партии до текущей включительно; поиск дополняет ее позициями своего пути
+    HashHistory history;
 
   private:
 	  // генератор случайных чисел для перемешивания ходов
@@ -418,12 +696,23 @@ private:
     string scoring_mode;
 	// уровень оптимизации альфа-бета отсечения
     string optimization;
-	// следующий ход
-    vector<move_pos> next_move;
-	// следующий статус доски после хода
-    vector<int> next_best_state;
-	// указатели на доску
-    Board *board;
+    // число полуходов дамками без взятий до ничьей (0 - без ограничения)
+    int no_progress_limit = 0;
+    // оценка листьев
+    Eval eval;
+    // буферы для пачечной оценки листьев
+    vector<bitboard_pos> leaf_pos;
+    vector<double> leaf_scores;
+    // оценка сетью NNUE (BotScoringType "NNUE")
+    bool use_nnue = false;
+    Nnue nnue;
+    // аккумуляторы NNUE на пути от корня до текущего узла
+    vector<nnue_accumulator> nnue_stack;
+    // ограничение времени текущей итерации find_first_best_turn_timed
+    bool timed = false;
+    bool out_of_time = false;
+    uint32_t time_checks = 0;
+    chrono::steady_clock::time_point deadline;
 	// указатель на конфиг
     Config *config;
 };
@@ -0,0 +1,350 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../Models/Bitboard.h"
+#include "../Models/Fen.h"
+#include "../Models/Move.h"
+#include "Config.h"
+#include "History.h"
+#include "Logic.h"
+#include "Trace.h"
+
+// размер пула узлов дерева (около 64 байт на узел)
+const int MCTS_POOL_SIZE = 1 << 19;
+// константа исследования PUCT
+const double MCTS_EXPLORATION = 1.4;
+// масштаб для хранения суммы значений в целочисленном атомике
+const int64_t MCTS_VALUE_SCALE = 1 << 20;
+
+// узел дерева: позиция после хода и статистика с точки зрения игрока, сделавшего этот ход
+struct mcts_node
+{
+    bitboard_pos pos;
+    bool color = 0; // чей ход в этой позиции
+    int parent = -1;
+    std::atomic<int> first_child{-1};
+    std::atomic<int> num_children{0};
+    // 0 - не раскрыт, 1 - раскрывается другим потоком, 2 - раскрыт, 3 - не раскрыт из-за заполнения пула
+    std::atomic<int> state{0};
+    std::atomic<int> visits{0};
+    std::atomic<int> virtual_loss{0};
+    std::atomic<int64_t> value_sum{0};
+    float prior = 1;
+};
+
+// поиск Монте-Карло по дереву (PUCT) на нескольких потоках с виртуальными потерями;
+// ходы генерируются правилами Logic, листья оцениваются той же оценкой, что и в альфа-бета,
+// повторение позиции и ходы без продвижения (как в Logic) - ничья
+class Mcts
+{
+  public:
+    Mcts(Config *config) : config(config)
+    {
+        reload();
+    }
+
+    // перечитать настройки (после перезапуска игры)
+    void reload()
+    {
+        int threads = (*config)("Bot", "MctsThreads");
+        if (threads <= 0)
+            threads = std::max(1, int(std::thread::hardware_concurrency()));
+        logics.clear();
+        for (int t = 0; t < threads; ++t)
+            logics.emplace_back(config);
+        no_progress_limit = (*config)("Game", "NoProgressLimit");
+        clear();
+    }
+
+    // забыть дерево
+    void clear()
+    {
+        used = 0;
+        root = -1;
+    }
+
+    // лучший ход (серия ходов одной шашкой) для цвета color в позиции mtx за время move_time_ms;
+    // history - позиции партии до mtx (для правил ничьей)
+    vector<move_pos> find_best_turns(const vector<vector<POS_T>> &mtx, const bool color, const int move_time_ms,
+                                     const HashHistory &history = HashHistory())
+    {
+        TRACE_SCOPE("mcts", "search");
+        // пул выделяется при первом ходе, чтобы не занимать память при игре альфа-бета
+        if (!nodes)
+            nodes.reset(new mcts_node[MCTS_POOL_SIZE]);
+        set_root(pack_board(mtx), color);
+        Logic &lg = logics[0];
+        const auto full_turns = lg.find_full_turns(mtx, color);
+        if (full_turns.size() <= 1)
+            return full_turns.empty() ? vector<move_pos>() : full_turns[0];
+
+        // корень добавляется в историю, если вызывающий не добавил его сам
+        game_history = history;
+        if (game_history.empty() || game_history.last_key() != position_hash(nodes[root].pos, color))
+            game_history.push(nodes[root].pos, color);
+        stop = false;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(move_time_ms);
+        vector<std::thread> pool;
+        for (size_t t = 1; t < logics.size(); ++t)
+            pool.emplace_back(&Mcts::worker, this, std::ref(logics[t]), deadline);
+        worker(logics[0], deadline);
+        for (auto &th : pool)
+            th.join();
+
+        // выбираем самый посещаемый ход корня
+        const mcts_node &r = nodes[root];
+        int best = -1;
+        for (int c = r.first_child; c != -1 && c < r.first_child + r.num_children; ++c)
+        {
+            if (best == -1 || nodes[c].visits > nodes[best].visits)
+                best = c;
+        }
+        last_playouts = r.visits;
+        // восстанавливаем серию ходов, ведущую в выбранную позицию
+        for (const auto &turn : full_turns)
+        {
+            auto next = mtx;
+            for (const auto &mv : turn)
+                next = lg.make_turn(next, mv);
+            const bitboard_pos p = pack_board(next);
+            if (best != -1 && p.wm == nodes[best].pos.wm && p.bm == nodes[best].pos.bm &&
+                p.wk == nodes[best].pos.wk && p.bk == nodes[best].pos.bk)
+            {
+                root = best;
+                return turn;
+            }
+        }
+        return full_turns[0];
+    }
+
+    // число симуляций последнего поиска
+    int last_playouts = 0;
+
+  private:
+    void worker(Logic &lg, const std::chrono::steady_clock::time_point deadline)
+    {
+        vector<int> path;
+        // история партии, дополняемая позициями пути симуляции
+        HashHistory history = game_history;
+        int iter = 0;
+        while (!stop)
+        {
+            playout(lg, path, history);
+            if (++iter % 16 == 0 && std::chrono::steady_clock::now() >= deadline)
+                stop = true;
+        }
+    }
+
+    // одна симуляция: спуск с виртуальными потерями, раскрытие листа, оценка и обратное распространение
+    void playout(Logic &lg, vector<int> &path, HashHistory &history)
+    {
+        path.clear();
+        int node = root;
+        path.push_back(node);
+        nodes[node].virtual_loss++;
+        // позиция, повторившая позицию пути или партии, или конец серии ходов без продвижения - ничья,
+        // дальше нее спуск не идет
+        bool draw = false;
+        while (!draw && nodes[node].state == 2 && nodes[node].num_children > 0)
+        {
+            node = select(node);
+            path.push_back(node);
+            nodes[node].virtual_loss++;
+            history.push(nodes[node].pos, nodes[node].color);
+            draw = history.is_draw(1, no_progress_limit);
+        }
+        for (size_t k = 1; k < path.size(); ++k)
+            history.pop();
+        mcts_node &leaf = nodes[node];
+        int expected = 0;
+        if (!draw && leaf.state.compare_exchange_strong(expected, 1))
+            leaf.state = expand(lg, node) ? 2 : 3;
+        // значение для игрока, сделавшего ход в лист
+        double value;
+        if (draw)
+            value = 0.5;
+        else if (leaf.state == 2 && leaf.num_children == 0)
+            value = 1; // у соперника нет ходов
+        else
+        {
+            const double ratio = lg.evaluate(unpack_board(leaf.pos), !leaf.color);
+            value = ratio >= INF ? 1.0 : ratio / (1 + ratio);
+        }
+        for (int k = int(path.size()) - 1; k >= 0; --k)
+        {
+            mcts_node &n = nodes[path[k]];
+            n.value_sum += int64_t(value * MCTS_VALUE_SCALE);
+            n.visits++;
+            n.virtual_loss--;
+            value = 1 - value;
+        }
+    }
+
+    // выбор потомка по PUCT, виртуальные потери считаются проигранными посещениями
+    int select(const int node) const
+    {
+        const mcts_node &p = nodes[node];
+        const double sqrt_n = std::sqrt(double(p.visits + p.virtual_loss) + 1);
+        int best = -1;
+        double best_score = -1;
+        const int first = p.first_child, last = first + p.num_children;
+        for (int c = first; c < last; ++c)
+        {
+            const mcts_node &ch = nodes[c];
+            const int n = ch.visits + ch.virtual_loss;
+            const double q = n ? double(ch.value_sum) / MCTS_VALUE_SCALE / n : 0.5;
+            const double score = q + MCTS_EXPLORATION * ch.prior * sqrt_n / (1 + n);
+            if (score > best_score)
+            {
+                best_score = score;
+                best = c;
+            }
+        }
+        return best;
+    }
+
+    // раскрытие узла; false, если пул исчерпан (узел навсегда остается листом)
+    bool expand(Logic &lg, const int node)
+    {
+        const mcts_node &p = nodes[node];
+        const auto mtx = unpack_board(p.pos);
+        const auto turns = lg.find_full_turns(mtx, p.color);
+        if (turns.empty())
+            return true;
+        if (used + int(turns.size()) > MCTS_POOL_SIZE)
+            return false;
+        const int first = used.fetch_add(int(turns.size()));
+        if (first + int(turns.size()) > MCTS_POOL_SIZE)
+            return false;
+        for (size_t k = 0; k < turns.size(); ++k)
+        {
+            auto next = mtx;
+            for (const auto &mv : turns[k])
+                next = lg.make_turn(next, mv);
+            reset_node(first + int(k), pack_board(next), !p.color, node);
+            nodes[first + int(k)].prior = float(1.0 / double(turns.size()));
+        }
+        nodes[node].first_child = first;
+        nodes[node].num_children = int(turns.size());
+        return true;
+    }
+
+    void reset_node(const int k, const bitboard_pos &pos, const bool color, const int parent)
+    {
+        mcts_node &n = nodes[k];
+        n.pos = pos;
+        n.color = color;
+        n.parent = parent;
+        n.first_child = -1;
+        n.num_children = 0;
+        n.state = 0;
+        n.visits = 0;
+        n.virtual_loss = 0;
+        n.value_sum = 0;
+        n.prior = 1;
+    }
+
+    static bool same(const mcts_node &n, const bitboard_pos &pos, const bool color)
+    {
+        return n.color == color && n.pos.wm == pos.wm && n.pos.bm == pos.bm && n.pos.wk == pos.wk &&
+               n.pos.bk == pos.bk;
+    }
+
+    // переиспользование дерева: новый корень ищется среди узлов на глубине до двух ходов от старого
+    void set_root(const bitboard_pos &pos, const bool color)
+    {
+        int found = -1;
+        if (root != -1)
+        {
+            if (same(nodes[root], pos, color))
+                found = root;
+            const mcts_node &r = nodes[root];
+            for (int c = r.first_child; found == -1 && c != -1 && c < r.first_child + r.num_children; ++c)
+            {
+                if (same(nodes[c], pos, color))
+                    found = c;
+                for (int g = nodes[c].first_child; found == -1 && g != -1 &&
+                                                   g < nodes[c].first_child + nodes[c].num_children;
+                     ++g)
+                {
+                    if (same(nodes[g], pos, color))
+                        found = g;
+                }
+            }
+        }
+        if (found == -1 || used > MCTS_POOL_SIZE / 2)
+        {
+            // при заполнении пула переносим поддерево в начало пула
+            if (found != -1)
+                found = compact(found);
+            else
+            {
+                clear();
+                found = used++;
+                reset_node(found, pos, color, -1);
+            }
+        }
+        root = found;
+        nodes[root].parent = -1;
+    }
+
+    // копирует поддерево с корнем from в начало нового пула, возвращает новый номер корня
+    int compact(const int from)
+    {
+        std::unique_ptr<mcts_node[]> fresh(new mcts_node[MCTS_POOL_SIZE]);
+        // src[k] - номер в старом пуле узла, ставшего k-м в новом (обход в ширину, дети остаются подряд)
+        vector<int> src{from};
+        copy_node(nodes[from], fresh[0], -1);
+        for (size_t k = 0; k < src.size(); ++k)
+        {
+            const mcts_node &s = nodes[src[k]];
+            const int cnt = s.num_children;
+            if (cnt == 0)
+                continue;
+            if (int(src.size()) + cnt > MCTS_POOL_SIZE)
+            {
+                // дети не поместились, узел снова станет листом
+                fresh[k].state = 0;
+                continue;
+            }
+            fresh[k].first_child = int(src.size());
+            fresh[k].num_children = cnt;
+            for (int c = 0; c < cnt; ++c)
+            {
+                copy_node(nodes[s.first_child + c], fresh[src.size()], int(k));
+                src.push_back(s.first_child + c);
+            }
+        }
+        nodes.swap(fresh);
+        used = int(src.size());
+        return 0;
+    }
+
+    static void copy_node(const mcts_node &s, mcts_node &d, const int parent)
+    {
+        d.pos = s.pos;
+        d.color = s.color;
+        d.parent = parent;
+        d.state = s.state == 3 ? 0 : s.state.load();
+        d.visits = s.visits.load();
+        d.value_sum = s.value_sum.load();
+        d.prior = s.prior;
+    }
+
+  private:
+    Config *config;
+    // отдельный экземпляр правил на каждый поток
+    vector<Logic> logics;
+    std::unique_ptr<mcts_node[]> nodes;
+    std::atomic<int> used{0};
+    int root = -1;
+    std::atomic<bool> stop{false};
+    // позиции партии до корня включительно (копия для потоков)
+    HashHistory game_history;
+    int no_progress_limit = 0;
+};
@@ -0,0 +1,172 @@
+﻿#pragma once
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+#include "../Models/Bitboard.h"
+#include "../Models/Geometry.h"
+#include "../Models/Move.h"
+#include "Rules.h"
+
+// генератор полных ходов на масках для доски N x N и правил Rules (Rules.h), таблицы соседей строятся
+// при компиляции для каждого размера. По умолчанию - правила Logic::find_turns: взятие обязательно, шашки бьют
+// во все стороны, дамки ходят и бьют на любое расстояние, побитая фигура снимается сразу,
+// шашка, дошедшая до края в серии, продолжает ее дамкой
+template <int N, class Rules = russian_rules> class Movegen
+{
+  public:
+    typedef board_geometry<N> geometry;
+    typedef typename geometry::mask_t mask_t;
+    typedef basic_bitboard_pos<N> position;
+
+    // все полные ходы цвета color: серия взятий одной шашкой - один ход из нескольких перемещений
+    static void full_turns(const position &pos, const bool color, std::vector<std::vector<move_pos>> &res)
+    {
+        res.clear();
+        const mask_t men = color ? pos.bm : pos.wm, kings = color ? pos.bk : pos.wk;
+        std::vector<move_pos> series;
+        for (mask_t m = men | kings; m; m &= m - 1)
+            add_captures(pos, color, lowest_bit(m), 0, series, res);
+        if (!res.empty())
+        {
+            // правило большинства: остаются только серии с наибольшим числом взятых фигур
+            if (Rules::max_capture)
+            {
+                size_t longest = 0;
+                for (const auto &turn : res)
+                    longest = std::max(longest, turn.size());
+                res.erase(std::remove_if(res.begin(), res.end(),
+                                         [&](const std::vector<move_pos> &turn) { return turn.size() < longest; }),
+                          res.end());
+            }
+            return;
+        }
+
+        const mask_t empty = ~occupied(pos) & geometry::all_mask();
+        // шашки ходят только вперед: белые вверх, черные вниз
+        const int first_dir = color ? DIR_DOWN_LEFT : DIR_UP_LEFT;
+        for (mask_t m = men; m; m &= m - 1)
+        {
+            const int sq = lowest_bit(m);
+            for (int d = first_dir; d < first_dir + 2; ++d)
+            {
+                const int to = geometry::step(d, sq);
+                if (to >= 0 && (empty & geometry::bit(to)))
+                    res.push_back({hop(sq, to, -1)});
+            }
+        }
+        for (mask_t m = kings; m; m &= m - 1)
+        {
+            const int sq = lowest_bit(m);
+            for (int d = 0; d < 4; ++d)
+            {
+                for (int to = geometry::step(d, sq); to >= 0 && (empty & geometry::bit(to));
+                     to = Rules::flying_kings ? geometry::step(d, to) : -1)
+                    res.push_back({hop(sq, to, -1)});
+            }
+        }
+    }
+
+    // позиция после полного хода
+    static position make_turn(position pos, const std::vector<move_pos> &turn)
+    {
+        for (size_t k = 0; k < turn.size(); ++k)
+        {
+            const move_pos &mv = turn[k];
+            const int from = geometry::index(mv.x, mv.y);
+            const bool color = ((pos.bm | pos.bk) >> from) & 1;
+            pos = make_hop(pos, color, from, geometry::index(mv.x2, mv.y2),
+                           mv.xb != -1 ? geometry::index(mv.xb, mv.yb) : -1,
+                           Rules::promotion != promotion_rule::at_series_end || k + 1 == turn.size());
+        }
+        return pos;
+    }
+
+    // число позиций на глубине depth полных ходов (perft) для проверки и замера генератора
+    static uint64_t perft(const position &pos, const bool color, const int depth)
+    {
+        std::vector<std::vector<move_pos>> turns;
+        full_turns(pos, color, turns);
+        if (depth <= 1)
+            return depth == 1 ? turns.size() : 1;
+        uint64_t res = 0;
+        for (const auto &turn : turns)
+            res += perft(make_turn(pos, turn), !color, depth - 1);
+        return res;
+    }
+
+  private:
+    static mask_t occupied(const position &pos)
+    {
+        return pos.wm | pos.bm | pos.wk | pos.bk;
+    }
+
+    static move_pos hop(const int from, const int to, const int beaten)
+    {
+        if (beaten < 0)
+            return move_pos(POS_T(geometry::row(from)), POS_T(geometry::col(from)), POS_T(geometry::row(to)),
+                            POS_T(geometry::col(to)));
+        return move_pos(POS_T(geometry::row(from)), POS_T(geometry::col(from)), POS_T(geometry::row(to)),
+                        POS_T(geometry::col(to)), POS_T(geometry::row(beaten)), POS_T(geometry::col(beaten)));
+    }
+
+    // одно перемещение фигуры цвета color с клетки from на to со взятием на клетке beaten (-1 - без взятия),
+    // promote - превращать ли шашку на последней строке
+    static position make_hop(position pos, const bool color, const int from, const int to, const int beaten,
+                             const bool promote)
+    {
+        if (beaten >= 0)
+        {
+            const mask_t keep = ~geometry::bit(beaten);
+            (color ? pos.wm : pos.bm) &= keep;
+            (color ? pos.wk : pos.bk) &= keep;
+        }
+        mask_t &men = color ? pos.bm : pos.wm, &kings = color ? pos.bk : pos.wk;
+        if (men & geometry::bit(from))
+        {
+            men ^= geometry::bit(from);
+            (promote && geometry::row(to) == geometry::promotion_row(color) ? kings : men) |= geometry::bit(to);
+        }
+        else
+            kings ^= geometry::bit(from) | geometry::bit(to);
+        return pos;
+    }
+
+    // все серии взятий фигурой с клетки sq, продолжающие series; false - взятий нет.
+    // captured - уже побитые в серии фигуры, которые при турецком ударе остаются на доске до конца хода
+    static bool add_captures(const position &pos, const bool color, const int sq, const mask_t captured,
+                             std::vector<move_pos> &series, std::vector<std::vector<move_pos>> &res)
+    {
+        const mask_t occ = occupied(pos) | captured;
+        const mask_t enemy = color ? pos.wm | pos.wk : pos.bm | pos.bk;
+        const bool king = ((color ? pos.bk : pos.wk) >> sq) & 1;
+        const bool flying = king && Rules::flying_kings;
+        bool found = false;
+        for (int d = 0; d < 4; ++d)
+        {
+            if (!king && !Rules::men_capture_backward && (color ? d < DIR_DOWN_LEFT : d >= DIR_DOWN_LEFT))
+                continue;
+            // дальняя дамка доходит до первой фигуры на диагонали, остальные бьют только соседнюю
+            int beaten = geometry::step(d, sq);
+            while (flying && beaten >= 0 && !(occ & geometry::bit(beaten)))
+                beaten = geometry::step(d, beaten);
+            if (beaten < 0 || !(enemy & geometry::bit(beaten)))
+                continue;
+            for (int to = geometry::step(d, beaten); to >= 0 && !(occ & geometry::bit(to));
+                 to = flying ? geometry::step(d, to) : -1)
+            {
+                found = true;
+                const bool crowned = !king && geometry::row(to) == geometry::promotion_row(color);
+                const position next = make_hop(pos, color, sq, to, beaten,
+                                               Rules::promotion != promotion_rule::at_series_end);
+                series.push_back(hop(sq, to, beaten));
+                if ((crowned && Rules::promotion == promotion_rule::end_series) ||
+                    !add_captures(next, color, to, Rules::lift_after_series ? captured | geometry::bit(beaten) : 0,
+                                  series, res))
+                    res.push_back(series);
+                series.pop_back();
+            }
+        }
+        return found;
+    }
+};
@@ -0,0 +1,295 @@
+﻿#pragma once
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "../Models/Bitboard.h"
+#include "../Models/Move.h"
+#include "Eval.h"
+
+// небольшая сеть оценки в стиле NNUE:
+// 128 признаков (4 типа фигур x 32 клетки) -> 32 (int16, аккумулятор) -> 32 (int8) -> 1
+// первый слой хранится в аккумуляторе и обновляется по ходу, а не пересчитывается в каждом листе
+const int NNUE_INPUTS = 128;
+const int NNUE_HIDDEN1 = 32;
+const int NNUE_HIDDEN2 = 32;
+// масштабы квантования: активации [0, 1] -> [0, 127], веса слоев 2 и 3 -> x64
+const int NNUE_QA = 127;
+const int NNUE_QB = 64;
+
+// аккумулятор первого слоя и число фигур сторон (для терминальных позиций)
+struct nnue_accumulator
+{
+    alignas(32) int16_t v[NNUE_HIDDEN1];
+    int8_t white = 0, black = 0;
+};
+
+class Nnue
+{
+  public:
+    Nnue()
+    {
+        init_material();
+    }
+
+    // номер признака фигуры type (1..4 как в матрице доски) на клетке sq
+    static int feature(const int type, const int sq)
+    {
+        return (type - 1) * 32 + sq;
+    }
+
+    // полный пересчет аккумулятора
+    nnue_accumulator refresh(const bitboard_pos &pos) const
+    {
+        nnue_accumulator acc;
+        std::copy(b1, b1 + NNUE_HIDDEN1, acc.v);
+        const uint32_t masks[4] = {pos.wm, pos.bm, pos.wk, pos.bk};
+        for (int type = 1; type <= 4; ++type)
+        {
+            for (int sq = 0; sq < 32; ++sq)
+                if ((masks[type - 1] >> sq) & 1)
+                    add(acc, feature(type, sq));
+        }
+        acc.white = int8_t(popcount32(pos.wm | pos.wk));
+        acc.black = int8_t(popcount32(pos.bm | pos.bk));
+        return acc;
+    }
+
+    // инкрементальное обновление аккумулятора ходом turn из позиции mtx (до хода)
+    void apply_move(nnue_accumulator &acc, const std::vector<std::vector<POS_T>> &mtx, const move_pos &turn) const
+    {
+        const int type = mtx[turn.x][turn.y];
+        int new_type = type;
+        if ((type == 1 && turn.x2 == game_geometry::promotion_row(0)) ||
+            (type == 2 && turn.x2 == game_geometry::promotion_row(1)))
+            new_type += 2;
+        sub(acc, feature(type, square_index(turn.x, turn.y)));
+        add(acc, feature(new_type, square_index(turn.x2, turn.y2)));
+        if (turn.xb != -1)
+        {
+            const int beaten = mtx[turn.xb][turn.yb];
+            sub(acc, feature(beaten, square_index(turn.xb, turn.yb)));
+            --(beaten % 2 ? acc.white : acc.black);
+        }
+    }
+
+    // то же для полного хода: все побитые фигуры снимаются одним обновлением
+    void apply_move(nnue_accumulator &acc, const std::vector<std::vector<POS_T>> &mtx, const compound_move &turn) const
+    {
+        const int type = mtx[turn.x][turn.y];
+        sub(acc, feature(type, square_index(turn.x, turn.y)));
+        add(acc, feature(type + (turn.promotes ? 2 : 0), square_index(turn.x2, turn.y2)));
+        for (uint32_t m = turn.captured; m; m &= m - 1)
+        {
+            const int sq = lowest_bit(m);
+            const int beaten = mtx[square_row(sq)][square_col(sq)];
+            sub(acc, feature(beaten, sq));
+            --(beaten % 2 ? acc.white : acc.black);
+        }
+    }
+
+    // выход сети (логит перспективы белых) в единицах NNUE_QA * NNUE_QB
+    int32_t forward(const nnue_accumulator &acc) const
+    {
+        static const auto impl = Eval::has_avx2() ? forward_avx2 : forward_scalar;
+        return impl(*this, acc);
+    }
+
+    // эталонная реализация в float на деквантованных весах (для проверки)
+    float forward_float(const bitboard_pos &pos) const
+    {
+        float h1[NNUE_HIDDEN1];
+        const uint32_t masks[4] = {pos.wm, pos.bm, pos.wk, pos.bk};
+        for (int i = 0; i < NNUE_HIDDEN1; ++i)
+        {
+            float acc = float(b1[i]) / NNUE_QA;
+            for (int type = 1; type <= 4; ++type)
+                for (int sq = 0; sq < 32; ++sq)
+                    if ((masks[type - 1] >> sq) & 1)
+                        acc += float(w1[feature(type, sq)][i]) / NNUE_QA;
+            h1[i] = std::min(std::max(acc, 0.f), 1.f);
+        }
+        float y = float(b3) / (NNUE_QA * NNUE_QB);
+        for (int j = 0; j < NNUE_HIDDEN2; ++j)
+        {
+            float z = float(b2[j]) / (NNUE_QA * NNUE_QB);
+            for (int i = 0; i < NNUE_HIDDEN1; ++i)
+                z += float(w2[j][i]) / NNUE_QB * h1[i];
+            y += float(w3[j]) / NNUE_QB * std::min(std::max(z, 0.f), 1.f);
+        }
+        return y;
+    }
+
+    // логит из целочисленного выхода
+    static double to_logit(const int32_t out)
+    {
+        return double(out) / (NNUE_QA * NNUE_QB);
+    }
+
+    // оценка в тех же единицах, что и Eval::score: отношение сил для игрока first_bot_color
+    double score(const nnue_accumulator &acc, const bool first_bot_color) const
+    {
+        const int me = first_bot_color ? acc.black : acc.white, op = first_bot_color ? acc.white : acc.black;
+        if (op == 0)
+            return INF;
+        if (me == 0)
+            return 0;
+        const double logit = to_logit(forward(acc));
+        return std::exp(first_bot_color ? -logit : logit);
+    }
+
+    // загрузка весов из бинарного файла; при ошибке остаются текущие веса
+    bool load(const std::string &path)
+    {
+        std::ifstream fin(path, std::ios_base::binary);
+        if (!fin)
+            return false;
+        char magic[4];
+        uint32_t header[4];
+        fin.read(magic, 4);
+        fin.read(reinterpret_cast<char *>(header), sizeof(header));
+        if (!fin || std::string(magic, 4) != "CKNN" || header[0] != VERSION || header[1] != NNUE_INPUTS ||
+            header[2] != NNUE_HIDDEN1 || header[3] != NNUE_HIDDEN2)
+            return false;
+        Nnue loaded;
+        fin.read(reinterpret_cast<char *>(loaded.w1), sizeof(w1));
+        fin.read(reinterpret_cast<char *>(loaded.b1), sizeof(b1));
+        fin.read(reinterpret_cast<char *>(loaded.w2), sizeof(w2));
+        fin.read(reinterpret_cast<char *>(loaded.b2), sizeof(b2));
+        fin.read(reinterpret_cast<char *>(loaded.w3), sizeof(w3));
+        fin.read(reinterpret_cast<char *>(&loaded.b3), sizeof(b3));
+        if (!fin)
+            return false;
+        *this = loaded;
+        return true;
+    }
+
+    // запись весов: "CKNN", версия, размеры слоев, затем w1, b1, w2, b2, w3, b3 (little-endian)
+    bool save(const std::string &path) const
+    {
+        std::ofstream fout(path, std::ios_base::binary | std::ios_base::trunc);
+        const uint32_t header[4] = {VERSION, NNUE_INPUTS, NNUE_HIDDEN1, NNUE_HIDDEN2};
+        fout.write("CKNN", 4);
+        fout.write(reinterpret_cast<const char *>(header), sizeof(header));
+        fout.write(reinterpret_cast<const char *>(w1), sizeof(w1));
+        fout.write(reinterpret_cast<const char *>(b1), sizeof(b1));
+        fout.write(reinterpret_cast<const char *>(w2), sizeof(w2));
+        fout.write(reinterpret_cast<const char *>(b2), sizeof(b2));
+        fout.write(reinterpret_cast<const char *>(w3), sizeof(w3));
+        fout.write(reinterpret_cast<const char *>(&b3), sizeof(b3));
+        return bool(fout);
+    }
+
+    // сеть по умолчанию (пока нет обученного файла): разность материала, дамка = 3 пешки
+    void init_material()
+    {
+        std::fill(&w1[0][0], &w1[0][0] + NNUE_INPUTS * NNUE_HIDDEN1, int16_t(0));
+        std::fill(b1, b1 + NNUE_HIDDEN1, int16_t(0));
+        std::fill(&w2[0][0], &w2[0][0] + NNUE_HIDDEN2 * NNUE_HIDDEN1, int8_t(0));
+        std::fill(b2, b2 + NNUE_HIDDEN2, 0);
+        std::fill(w3, w3 + NNUE_HIDDEN2, int8_t(0));
+        b3 = 0;
+        // нейрон 0 - материал белых, нейрон 1 - материал черных (максимум 12 дамок < 127)
+        for (int sq = 0; sq < 32; ++sq)
+        {
+            w1[feature(1, sq)][0] = 3;
+            w1[feature(3, sq)][0] = 9;
+            w1[feature(2, sq)][1] = 3;
+            w1[feature(4, sq)][1] = 9;
+        }
+        w2[0][0] = NNUE_QB;
+        w2[1][1] = NNUE_QB;
+        w3[0] = 127;
+        w3[1] = -127;
+    }
+
+    // прямой проход без SIMD и с AVX2 (открыты для проверки совпадения и бенчмарка)
+    static int32_t forward_scalar(const Nnue &net, const nnue_accumulator &acc)
+    {
+        uint8_t h1[NNUE_HIDDEN1];
+        for (int i = 0; i < NNUE_HIDDEN1; ++i)
+            h1[i] = uint8_t(std::min(std::max(int(acc.v[i]), 0), 127));
+        int32_t z[NNUE_HIDDEN2];
+        for (int j = 0; j < NNUE_HIDDEN2; ++j)
+        {
+            z[j] = net.b2[j];
+            for (int i = 0; i < NNUE_HIDDEN1; ++i)
+                z[j] += int32_t(net.w2[j][i]) * h1[i];
+        }
+        return output(net, z);
+    }
+
+#ifdef CHECKERS_X86
+    // второй слой на AVX2: произведения uint8 x int8 попарно в int16 (без насыщения при |w| <= 128, h <= 127),
+    // затем суммирование в int32; результат совпадает со скалярным
+    CHECKERS_TARGET_AVX2 static int32_t forward_avx2(const Nnue &net, const nnue_accumulator &acc)
+    {
+        const __m256i zero = _mm256_setzero_si256(), top = _mm256_set1_epi16(127);
+        const __m256i a0 = _mm256_load_si256(reinterpret_cast<const __m256i *>(acc.v));
+        const __m256i a1 = _mm256_load_si256(reinterpret_cast<const __m256i *>(acc.v + 16));
+        const __m256i c0 = _mm256_min_epi16(_mm256_max_epi16(a0, zero), top);
+        const __m256i c1 = _mm256_min_epi16(_mm256_max_epi16(a1, zero), top);
+        // packus переставляет 128-битные половины, возвращаем исходный порядок
+        const __m256i h1 = _mm256_permute4x64_epi64(_mm256_packus_epi16(c0, c1), 0xD8);
+        const __m256i ones = _mm256_set1_epi16(1);
+        alignas(32) int32_t z[NNUE_HIDDEN2];
+        for (int j = 0; j < NNUE_HIDDEN2; j += 8)
+        {
+            __m256i sums[8];
+            for (int k = 0; k < 8; ++k)
+            {
+                const __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(net.w2[j + k]));
+                sums[k] = _mm256_madd_epi16(_mm256_maddubs_epi16(h1, w), ones);
+            }
+            // горизонтальные суммы восьми векторов сразу
+            const __m256i s01 = _mm256_hadd_epi32(sums[0], sums[1]), s23 = _mm256_hadd_epi32(sums[2], sums[3]);
+            const __m256i s45 = _mm256_hadd_epi32(sums[4], sums[5]), s67 = _mm256_hadd_epi32(sums[6], sums[7]);
+            const __m256i s0123 = _mm256_hadd_epi32(s01, s23), s4567 = _mm256_hadd_epi32(s45, s67);
+            const __m256i lo = _mm256_permute2x128_si256(s0123, s4567, 0x20);
+            const __m256i hi = _mm256_permute2x128_si256(s0123, s4567, 0x31);
+            const __m256i bias = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(net.b2 + j));
+            _mm256_store_si256(reinterpret_cast<__m256i *>(z + j), _mm256_add_epi32(_mm256_add_epi32(lo, hi), bias));
+        }
+        return output(net, z);
+    }
+#else
+    static int32_t forward_avx2(const Nnue &net, const nnue_accumulator &acc)
+    {
+        return forward_scalar(net, acc);
+    }
+#endif
+
+  private:
+    void add(nnue_accumulator &acc, const int f) const
+    {
+        for (int i = 0; i < NNUE_HIDDEN1; ++i)
+            acc.v[i] += w1[f][i];
+    }
+
+    void sub(nnue_accumulator &acc, const int f) const
+    {
+        for (int i = 0; i < NNUE_HIDDEN1; ++i)
+            acc.v[i] -= w1[f][i];
+    }
+
+    // третий слой: активация второго и скалярное произведение
+    static int32_t output(const Nnue &net, const int32_t *z)
+    {
+        int32_t y = net.b3;
+        for (int j = 0; j < NNUE_HIDDEN2; ++j)
+            y += int32_t(net.w3[j]) * std::min(std::max(z[j] >> 6, 0), 127);
+        return y;
+    }
+
+    static const uint32_t VERSION = 1;
+
+    alignas(32) int16_t w1[NNUE_INPUTS][NNUE_HIDDEN1];
+    alignas(32) int16_t b1[NNUE_HIDDEN1];
+    alignas(32) int8_t w2[NNUE_HIDDEN2][NNUE_HIDDEN1];
+    alignas(32) int32_t b2[NNUE_HIDDEN2];
+    int8_t w3[NNUE_HIDDEN2];
+    int32_t b3;
+};
@@ -0,0 +1,290 @@
+﻿#pragma once
+#include <cctype>
+#include <ctime>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../Models/Fen.h"
+#include "../Models/GameRecord.h"
+
+// чтение и запись партий в PDN (Portable Draughts Notation)
+// партии пишутся как GameType 25 (русские шашки) с алгебраической записью клеток (c3-d4, взятия c3:e5),
+// при чтении понимаются и номера клеток 1..32
+class Pdn
+{
+  public:
+    // запись одной партии
+    static void write(std::ostream &out, const game_record &game)
+    {
+        auto tags = game.tags;
+        if (!tags.count("Event"))
+            tags["Event"] = "Checkers";
+        if (!tags.count("Date"))
+            tags["Date"] = today();
+        tags["Result"] = result_string(game.result);
+        tags["GameType"] = "25";
+        if (game.custom_start)
+            tags["FEN"] = to_fen(game.start, game.start_color, true);
+        // сначала обязательные теги в привычном порядке
+        const char *order[] = {"Event", "Site", "Date", "Round", "White", "Black", "Result"};
+        for (const char *name : order)
+        {
+            auto it = tags.find(name);
+            if (it == tags.end())
+                continue;
+            out << "[" << it->first << " \"" << it->second << "\"]\n";
+            tags.erase(it);
+        }
+        for (const auto &tag : tags)
+            out << "[" << tag.first << " \"" << tag.second << "\"]\n";
+        out << "\n";
+
+        std::string line;
+        auto put = [&](const std::string &token) {
+            if (!line.empty() && line.size() + 1 + token.size() > 79)
+            {
+                out << line << "\n";
+                line.clear();
+            }
+            line += (line.empty() ? "" : " ") + token;
+        };
+        for (size_t ply = 0; ply < game.turns.size(); ++ply)
+        {
+            const bool color = (ply % 2 == 1) != game.start_color;
+            const size_t num = (ply + game.start_color) / 2 + 1;
+            if (!color)
+                put(std::to_string(num) + ".");
+            else if (ply == 0)
+                put(std::to_string(num) + "...");
+            put(algebraic_move_string(game.turns[ply]));
+        }
+        put(result_string(game.result));
+        out << line << "\n\n";
+    }
+
+    // чтение следующей партии из потока; false, если партий больше нет
+    // error - описание первой ошибки в ходах (партия возвращается до ошибочного хода)
+    static bool read(std::istream &in, game_record &game, std::string &error)
+    {
+        game = game_record();
+        error.clear();
+        bool has_content = false, in_moves = false;
+        std::vector<std::vector<POS_T>> mtx;
+        auto start_moves = [&]() {
+            if (in_moves)
+                return;
+            in_moves = true;
+            auto it = game.tags.find("FEN");
+            game.start = start_position();
+            if (it != game.tags.end())
+            {
+                if (parse_fen(it->second, game.start, game.start_color))
+                    game.custom_start = true;
+                else
+                    error = "bad FEN: " + it->second;
+            }
+            mtx = unpack_board(game.start);
+        };
+
+        int c;
+        while ((c = in.peek()) != EOF)
+        {
+            if (isspace(c))
+            {
+                in.get();
+                continue;
+            }
+            if (c == '[')
+            {
+                // тег после ходов - начало следующей партии
+                if (in_moves)
+                    break;
+                in.get();
+                std::string name, value;
+                while (in.peek() != EOF && !isspace(in.peek()) && in.peek() != '"')
+                    name += char(in.get());
+                while (in.peek() != EOF && in.peek() != '"' && in.peek() != ']')
+                    in.get();
+                if (in.peek() == '"')
+                {
+                    in.get();
+                    while (in.peek() != EOF && in.peek() != '"')
+                        value += char(in.get());
+                    in.get();
+                }
+                while (in.peek() != EOF && in.get() != ']')
+                {
+                }
+                game.tags[name] = value;
+                has_content = true;
+                continue;
+            }
+            if (c == '{' || c == '(')
+            {
+                // комментарии и варианты пропускаются
+                skip_group(in, char(c), c == '{' ? '}' : ')');
+                continue;
+            }
+            std::string token;
+            while (in.peek() != EOF && !isspace(in.peek()) && in.peek() != '{' && in.peek() != '(' &&
+                   in.peek() != '[')
+                token += char(in.get());
+            has_content = true;
+            start_moves();
+            int result;
+            if (parse_result(token, result))
+            {
+                game.result = result;
+                break;
+            }
+            // номера ходов и оценки ходов ("12.", "12...", "$1", "!?")
+            while (!token.empty() && (token.back() == '!' || token.back() == '?'))
+                token.pop_back();
+            if (token.empty() || token[0] == '$' || token.back() == '.')
+                continue;
+            const size_t dot = token.find('.');
+            if (dot != std::string::npos)
+                token = token.substr(token.find_first_not_of('.', dot));
+            if (!error.empty())
+                continue;
+            std::vector<move_pos> turn;
+            if (!parse_move(token, mtx, turn))
+            {
+                error = "bad move " + token;
+                continue;
+            }
+            game.turns.push_back(turn);
+        }
+        if (has_content)
+            start_moves();
+        return has_content;
+    }
+
+    // запись хода: "22-18" или серия взятий "11x18x25"
+    static std::string move_string(const std::vector<move_pos> &turn)
+    {
+        std::string res;
+        if (turn.empty())
+            return res;
+        res = std::to_string(square_index(turn[0].x, turn[0].y) + 1);
+        for (const auto &mv : turn)
+            res += (mv.xb != -1 ? "x" : "-") + std::to_string(square_index(mv.x2, mv.y2) + 1);
+        return res;
+    }
+
+    // запись хода в PDN русских шашек: "c3-d4" или серия взятий "c3:e5:g3"
+    static std::string algebraic_move_string(const std::vector<move_pos> &turn)
+    {
+        std::string res;
+        if (turn.empty())
+            return res;
+        res = square_name(square_index(turn[0].x, turn[0].y));
+        for (const auto &mv : turn)
+            res += (mv.xb != -1 ? ":" : "-") + square_name(square_index(mv.x2, mv.y2));
+        return res;
+    }
+
+    static std::string result_string(const int result)
+    {
+        switch (result)
+        {
+        case 0:
+            return "1/2-1/2";
+        case 1:
+            return "1-0";
+        case 2:
+            return "0-1";
+        default:
+            return "*";
+        }
+    }
+
+    // разбор хода в текущей позиции mtx (позиция изменяется)
+    static bool parse_move(const std::string &token, std::vector<std::vector<POS_T>> &mtx, std::vector<move_pos> &turn)
+    {
+        std::vector<int> squares;
+        size_t p = 0;
+        while (p < token.size())
+        {
+            int sq = -1;
+            if (isdigit(token[p]))
+            {
+                int num = 0;
+                while (p < token.size() && isdigit(token[p]))
+                    num = num * 10 + (token[p++] - '0');
+                if (num >= 1 && num <= 32)
+                    sq = num - 1;
+            }
+            else if (token[p] >= 'a' && token[p] <= 'h' && p + 1 < token.size() && token[p + 1] >= '1' &&
+                     token[p + 1] <= '8')
+            {
+                // алгебраическая запись: буква - столбец, цифра - строка снизу
+                const POS_T i = POS_T(8 - (token[p + 1] - '0')), j = POS_T(token[p] - 'a');
+                if ((i + j) % 2 == 1)
+                    sq = square_index(i, j);
+                p += 2;
+            }
+            if (sq == -1)
+                return false;
+            squares.push_back(sq);
+            if (p < token.size())
+            {
+                if (token[p] != '-' && token[p] != 'x' && token[p] != ':')
+                    return false;
+                ++p;
+            }
+        }
+        if (squares.size() < 2)
+            return false;
+        turn.clear();
+        for (size_t k = 0; k + 1 < squares.size(); ++k)
+        {
+            const move_pos hop = make_hop(mtx, squares[k], squares[k + 1]);
+            if (hop.x == -1)
+                return false;
+            apply_hop(mtx, hop);
+            turn.push_back(hop);
+        }
+        return true;
+    }
+
+    static bool parse_result(const std::string &token, int &result)
+    {
+        if (token == "1-0" || token == "2-0")
+            result = 1;
+        else if (token == "0-1" || token == "0-2")
+            result = 2;
+        else if (token == "1/2-1/2" || token == "1-1")
+            result = 0;
+        else if (token == "*")
+            result = -1;
+        else
+            return false;
+        return true;
+    }
+
+  private:
+    static void skip_group(std::istream &in, const char open, const char close)
+    {
+        int depth = 0;
+        int c;
+        while ((c = in.get()) != EOF)
+        {
+            if (c == open)
+                ++depth;
+            else if (c == close && --depth == 0)
+                break;
+        }
+    }
+
+    static std::string today()
+    {
+        const std::time_t now = std::time(nullptr);
+        char buf[16];
+        std::strftime(buf, sizeof(buf), "%Y.%m.%d", std::localtime(&now));
+        return buf;
+    }
+};
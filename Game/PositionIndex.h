@@ -0,0 +1,608 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Models/Fen.h"
+#include "../Models/GameRecord.h"
+#include "../Models/Zobrist.h"
+#include "Corpus.h"
+
+// индекс позиций корпуса партий: хеш позиции (position_hash, с учетом очереди хода) -> партия, номер хода,
+// результат партии и сделанный из позиции ход. Индекс - набор сегментов, отсортированных по хешу и
+// отображаемых в память:
+//   манифест <path>: "CKPX <версия> <номер следующего сегмента>", затем номера сегментов от старых к новым
+//   сегмент <path>.<номер>: "CKPS", uint32 версия, uint64 число записей, uint64 первая партия,
+//     uint64 партия после последней, затем записи position_entry по возрастанию
+// Новые партии дописываются новыми сегментами, сегменты сливаются в фоновом потоке (как в LSM-дереве),
+// в каждом сегменте запись ищется интерполяцией по хешу
+const uint32_t POSITION_INDEX_VERSION = 1;
+const size_t POSITION_SEGMENT_HEADER = 32;
+// сегмент сливается с более новыми, когда он больше их суммы не более чем в POSITION_MERGE_RATIO раз,
+// так что сегментов остается O(log) от числа записей
+const uint64_t POSITION_MERGE_RATIO = 4;
+// записей в одном сегменте при добавлении партий (16 байт на запись)
+const size_t POSITION_BATCH = size_t(1) << 22;
+// ходы дальше этого номера не индексируются
+const int POSITION_MAX_PLY = 4095;
+
+// запись индекса: позиция встретилась в партии game перед ходом ply
+struct position_entry
+{
+    uint64_t key = 0;
+    uint32_t game = 0;
+    // биты 0-11 - номер хода, 12-13 - результат (0 - ничья, 1 - белые, 2 - черные, 3 - не закончена),
+    // бит 14 - из позиции сделан ход, биты 15-29 - его код (position_move_code)
+    uint32_t info = 0;
+
+    int ply() const
+    {
+        return int(info & 4095);
+    }
+
+    int result() const
+    {
+        const int r = int(info >> 12) & 3;
+        return r == 3 ? -1 : r;
+    }
+
+    bool has_move() const
+    {
+        return (info >> 14) & 1;
+    }
+
+    uint16_t move() const
+    {
+        return uint16_t(info >> 15);
+    }
+
+    bool operator<(const position_entry &other) const
+    {
+        if (key != other.key)
+            return key < other.key;
+        return game != other.game ? game < other.game : info < other.info;
+    }
+};
+static_assert(sizeof(position_entry) == 16, "position_entry is stored on disk as is");
+
+// код полного хода: откуда, куда первое перемещение и куда последнее (15 бит)
+inline uint16_t position_move_code(const std::vector<move_pos> &turn)
+{
+    return uint16_t(square_index(turn.front().x, turn.front().y) | square_index(turn.front().x2, turn.front().y2) << 5 |
+                    square_index(turn.back().x2, turn.back().y2) << 10);
+}
+
+// статистика партий по ходу из позиции (has_move = false - партии, закончившиеся в этой позиции)
+struct position_move_stats
+{
+    bool has_move = false;
+    uint16_t move = 0;
+    uint64_t games = 0;
+    uint64_t results[4] = {0, 0, 0, 0}; // ничьи, победы белых, победы черных, не закончены
+};
+
+// сегмент индекса, отображенный в память; remove_file - удалить файл, когда сегмент больше не нужен
+// (после слияния его могут еще читать запросы, начатые раньше)
+class PositionSegment
+{
+  public:
+    PositionSegment(const std::string &path) : path(path)
+    {
+    }
+
+    ~PositionSegment()
+    {
+        file.close();
+        if (remove_file)
+            std::remove(path.c_str());
+    }
+
+    bool open()
+    {
+        if (!file.open(path, false) || file.size() < POSITION_SEGMENT_HEADER ||
+            std::memcmp(file.data(), "CKPS", 4) != 0)
+            return false;
+        uint32_t version;
+        uint64_t n;
+        std::memcpy(&version, file.data() + 4, 4);
+        std::memcpy(&n, file.data() + 8, 8);
+        std::memcpy(&first, file.data() + 16, 8);
+        std::memcpy(&end, file.data() + 24, 8);
+        if (version != POSITION_INDEX_VERSION || POSITION_SEGMENT_HEADER + n * sizeof(position_entry) != file.size())
+            return false;
+        count = size_t(n);
+        items = reinterpret_cast<const position_entry *>(file.data() + POSITION_SEGMENT_HEADER);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    const position_entry *entries() const
+    {
+        return items;
+    }
+
+    // первая запись с хешем не меньше key. Хеши распределены равномерно, поэтому место записи
+    // угадывается интерполяцией за несколько шагов, остаток - двоичным поиском
+    size_t lower_bound(const uint64_t key) const
+    {
+        size_t lo = 0, hi = count;
+        for (int step = 0; step < 8 && hi - lo > 64; ++step)
+        {
+            const uint64_t a = items[lo].key, b = items[hi - 1].key;
+            if (key <= a)
+                return lo;
+            if (key > b)
+                return hi;
+            const size_t pos = lo + size_t(double(key - a) / double(b - a) * double(hi - 1 - lo));
+            if (items[pos].key < key)
+                lo = pos + 1;
+            else
+                hi = pos;
+        }
+        return size_t(std::lower_bound(items + lo, items + hi, key,
+                                       [](const position_entry &e, const uint64_t k) { return e.key < k; }) -
+                      items);
+    }
+
+    const std::string path;
+    // партии [first, end) корпуса
+    uint64_t first = 0, end = 0;
+    bool remove_file = false;
+
+  private:
+    MappedFile file;
+    const position_entry *items = nullptr;
+    size_t count = 0;
+};
+
+// запись сегмента: записи добавляются по возрастанию, число записей пишется в заголовок в конце
+class PositionSegmentWriter
+{
+  public:
+    ~PositionSegmentWriter()
+    {
+        abort();
+    }
+
+    bool open(const std::string &file_path, const uint64_t first, const uint64_t end)
+    {
+        path = file_path;
+        file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        const uint64_t zero = 0;
+        std::fwrite("CKPS", 1, 4, file);
+        std::fwrite(&POSITION_INDEX_VERSION, 4, 1, file);
+        std::fwrite(&zero, 8, 1, file);
+        std::fwrite(&first, 8, 1, file);
+        std::fwrite(&end, 8, 1, file);
+        count = 0;
+        return true;
+    }
+
+    void add(const position_entry &e)
+    {
+        std::fwrite(&e, sizeof(e), 1, file);
+        ++count;
+    }
+
+    bool finish()
+    {
+        std::fseek(file, 8, SEEK_SET);
+        std::fwrite(&count, 8, 1, file);
+        const bool ok = !std::ferror(file);
+        std::fclose(file);
+        file = nullptr;
+        if (!ok)
+            std::remove(path.c_str());
+        return ok;
+    }
+
+    // недописанный сегмент удаляется
+    void abort()
+    {
+        if (!file)
+            return;
+        std::fclose(file);
+        file = nullptr;
+        std::remove(path.c_str());
+    }
+
+  private:
+    std::FILE *file = nullptr;
+    std::string path;
+    uint64_t count = 0;
+};
+
+class PositionIndex
+{
+  public:
+    PositionIndex() = default;
+    PositionIndex(const PositionIndex &) = delete;
+    PositionIndex &operator=(const PositionIndex &) = delete;
+
+    ~PositionIndex()
+    {
+        close();
+    }
+
+    // открыть индекс; без манифеста индекс пустой и создается при первом update.
+    // false - манифест есть, но сегмент не читается (индекс надо удалить и построить заново)
+    bool open(const std::string &index_path)
+    {
+        close();
+        path = index_path;
+        std::ifstream fin(path);
+        std::string magic;
+        uint32_t version = 0;
+        if (!(fin >> magic >> version >> next_segment))
+        {
+            next_segment = 0;
+            return true;
+        }
+        if (magic != "CKPX" || version != POSITION_INDEX_VERSION)
+            return false;
+        uint64_t number;
+        while (fin >> number)
+        {
+            auto seg = std::make_shared<PositionSegment>(segment_path(number));
+            if (!seg->open())
+            {
+                segments.clear();
+                return false;
+            }
+            segments.push_back(seg);
+        }
+        return true;
+    }
+
+    // остановить фоновое слияние (недописанный результат удаляется, сегменты остаются прежними)
+    void close()
+    {
+        cancel = true;
+        if (merge_thread.joinable())
+            merge_thread.join();
+        cancel = false;
+        merging = false;
+        merge_pending = false;
+        pending_corpus.clear();
+        segments.clear();
+    }
+
+    // число партий корпуса в индексе: партии [0, indexed_games())
+    uint64_t indexed_games() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return segments.empty() ? 0 : segments.back()->end;
+    }
+
+    size_t segment_count() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return segments.size();
+    }
+
+    // добавить партии корпуса, которых еще нет в индексе (новые сегменты), и запустить фоновое слияние;
+    // возвращает число добавленных партий
+    size_t update(const CorpusReader &corpus)
+    {
+        const size_t added = add_games(corpus);
+        start_merge();
+        return added;
+    }
+
+    // то же в фоновом потоке (вместе со слиянием): корпус corpus_path открывается и дописывается там же,
+    // так что первое построение индекса по большому корпусу не задерживает вызывающий поток
+    void update_async(const std::string &corpus_path)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            pending_corpus = corpus_path;
+        }
+        start_merge();
+    }
+
+    // все вхождения позиции pos с ходом color по возрастанию номера партии
+    std::vector<position_entry> find(const bitboard_pos &pos, const bool color) const
+    {
+        const uint64_t key = position_hash(pos, color);
+        std::vector<position_entry> res;
+        for (const auto &seg : snapshot())
+        {
+            for (size_t k = seg->lower_bound(key); k < seg->size() && seg->entries()[k].key == key; ++k)
+                res.push_back(seg->entries()[k]);
+        }
+        std::sort(res.begin(), res.end());
+        return res;
+    }
+
+    // результаты партий по сделанным из позиции ходам, по убыванию числа партий
+    std::vector<position_move_stats> move_stats(const bitboard_pos &pos, const bool color) const
+    {
+        std::vector<position_move_stats> res;
+        for (const position_entry &e : find(pos, color))
+        {
+            auto it = std::find_if(res.begin(), res.end(), [&](const position_move_stats &s) {
+                return s.has_move == e.has_move() && s.move == e.move();
+            });
+            if (it == res.end())
+            {
+                res.emplace_back();
+                it = res.end() - 1;
+                it->has_move = e.has_move();
+                it->move = e.move();
+            }
+            ++it->games;
+            ++it->results[e.result() == -1 ? 3 : e.result()];
+        }
+        std::stable_sort(res.begin(), res.end(),
+                         [](const position_move_stats &a, const position_move_stats &b) { return a.games > b.games; });
+        return res;
+    }
+
+    // дождаться окончания фонового слияния
+    void wait()
+    {
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (!merging)
+                    break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (merge_thread.joinable())
+            merge_thread.join();
+    }
+
+  private:
+    std::string segment_path(const uint64_t number) const
+    {
+        return path + "." + std::to_string(number);
+    }
+
+    std::vector<std::shared_ptr<PositionSegment>> snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return segments;
+    }
+
+    // записи позиций партии: позиция перед каждым ходом с этим ходом и позиция после последнего хода
+    static void add_game(const uint32_t id, const game_record &game, std::vector<position_entry> &out)
+    {
+        const uint32_t result = uint32_t(game.result == -1 ? 3 : game.result) << 12;
+        auto board = unpack_board(game.start);
+        bool color = game.start_color;
+        bitboard_pos pos = game.start;
+        for (size_t ply = 0; ply <= game.turns.size() && ply <= size_t(POSITION_MAX_PLY); ++ply)
+        {
+            position_entry e;
+            e.key = position_hash(pos, color);
+            e.game = id;
+            e.info = uint32_t(ply) | result;
+            if (ply == game.turns.size())
+            {
+                out.push_back(e);
+                break;
+            }
+            e.info |= 1u << 14 | uint32_t(position_move_code(game.turns[ply])) << 15;
+            out.push_back(e);
+            for (const auto &hop : game.turns[ply])
+                apply_hop(board, hop);
+            pos = pack_board(board);
+            color = !color;
+        }
+    }
+
+    // новые партии корпуса сегментами по POSITION_BATCH записей; возвращает число добавленных партий
+    size_t add_games(const CorpusReader &corpus)
+    {
+        // обновления из разных потоков не должны индексировать одни партии дважды
+        std::lock_guard<std::mutex> lock(update_mtx);
+        const uint64_t from = indexed_games();
+        if (corpus.size() <= from)
+            return 0;
+        std::vector<position_entry> batch;
+        game_record game;
+        uint64_t batch_first = from;
+        for (uint64_t i = from; i < corpus.size(); ++i)
+        {
+            if (cancel)
+                return size_t(batch_first - from);
+            // партия с ошибкой индексируется до ошибочного хода
+            corpus.get(size_t(i), game);
+            add_game(uint32_t(i), game, batch);
+            if (batch.size() >= POSITION_BATCH || i + 1 == corpus.size())
+            {
+                std::sort(batch.begin(), batch.end());
+                if (!write_segment(batch, batch_first, i + 1))
+                    return size_t(batch_first - from);
+                batch.clear();
+                batch_first = i + 1;
+            }
+        }
+        return size_t(corpus.size() - from);
+    }
+
+    // новый сегмент из отсортированных записей партий [first, end)
+    bool write_segment(const std::vector<position_entry> &entries, const uint64_t first, const uint64_t end)
+    {
+        uint64_t number;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            number = next_segment++;
+        }
+        PositionSegmentWriter writer;
+        if (!writer.open(segment_path(number), first, end))
+            return false;
+        for (const auto &e : entries)
+            writer.add(e);
+        if (!writer.finish())
+            return false;
+        auto seg = std::make_shared<PositionSegment>(segment_path(number));
+        if (!seg->open())
+            return false;
+        std::lock_guard<std::mutex> lock(mtx);
+        segments.push_back(seg);
+        return write_manifest();
+    }
+
+    // манифест пишется во временный файл и подменяет старый, так что он всегда целый (вызывается под mtx)
+    bool write_manifest()
+    {
+        const std::string tmp = path + ".tmp";
+        {
+            std::ofstream fout(tmp, std::ios_base::trunc);
+            fout << "CKPX " << POSITION_INDEX_VERSION << " " << next_segment << "\n";
+            for (const auto &seg : segments)
+                fout << seg->path.substr(path.size() + 1) << "\n";
+            if (!fout)
+                return false;
+        }
+#ifdef _WIN32
+        std::remove(path.c_str());
+#endif
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    void start_merge()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (merging)
+        {
+            merge_pending = true;
+            return;
+        }
+        if (merge_thread.joinable())
+            merge_thread.join();
+        merging = true;
+        merge_thread = std::thread(&PositionIndex::merge_loop, this);
+    }
+
+    void merge_loop()
+    {
+        while (!cancel)
+        {
+            std::string corpus_path;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                corpus_path.swap(pending_corpus);
+            }
+            if (!corpus_path.empty())
+            {
+                CorpusReader corpus;
+                if (corpus.open(corpus_path))
+                    add_games(corpus);
+                continue;
+            }
+            // новейшие сегменты, начиная с первого, который не слишком велик по сравнению с суммой следующих
+            std::vector<std::shared_ptr<PositionSegment>> parts;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                uint64_t newer = 0;
+                size_t from = segments.size();
+                for (size_t k = segments.size(); k-- > 0;)
+                {
+                    if (k + 1 < segments.size() && segments[k]->size() <= POSITION_MERGE_RATIO * newer)
+                        from = k;
+                    newer += segments[k]->size();
+                }
+                if (from == segments.size())
+                {
+                    if (!merge_pending && pending_corpus.empty())
+                    {
+                        merging = false;
+                        return;
+                    }
+                    merge_pending = false;
+                    continue;
+                }
+                parts.assign(segments.begin() + long(from), segments.end());
+            }
+            if (!merge(parts))
+                break;
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        merging = false;
+    }
+
+    // слияние сегментов parts (подряд идущих в списке) в один
+    bool merge(const std::vector<std::shared_ptr<PositionSegment>> &parts)
+    {
+        uint64_t number;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            number = next_segment++;
+        }
+        PositionSegmentWriter writer;
+        if (!writer.open(segment_path(number), parts.front()->first, parts.back()->end))
+            return false;
+        typedef std::pair<position_entry, size_t> head;
+        auto greater = [](const head &a, const head &b) { return b.first < a.first; };
+        std::priority_queue<head, std::vector<head>, decltype(greater)> heap(greater);
+        std::vector<size_t> next(parts.size(), 0);
+        for (size_t p = 0; p < parts.size(); ++p)
+        {
+            if (parts[p]->size())
+                heap.push({parts[p]->entries()[next[p]++], p});
+        }
+        for (uint64_t written = 0; !heap.empty(); ++written)
+        {
+            if ((written & 0xFFFF) == 0 && cancel)
+                return false;
+            const head top = heap.top();
+            heap.pop();
+            writer.add(top.first);
+            const size_t p = top.second;
+            if (next[p] < parts[p]->size())
+                heap.push({parts[p]->entries()[next[p]++], p});
+        }
+        if (!writer.finish())
+            return false;
+        auto merged = std::make_shared<PositionSegment>(segment_path(number));
+        if (!merged->open())
+            return false;
+        std::lock_guard<std::mutex> lock(mtx);
+        const auto it = std::find(segments.begin(), segments.end(), parts.front());
+        if (it == segments.end())
+            return false;
+        const auto pos = segments.erase(it, it + long(parts.size()));
+        segments.insert(pos, merged);
+        if (!write_manifest())
+            return false;
+        // старые файлы удаляются, когда их отпустят начатые запросы
+        for (const auto &seg : parts)
+            seg->remove_file = true;
+        return true;
+    }
+
+    std::string path;
+    mutable std::mutex mtx;
+    // сегменты от старых партий к новым
+    std::vector<std::shared_ptr<PositionSegment>> segments;
+    uint64_t next_segment = 0;
+    std::thread merge_thread;
+    bool merging = false;
+    // за время слияния добавились сегменты, проверить еще раз
+    bool merge_pending = false;
+    // корпус для фонового update_async
+    std::string pending_corpus;
+    std::mutex update_mtx;
+    std::atomic<bool> cancel{false};
+};
@@ -0,0 +1,88 @@
+﻿#pragma once
+#include <string>
+
+// правила варианта шашек как набор констант этапа компиляции: генератор ходов и поиск
+// собираются отдельно для каждого варианта, поэтому проверки правил не выполняются во время поиска
+
+// превращение шашки, дошедшей до последней строки во время серии взятий
+enum class promotion_rule
+{
+    continue_as_king, // сразу становится дамкой и продолжает серию дамкой
+    end_series,       // становится дамкой, серия на этом заканчивается
+    at_series_end     // продолжает серию шашкой, становится дамкой, только если серия закончилась на этой строке
+};
+
+// русские шашки в том виде, как их реализует Logic::find_turns (побитые снимаются сразу по ходу серии)
+struct russian_rules
+{
+    static constexpr bool flying_kings = true;         // дамка ходит и бьет на любое расстояние
+    static constexpr bool men_capture_backward = true; // шашка бьет назад
+    static constexpr bool max_capture = false;         // обязательно взятие наибольшего числа фигур
+    static constexpr bool lift_after_series = false;   // побитые снимаются после серии (турецкий удар)
+    static constexpr promotion_rule promotion = promotion_rule::continue_as_king;
+    static const char *name()
+    {
+        return "russian";
+    }
+};
+
+// английские шашки (checkers): короткие дамки, шашки бьют только вперед, превращение заканчивает ход
+struct english_rules
+{
+    static constexpr bool flying_kings = false;
+    static constexpr bool men_capture_backward = false;
+    static constexpr bool max_capture = false;
+    static constexpr bool lift_after_series = true;
+    static constexpr promotion_rule promotion = promotion_rule::end_series;
+    static const char *name()
+    {
+        return "english";
+    }
+};
+
+// бразильские шашки: правила международных шашек на доске 8x8
+struct brazilian_rules
+{
+    static constexpr bool flying_kings = true;
+    static constexpr bool men_capture_backward = true;
+    static constexpr bool max_capture = true;
+    static constexpr bool lift_after_series = true;
+    static constexpr promotion_rule promotion = promotion_rule::at_series_end;
+    static const char *name()
+    {
+        return "brazilian";
+    }
+};
+
+// американские pool checkers: как бразильские, но без правила большинства
+struct pool_rules
+{
+    static constexpr bool flying_kings = true;
+    static constexpr bool men_capture_backward = true;
+    static constexpr bool max_capture = false;
+    static constexpr bool lift_after_series = true;
+    static constexpr promotion_rule promotion = promotion_rule::at_series_end;
+    static const char *name()
+    {
+        return "pool";
+    }
+};
+
+// международные шашки 10x10
+typedef brazilian_rules international_rules;
+
+// вызов f(rules) с вариантом по имени ("russian", "english", "brazilian", "pool"); false - неизвестное имя
+template <class F> bool with_rules(const std::string &name, F &&f)
+{
+    if (name == russian_rules::name())
+        f(russian_rules());
+    else if (name == english_rules::name())
+        f(english_rules());
+    else if (name == brazilian_rules::name())
+        f(brazilian_rules());
+    else if (name == pool_rules::name())
+        f(pool_rules());
+    else
+        return false;
+    return true;
+}
@@ -0,0 +1,530 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+#include "../Models/Bitboard.h"
+#include "../Models/Move.h"
+#include "../Models/Zobrist.h"
+#include "Config.h"
+#include "History.h"
+#include "Logic.h"
+#include "Movegen.h"
+#include "Rules.h"
+#include "Timeman.h"
+#include "Trace.h"
+#include "Tt.h"
+
+// оценки поиска: логарифм отношения calc_score в тысячных с точки зрения ходящего,
+// выигрыш - SEARCH_WIN минус число полуходов до него
+const int SEARCH_WIN = 30000;
+const int SEARCH_WIN_BOUND = SEARCH_WIN - 1000;
+const int SEARCH_EVAL_MAX = 20000;
+const int SEARCH_MAX_PLY = 128;
+
+// ограничения поиска, 0 - без ограничения
+struct search_limits
+{
+    int depth = SEARCH_MAX_PLY - 1;
+    int64_t nodes = 0;
+    int move_time_ms = 0;
+    // рассчитанное время на ход (Timeman.h): новая итерация начинается, только пока оно не израсходовано
+    int soft_time_ms = 0;
+    // число лучших ходов корня с точными оценками (MultiPV, для анализа)
+    int multi_pv = 1;
+};
+
+// ход корня и его оценка
+struct root_line
+{
+    vector<move_pos> turn;
+    int score = 0;
+};
+
+// результат завершенной итерации
+struct search_info
+{
+    int depth = 0;
+    int score = 0;
+    int64_t nodes = 0;
+    int time_ms = 0;
+    vector<vector<move_pos>> pv;
+    // лучшие ходы корня по убыванию оценки, search_limits::multi_pv штук (меньше, если ходов меньше)
+    vector<root_line> lines;
+    // корень совпал с позицией, ожидавшейся по главной линии прошлого поиска
+    bool predicted = false;
+};
+
+// код полного хода для таблицы транспозиций: откуда, первая и последняя клетка серии
+inline uint16_t turn_code(const vector<move_pos> &turn)
+{
+    const move_pos &first = turn.front(), &last = turn.back();
+    return uint16_t(1 + square_index(first.x, first.y) + 32 * square_index(first.x2, first.y2) +
+                    1024 * square_index(last.x2, last.y2));
+}
+
+// код того же хода в отраженной позиции (canonical_hash): каждая клетка sq переходит в 31 - sq
+inline uint16_t flip_turn_code(const uint16_t code)
+{
+    if (!code)
+        return 0;
+    const int c = code - 1;
+    return uint16_t(1 + (31 - c % 32) + 32 * (31 - c / 32 % 32) + 1024 * (31 - c / 1024));
+}
+
+// поиск с итеративным углублением и таблицей транспозиций (negamax с альфа-бета) на масках,
+// ходы генерирует Movegen для правил Rules: серия взятий одной шашкой - один полуход, оценку дает Logic.
+// Таблица транспозиций, таблица истории тихих ходов и ожидаемая линия сохраняются между вызовами go,
+// поэтому следующий ход той же партии начинается с результатов предыдущего поиска
+template <class Rules> class BasicSearch
+{
+  public:
+    typedef Movegen<8, Rules> movegen;
+
+    BasicSearch(Config *config, TranspositionTable *tt) : logic(config), tt(tt), config(config)
+    {
+        no_progress_limit = (*config)("Game", "NoProgressLimit");
+    }
+
+    // перечитать настройки (после перезапуска игры); накопленные таблицы остаются
+    void reload()
+    {
+        logic.reload();
+        no_progress_limit = (*config)("Game", "NoProgressLimit");
+    }
+
+    // забыть все, что узнали прошлые поиски (новая партия с другой оценкой, ucinewgame)
+    void clear()
+    {
+        tt->clear();
+        std::fill(std::begin(history_table), std::end(history_table), 0);
+        expected_key[0] = expected_key[1] = 0;
+    }
+
+    // лучший ход для цвета color в позиции mtx; info вызывается после каждой завершенной итерации
+    vector<move_pos> go(const vector<vector<POS_T>> &mtx, const bool color, const search_limits &limits,
+                        const function<void(const search_info &)> &info = nullptr)
+    {
+        return go(pack_board(mtx), color, limits, info);
+    }
+
+    vector<move_pos> go(const bitboard_pos &root, const bool color, const search_limits &limits,
+                        const function<void(const search_info &)> &info = nullptr)
+    {
+        TRACE_ROOT("search", "search");
+        start = chrono::steady_clock::now();
+        // stop, пришедший до начала поиска, не теряется: флаг сбрасывается до проверки запроса
+        stopped = false;
+        if (stop_requested)
+            stopped = true;
+        nodes = 0;
+        node_limit = limits.nodes;
+        set_move_time(limits.move_time_ms);
+        set_soft_time(limits.soft_time_ms);
+        ++started;
+        tt->reserve();
+        tt->new_search();
+        last = search_info();
+        // старые счетчики истории постепенно теряют вес
+        for (int &h : history_table)
+            h /= 2;
+
+        vector<vector<move_pos>> turns;
+        movegen::full_turns(root, color, turns);
+        if (turns.empty())
+            return {};
+        // корень добавляется в историю, если вызывающий не добавил его сам
+        const uint64_t root_key = position_hash(root, color);
+        const bool push_root = history.empty() || history.last_key() != root_key;
+        if (push_root)
+            history.push(root, color);
+        // соперник ответил по главной линии: ее продолжение пробуется первым, даже если таблица его потеряла
+        last.predicted = expected_key[color] && expected_key[color] == root_key;
+        if (last.predicted)
+            order(turns, expected_move[color]);
+        vector<move_pos> best = turns[0];
+        // стабильность лучшего хода по итерациям для распределения времени
+        const bool root_captures = turns[0][0].xb != -1;
+        int best_changes = 0, stable_iterations = 0;
+        for (int depth = 1; depth <= min(limits.depth, SEARCH_MAX_PLY - 1); ++depth)
+        {
+            int best_index = -1;
+            TRACE_SCOPE_ARG("iteration", "search", depth);
+            const int score = search_root(root, color, depth, max(1, limits.multi_pv), turns, best_index);
+            // прерванная итерация используется, только если она успела улучшить ход
+            const vector<move_pos> previous = best;
+            if (best_index != -1)
+                best = turns[best_index];
+            if (stopped)
+                break;
+            best_changes /= 2;
+            if (depth > 1 && best != previous)
+            {
+                best_changes += 2;
+                stable_iterations = 0;
+            }
+            else
+                ++stable_iterations;
+            last.depth = depth;
+            last.score = score;
+            last.nodes = nodes;
+            last.time_ms = elapsed_ms();
+            last.pv = pv_line(root, color);
+            last.lines = root_lines;
+            if (info)
+                info(last);
+            // единственный ход или найденный выигрыш - дальше углубляться незачем
+            if (turns.size() == 1 || abs(score) >= SEARCH_WIN - depth)
+                break;
+            // следующая итерация обычно дольше всех предыдущих вместе, поэтому ее не начинаем,
+            // если прошла половина рассчитанного времени
+            const int soft = soft_time_ms;
+            if (soft &&
+                elapsed_ms() - soft_from_ms >= soft * time_scale(best_changes, stable_iterations, root_captures) / 2)
+                break;
+        }
+        if (push_root)
+            history.pop();
+        // позиция после нашего хода и ожидаемого ответа - вероятный корень следующего поиска
+        expected_key[color] = 0;
+        if (last.pv.size() >= 3 && last.pv[0] == best)
+        {
+            expected_key[color] =
+                position_hash(movegen::make_turn(movegen::make_turn(root, last.pv[0]), last.pv[1]), color);
+            expected_move[color] = turn_code(last.pv[2]);
+        }
+        return best;
+    }
+
+    // остановка поиска из другого потока; действует и на go, который еще не начался
+    void stop()
+    {
+        stop_requested = true;
+        stopped = true;
+    }
+
+    // снять запрос остановки перед запуском go в другом потоке (после join прошлого поиска)
+    void clear_stop()
+    {
+        stop_requested = false;
+    }
+
+    // время на текущий поиск начиная с этого момента (0 - без ограничения), можно менять во время поиска
+    void set_move_time(const int ms)
+    {
+        deadline_ms = ms > 0 ? elapsed_ms() + ms : 0;
+    }
+
+    // рассчитанное время на ход (search_limits::soft_time_ms) начиная с этого момента (0 - без ограничения),
+    // можно менять во время поиска: при обдумывании на время соперника оно задается по ponderhit
+    void set_soft_time(const int ms)
+    {
+        soft_from_ms = elapsed_ms();
+        soft_time_ms = ms;
+    }
+
+    // число начатых go: после его изменения set_move_time и set_soft_time уже не перекрываются лимитами go
+    int64_t started_searches() const
+    {
+        return started;
+    }
+
+    int64_t node_count() const
+    {
+        return nodes;
+    }
+
+    // последняя завершенная итерация
+    search_info last;
+    // позиции партии до корня включительно (для правил ничьей)
+    HashHistory history;
+
+  private:
+    // multi_pv > 1: первые multi_pv ходов получают точные оценки, остальные проверяются нулевым окном
+    // против худшей из лучших multi_pv оценок
+    int search_root(const bitboard_pos &pos, const bool color, const int depth, const int multi_pv,
+                    vector<vector<move_pos>> &turns, int &best_index)
+    {
+        // таблица хранит позицию и ее отражение с переставленными цветами в одной записи
+        bool flipped;
+        const uint64_t key = canonical_hash(pos, color, flipped);
+        tt_data e;
+        if (tt->probe(key, e) && e.move)
+            order(turns, flipped ? flip_turn_code(e.move) : e.move);
+        int alpha = -SEARCH_WIN - 1;
+        const int beta = SEARCH_WIN + 1;
+        pv_len[0] = 0;
+        vector<int> scores(turns.size(), -SEARCH_WIN - 1), top;
+        for (size_t k = 0; k < turns.size(); ++k)
+        {
+            TRACE_SCOPE_ARG("root move", "search", k);
+            const bitboard_pos child = movegen::make_turn(pos, turns[k]);
+            // первый ход - с полным окном, остальные - проверка нулевым окном и пересчет при улучшении
+            const int floor = multi_pv == 1 ? alpha : int(top.size()) < multi_pv ? -SEARCH_WIN - 1 : top.back();
+            int score;
+            if (!k || floor == -SEARCH_WIN - 1)
+                score = -negamax(child, !color, depth - 1, -beta, -floor, 1);
+            else
+            {
+                score = -negamax(child, !color, depth - 1, -floor - 1, -floor, 1);
+                if (score > floor && !stopped)
+                    score = -negamax(child, !color, depth - 1, -beta, -floor, 1);
+            }
+            if (stopped)
+                break;
+            if (score > floor)
+            {
+                scores[k] = score;
+                top.insert(std::upper_bound(top.begin(), top.end(), score, std::greater<int>()), score);
+                if (int(top.size()) > multi_pv)
+                    top.pop_back();
+            }
+            if (score > alpha)
+            {
+                alpha = score;
+                best_index = int(k);
+                update_pv(0, turn_code(turns[k]));
+            }
+        }
+        if (best_index != -1)
+        {
+            // лучший ход - первым в следующей итерации, с multi_pv - все ходы по убыванию оценок
+            if (multi_pv == 1)
+                std::rotate(turns.begin(), turns.begin() + best_index, turns.begin() + best_index + 1);
+            else
+            {
+                vector<size_t> by_score(turns.size());
+                for (size_t k = 0; k < by_score.size(); ++k)
+                    by_score[k] = k;
+                std::stable_sort(by_score.begin(), by_score.end(),
+                                 [&](const size_t a, const size_t b) { return scores[a] > scores[b]; });
+                vector<vector<move_pos>> sorted;
+                vector<int> sorted_scores;
+                for (const size_t k : by_score)
+                {
+                    sorted.push_back(turns[k]);
+                    sorted_scores.push_back(scores[k]);
+                }
+                turns.swap(sorted);
+                scores.swap(sorted_scores);
+            }
+            best_index = 0;
+            root_lines.clear();
+            root_lines.push_back({turns[0], alpha});
+            for (size_t k = 1; k < turns.size() && int(k) < multi_pv && scores[k] > -SEARCH_WIN - 1; ++k)
+                root_lines.push_back({turns[k], scores[k]});
+            if (!stopped)
+                tt->store(key, alpha, depth, TT_EXACT,
+                          flipped ? flip_turn_code(turn_code(turns[0])) : turn_code(turns[0]));
+        }
+        return alpha;
+    }
+
+    int negamax(const bitboard_pos &pos, const bool color, const int depth, int alpha, const int beta,
+                const int ply)
+    {
+        pv_len[ply] = 0;
+        if ((++nodes & 1023) == 0)
+            check_limits();
+        if (stopped)
+            return 0;
+        if (ply >= SEARCH_MAX_PLY - 1)
+            return static_eval(pos, color);
+
+        // повторение позиции на пути или в партии и ходы без продвижения - ничья
+        history_guard guard(history, pos, color);
+        if (history.is_draw(1, no_progress_limit))
+            return 0;
+
+        const bool pv_node = beta - alpha > 1;
+        bool flipped;
+        const uint64_t key = canonical_hash(pos, color, flipped);
+        tt_data e;
+        uint16_t tt_move = 0;
+        if (tt->probe(key, e))
+        {
+            tt_move = flipped ? flip_turn_code(e.move) : e.move;
+            const int s = score_from_tt(e.score, ply);
+            // в узлах главной линии таблица не обрывает поиск, чтобы линия была полной
+            if (!pv_node && e.depth >= max(depth, 0) &&
+                (e.bound == TT_EXACT || (e.bound == TT_LOWER && s >= beta) || (e.bound == TT_UPPER && s <= alpha)))
+                return s;
+        }
+
+        // списки ходов по глубине переиспользуются между узлами
+        auto &turns = ply_turns[ply];
+        movegen::full_turns(pos, color, turns);
+        // нет ходов - проигрыш
+        if (turns.empty())
+            return -SEARCH_WIN + ply;
+        // за горизонтом досчитываются только взятия (они обязательны, поэтому без оценки "стоя")
+        const bool captures = turns[0][0].xb != -1;
+        if (depth <= 0 && !captures)
+            return static_eval(pos, color);
+        if (!captures)
+            order_history(turns, color);
+        if (tt_move)
+            order(turns, tt_move);
+
+        const int alpha0 = alpha;
+        int best = -SEARCH_WIN - 1;
+        uint16_t best_move = 0;
+        for (size_t k = 0; k < turns.size(); ++k)
+        {
+            const auto &turn = turns[k];
+            const bitboard_pos child = movegen::make_turn(pos, turn);
+            int score;
+            if (!k || !pv_node)
+                score = -negamax(child, !color, depth - 1, -beta, -alpha, ply + 1);
+            else
+            {
+                score = -negamax(child, !color, depth - 1, -alpha - 1, -alpha, ply + 1);
+                if (score > alpha && score < beta && !stopped)
+                    score = -negamax(child, !color, depth - 1, -beta, -alpha, ply + 1);
+            }
+            if (stopped)
+                return 0;
+            if (score > best)
+            {
+                best = score;
+                best_move = turn_code(turn);
+                if (score > alpha)
+                {
+                    alpha = score;
+                    update_pv(ply, best_move);
+                    if (alpha >= beta)
+                    {
+                        // тихий ход, давший отсечение, в следующих узлах пробуется раньше
+                        if (!captures)
+                            history_table[history_index(color, turn)] += depth * depth;
+                        break;
+                    }
+                }
+            }
+        }
+        const int bound = best >= beta ? TT_LOWER : best > alpha0 ? TT_EXACT : TT_UPPER;
+        tt->store(key, score_to_tt(best, ply), max(depth, 0), bound, flipped ? flip_turn_code(best_move) : best_move);
+        return best;
+    }
+
+    // статическая оценка для ходящего
+    int static_eval(const bitboard_pos &pos, const bool color) const
+    {
+        const double ratio = logic.evaluate(pos, color);
+        if (ratio <= 0)
+            return -SEARCH_EVAL_MAX;
+        if (ratio >= INF)
+            return SEARCH_EVAL_MAX;
+        return max(-SEARCH_EVAL_MAX, min(SEARCH_EVAL_MAX, int(lround(log(ratio) * 1000))));
+    }
+
+    // оценки выигрыша хранятся в таблице относительно узла, а не корня
+    static int score_to_tt(const int score, const int ply)
+    {
+        return score >= SEARCH_WIN_BOUND ? score + ply : score <= -SEARCH_WIN_BOUND ? score - ply : score;
+    }
+
+    static int score_from_tt(const int score, const int ply)
+    {
+        return score >= SEARCH_WIN_BOUND ? score - ply : score <= -SEARCH_WIN_BOUND ? score + ply : score;
+    }
+
+    static int history_index(const bool color, const vector<move_pos> &turn)
+    {
+        return (color * 32 + square_index(turn[0].x, turn[0].y)) * 32 + square_index(turn[0].x2, turn[0].y2);
+    }
+
+    // тихие ходы по убыванию счетчика истории
+    void order_history(vector<vector<move_pos>> &turns, const bool color) const
+    {
+        std::stable_sort(turns.begin(), turns.end(), [&](const vector<move_pos> &a, const vector<move_pos> &b) {
+            return history_table[history_index(color, a)] > history_table[history_index(color, b)];
+        });
+    }
+
+    // ход с кодом code ставится первым
+    static void order(vector<vector<move_pos>> &turns, const uint16_t code)
+    {
+        for (size_t k = 0; k < turns.size(); ++k)
+        {
+            if (turn_code(turns[k]) == code)
+            {
+                std::rotate(turns.begin(), turns.begin() + k, turns.begin() + k + 1);
+                return;
+            }
+        }
+    }
+
+    void update_pv(const int ply, const uint16_t code)
+    {
+        pv[ply][0] = code;
+        const int child = ply + 1 < SEARCH_MAX_PLY ? pv_len[ply + 1] : 0;
+        for (int k = 0; k < child; ++k)
+            pv[ply][k + 1] = pv[ply + 1][k];
+        pv_len[ply] = child + 1;
+    }
+
+    // главная линия из кодов ходов в полные ходы
+    vector<vector<move_pos>> pv_line(bitboard_pos pos, bool color)
+    {
+        vector<vector<move_pos>> line;
+        vector<vector<move_pos>> turns;
+        for (int k = 0; k < pv_len[0]; ++k)
+        {
+            movegen::full_turns(pos, color, turns);
+            auto it = std::find_if(turns.begin(), turns.end(),
+                                   [&](const vector<move_pos> &t) { return turn_code(t) == pv[0][k]; });
+            if (it == turns.end())
+                break;
+            line.push_back(*it);
+            pos = movegen::make_turn(pos, *it);
+            color = !color;
+        }
+        return line;
+    }
+
+    void check_limits()
+    {
+        if ((node_limit && nodes >= node_limit) || (deadline_ms && elapsed_ms() >= deadline_ms))
+            stopped = true;
+    }
+
+    int elapsed_ms() const
+    {
+        return int(chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count());
+    }
+
+  private:
+    Logic logic;
+    TranspositionTable *tt;
+    Config *config;
+    chrono::steady_clock::time_point start;
+    std::atomic<bool> stopped{false};
+    // запрос остановки извне, в отличие от stopped не сбрасывается в go
+    std::atomic<bool> stop_requested{false};
+    std::atomic<int> deadline_ms{0};
+    // начало отсчета и величина рассчитанного времени на ход
+    std::atomic<int> soft_from_ms{0};
+    std::atomic<int> soft_time_ms{0};
+    std::atomic<int64_t> started{0};
+    int64_t nodes = 0;
+    int64_t node_limit = 0;
+    int no_progress_limit = 0;
+    // треугольная таблица главных линий
+    uint16_t pv[SEARCH_MAX_PLY][SEARCH_MAX_PLY];
+    int pv_len[SEARCH_MAX_PLY];
+    // лучшие ходы корня последней итерации
+    vector<root_line> root_lines;
+    vector<vector<move_pos>> ply_turns[SEARCH_MAX_PLY];
+    // счетчики отсечений тихих ходов: цвет, откуда, куда
+    int history_table[2 * 32 * 32] = {};
+    // ожидаемый корень следующего поиска за каждый цвет и лучший ход в нем по прошлой главной линии
+    uint64_t expected_key[2] = {0, 0};
+    uint16_t expected_move[2] = {0, 0};
+};
+
+// поиск по правилам Logic
+typedef BasicSearch<russian_rules> Search;
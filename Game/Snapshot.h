@@ -0,0 +1,121 @@
+﻿#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../Models/Geometry.h"
+#include "../Models/Move.h"
+
+// подсветка клеток снимка хранится битами одного uint64_t
+static_assert(game_geometry::size * game_geometry::size <= 64, "highlighted mask must fit all cells");
+
+// неизменяемый снимок доски для потока отрисовки: поток игры только публикует снимки и события ходов
+struct board_snapshot
+{
+    POS_T mtx[game_geometry::size][game_geometry::size] = {};
+    uint64_t highlighted = 0; // бит i * size + j - подсвеченная клетка
+    int active_x = -1, active_y = -1;
+    int game_results = -1;
+};
+
+// подсказки фонового анализа: лучшие ходы с оценками для позиции mtx (на другой позиции они не рисуются)
+const int ANALYSIS_MAX_LINES = 4;
+const int ANALYSIS_MAX_PATH = 16;
+struct analysis_hint
+{
+    POS_T path[ANALYSIS_MAX_PATH][2] = {}; // клетки хода: начальная и конец каждого перемещения серии
+    int path_len = 0;
+    char score[8] = {}; // оценка для показа: "+0.4", "-1.2", "#3" - выигрыш за 3 хода, "-#3" - проигрыш
+};
+
+struct analysis_overlay
+{
+    POS_T mtx[game_geometry::size][game_geometry::size] = {};
+    analysis_hint hints[ANALYSIS_MAX_LINES]; // первый - лучший
+    int count = 0;
+    int depth = 0;
+};
+
+// перемещение шашки для анимации: доска до перемещения и само перемещение
+struct move_event
+{
+    board_snapshot before;
+    move_pos hop = move_pos(-1, -1, -1, -1);
+    uint32_t epoch = 0; // события старой эпохи (до отката или перезапуска) пропускаются
+};
+
+// последний опубликованный снимок: тройной буфер, писатель и читатель никогда не ждут друг друга
+template <class T> class TripleBuffer
+{
+  public:
+    // буфер писателя, после заполнения - publish
+    T &back()
+    {
+        return slots[back_idx];
+    }
+
+    void publish()
+    {
+        back_idx = middle.exchange(back_idx | DIRTY, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // забрать последний снимок, false - нового нет
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & DIRTY))
+            return false;
+        front_idx = middle.exchange(front_idx, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    const T &front() const
+    {
+        return slots[front_idx];
+    }
+
+  private:
+    static const int INDEX = 3;
+    static const int DIRTY = 4;
+
+    T slots[3];
+    std::atomic<int> middle{1};
+    int back_idx = 0;
+    int front_idx = 2;
+};
+
+// очередь без блокировок на одного писателя и одного читателя; при переполнении push возвращает false
+template <class T, size_t N> class SpscQueue
+{
+    static_assert((N & (N - 1)) == 0, "queue size must be a power of two");
+
+  public:
+    bool push(const T &item)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N)
+            return false;
+        items[t & (N - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        item = items[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+  private:
+    T items[N];
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
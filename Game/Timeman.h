@@ -0,0 +1,118 @@
+﻿#pragma once
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+
+// часы партии: основное время, добавка за ход и контроль на число ходов (каждые moves_per_period ходов
+// добавляется основное время); base_ms = 0 - партия без часов
+class GameClock
+{
+  public:
+    void reset(const int64_t base, const int64_t increment, const int period)
+    {
+        base_ms = base;
+        inc_ms = increment;
+        moves_per_period = period;
+        remaining[0] = remaining[1] = base;
+        moves[0] = moves[1] = 0;
+    }
+
+    bool enabled() const
+    {
+        return base_ms > 0;
+    }
+
+    // начало очередного хода
+    void start_turn()
+    {
+        turn_start = std::chrono::steady_clock::now();
+    }
+
+    // конец хода цвета color; false - время вышло
+    bool finish_turn(const bool color)
+    {
+        if (!enabled())
+            return true;
+        remaining[color] -= std::chrono::duration_cast<std::chrono::milliseconds>(
+                                std::chrono::steady_clock::now() - turn_start)
+                                .count();
+        if (remaining[color] < 0)
+            return false;
+        remaining[color] += inc_ms;
+        if (moves_per_period && ++moves[color] % moves_per_period == 0)
+            remaining[color] += base_ms;
+        return true;
+    }
+
+    int64_t remaining_ms(const bool color) const
+    {
+        return remaining[color];
+    }
+
+    int64_t increment_ms() const
+    {
+        return inc_ms;
+    }
+
+    // ходов до следующего контроля, 0 - контроля нет
+    int moves_to_go(const bool color) const
+    {
+        return moves_per_period ? moves_per_period - moves[color] % moves_per_period : 0;
+    }
+
+  private:
+    int64_t base_ms = 0;
+    int64_t inc_ms = 0;
+    int moves_per_period = 0;
+    int64_t remaining[2] = {0, 0};
+    int moves[2] = {0, 0};
+    std::chrono::steady_clock::time_point turn_start = std::chrono::steady_clock::now();
+};
+
+// время на ход: soft - на сколько рассчитан ход (поиск продолжает итерации только до него),
+// hard - после него поиск прерывается в любом случае
+struct time_budget
+{
+    int soft_ms = 0;
+    int hard_ms = 0;
+};
+
+// запас на задержки вывода и перерисовки, чтобы не просрочить время из-за них
+const int TIME_SAFETY_MS = 30;
+
+// распределение оставшегося времени по ходам с учетом фазы партии
+// pieces - фигур на доске, legal_moves - число полных ходов в позиции
+inline time_budget allocate_time(const int64_t remaining_ms, const int64_t inc_ms, const int moves_to_go,
+                                 const int pieces, const int legal_moves)
+{
+    time_budget res;
+    const int64_t usable = std::max<int64_t>(1, remaining_ms - TIME_SAFETY_MS);
+    // единственный ход делается сразу
+    if (legal_moves <= 1)
+    {
+        res.soft_ms = res.hard_ms = 1;
+        return res;
+    }
+    // ожидаемое число своих ходов до конца партии убывает вместе с числом фигур
+    const int horizon = moves_to_go ? moves_to_go : 10 + pieces;
+    // дебют играется быстрее, больше всего времени получает миттельшпиль
+    const double phase = pieces >= 20 ? 0.7 : pieces >= 9 ? 1.25 : 1.0;
+    const int64_t soft = int64_t(double(usable) / horizon * phase) + inc_ms * 3 / 4;
+    res.soft_ms = int(std::max<int64_t>(1, std::min(soft, usable / 2)));
+    res.hard_ms = int(std::max<int64_t>(res.soft_ms, std::min(int64_t(res.soft_ms) * 4, usable / 3)));
+    return res;
+}
+
+// множитель soft-времени после итерации: нестабильный лучший ход и обязательная серия взятий
+// в корне продлевают ход, лучший ход, не менявшийся несколько итераций, позволяет закончить раньше
+inline double time_scale(const int best_changes, const int stable_iterations, const bool root_captures)
+{
+    double scale = 1.0;
+    if (best_changes > 0)
+        scale *= 1.0 + 0.3 * std::min(best_changes, 3);
+    else if (stable_iterations >= 4)
+        scale *= 0.6;
+    if (root_captures)
+        scale *= 1.3;
+    return scale;
+}
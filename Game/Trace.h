@@ -0,0 +1,190 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// трассировка интервалов в формате Chrome trace events (открывается в chrome://tracing и Perfetto).
+// Включается настройкой Game/TraceFile; сборка с -DCHECKERS_TRACE=0 убирает все интервалы из кода.
+#ifndef CHECKERS_TRACE
+#define CHECKERS_TRACE 1
+#endif
+
+struct trace_event
+{
+    const char *name;
+    const char *cat;
+    int64_t ts;  // начало, мкс от старта записи
+    int64_t dur; // длительность, мкс
+    int64_t arg; // число для args (глубина, номер хода), -1 - нет
+    uint32_t tid;
+};
+
+class Tracer
+{
+  public:
+    static Tracer &instance()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    ~Tracer()
+    {
+        stop();
+    }
+
+    // начать запись в path; записывается каждый sample_rate-й корневой интервал (кадр, ход) со всеми вложенными
+    void start(const std::string &path, const int sample_rate)
+    {
+#if CHECKERS_TRACE
+        std::lock_guard<std::mutex> lock(m);
+        if (path.empty() || on)
+            return;
+        file = path;
+        rate = sample_rate > 0 ? uint64_t(sample_rate) : 1;
+        origin = std::chrono::steady_clock::now();
+        events.clear();
+        dropped = 0;
+        on = true;
+#endif
+    }
+
+    // закончить запись и сохранить файл
+    void stop()
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if (!on)
+            return;
+        on = false;
+        std::ofstream fout(file, std::ios_base::trunc);
+        fout << "{\"traceEvents\":[\n";
+        for (size_t k = 0; k < events.size(); ++k)
+        {
+            const trace_event &e = events[k];
+            fout << "{\"name\":\"" << e.name << "\",\"cat\":\"" << e.cat << "\",\"ph\":\"X\",\"ts\":" << e.ts
+                 << ",\"dur\":" << e.dur << ",\"pid\":1,\"tid\":" << e.tid;
+            if (e.arg != -1)
+                fout << ",\"args\":{\"v\":" << e.arg << "}";
+            fout << (k + 1 < events.size() ? "},\n" : "}\n");
+        }
+        fout << "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":" << dropped << "}}\n";
+        events.clear();
+    }
+
+    bool enabled() const
+    {
+        return on.load(std::memory_order_relaxed);
+    }
+
+    // записывать ли очередной корневой интервал
+    bool sample()
+    {
+        return roots.fetch_add(1, std::memory_order_relaxed) % rate == 0;
+    }
+
+    int64_t now_us() const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin)
+            .count();
+    }
+
+    void add(const trace_event &e)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if (!on)
+            return;
+        // ограничение памяти: после MAX_EVENTS интервалы только считаются
+        if (events.size() < MAX_EVENTS)
+            events.push_back(e);
+        else
+            ++dropped;
+    }
+
+    // короткий номер потока для tid
+    static uint32_t thread_id()
+    {
+        static std::atomic<uint32_t> next{1};
+        static thread_local uint32_t id = next++;
+        return id;
+    }
+
+    // пишется ли трасса в текущем потоке (внутри выбранного корневого интервала)
+    static bool &active()
+    {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+  private:
+    Tracer() = default;
+
+    static const size_t MAX_EVENTS = 1 << 20;
+
+    std::mutex m;
+    std::atomic<bool> on{false};
+    std::atomic<uint64_t> roots{0};
+    uint64_t rate = 1;
+    uint64_t dropped = 0;
+    std::string file;
+    std::chrono::steady_clock::time_point origin;
+    std::vector<trace_event> events;
+};
+
+// интервал от создания до конца области видимости; корневой интервал решает по выборке, писать ли
+// его вместе с вложенными, вложенные пишутся только внутри выбранного корневого
+class trace_span
+{
+  public:
+    trace_span(const char *name, const char *cat, const bool root, const int64_t arg = -1)
+    {
+        Tracer &tracer = Tracer::instance();
+        if (!tracer.enabled())
+            return;
+        bool &active = Tracer::active();
+        if (!active)
+        {
+            if (!root || !tracer.sample())
+                return;
+            active = owner = true;
+        }
+        e = {name, cat, tracer.now_us(), 0, arg, Tracer::thread_id()};
+        recording = true;
+    }
+
+    ~trace_span()
+    {
+        if (!recording)
+            return;
+        Tracer &tracer = Tracer::instance();
+        e.dur = tracer.now_us() - e.ts;
+        tracer.add(e);
+        if (owner)
+            Tracer::active() = false;
+    }
+
+    trace_span(const trace_span &) = delete;
+    trace_span &operator=(const trace_span &) = delete;
+
+  private:
+    trace_event e{};
+    bool recording = false;
+    bool owner = false;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#if CHECKERS_TRACE
+// корневой интервал (кадр, ход бота, поиск в отдельном потоке)
+#define TRACE_ROOT(name, cat) trace_span TRACE_CONCAT(trace_span_, __LINE__)(name, cat, true)
+// вложенный интервал, arg - число в args
+#define TRACE_SCOPE(name, cat) trace_span TRACE_CONCAT(trace_span_, __LINE__)(name, cat, false)
+#define TRACE_SCOPE_ARG(name, cat, arg) trace_span TRACE_CONCAT(trace_span_, __LINE__)(name, cat, false, int64_t(arg))
+#else
+#define TRACE_ROOT(name, cat)
+#define TRACE_SCOPE(name, cat)
+#define TRACE_SCOPE_ARG(name, cat, arg)
+#endif
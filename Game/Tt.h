@@ -0,0 +1,124 @@
+﻿#pragma once
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+// границы оценки, сохраненной в таблице
+const int TT_UPPER = 1; // оценка не больше сохраненной
+const int TT_LOWER = 2; // оценка не меньше сохраненной
+const int TT_EXACT = 3;
+
+struct tt_data
+{
+    int score = 0;
+    int depth = 0;
+    int bound = 0;
+    uint16_t move = 0; // код лучшего хода (turn_code), 0 - нет
+};
+
+// таблица транспозиций без блокировок: запись - два 64-битных слова, ключ хранится как key ^ data,
+// поэтому запись, разорванная одновременной записью другого потока, не совпадет по ключу и будет пропущена
+class TranspositionTable
+{
+  public:
+    // deferred - память выделяется при первом поиске (reserve), а не сразу
+    explicit TranspositionTable(const size_t mb = 64, const bool deferred = false) : mb(mb)
+    {
+        if (!deferred)
+            resize(mb);
+    }
+
+    // выделить таблицу, если она еще не выделена
+    void reserve()
+    {
+        if (!count)
+            resize(mb);
+    }
+
+    // размер в мегабайтах (округляется вниз до степени двойки записей)
+    void resize(const size_t size_mb)
+    {
+        mb = size_mb;
+        size_t n = 1;
+        while (n * 2 * sizeof(entry) <= (mb << 20))
+            n *= 2;
+        count = n;
+        table.reset(new entry[count]);
+        clear();
+    }
+
+    void clear()
+    {
+        for (size_t k = 0; k < count; ++k)
+        {
+            table[k].key.store(0, std::memory_order_relaxed);
+            table[k].data.store(0, std::memory_order_relaxed);
+        }
+        age = 0;
+    }
+
+    // новый поиск: записи прошлых поисков вытесняются в первую очередь
+    void new_search()
+    {
+        age = (age.load() + 1) & 0xFF;
+    }
+
+    bool probe(const uint64_t key, tt_data &out) const
+    {
+        const entry &e = table[key & (count - 1)];
+        const uint64_t data = e.data.load(std::memory_order_relaxed);
+        if ((e.key.load(std::memory_order_relaxed) ^ data) != key || !data)
+            return false;
+        out.score = int(data & 0xFFFF) - 32768;
+        out.depth = int((data >> 16) & 0xFF);
+        out.bound = int((data >> 24) & 3);
+        out.move = uint16_t(data >> 34);
+        return true;
+    }
+
+    void store(const uint64_t key, const int score, const int depth, const int bound, uint16_t move)
+    {
+        entry &e = table[key & (count - 1)];
+        const uint64_t old = e.data.load(std::memory_order_relaxed);
+        const bool same = (e.key.load(std::memory_order_relaxed) ^ old) == key;
+        // глубокие записи текущего поиска не вытесняются мелкими
+        const int cur = age.load(std::memory_order_relaxed);
+        if (!same && old && int((old >> 26) & 0xFF) == cur && int((old >> 16) & 0xFF) > depth)
+            return;
+        if (same && !move)
+            move = uint16_t(old >> 34);
+        const uint64_t data = uint64_t(score + 32768) | uint64_t(depth & 0xFF) << 16 | uint64_t(bound) << 24 |
+                              uint64_t(cur) << 26 | uint64_t(move) << 34;
+        e.data.store(data, std::memory_order_relaxed);
+        e.key.store(key ^ data, std::memory_order_relaxed);
+    }
+
+    // заполненность в тысячных по первым записям (для info hashfull)
+    int hashfull() const
+    {
+        const size_t n = count < 1000 ? count : 1000;
+        if (!n)
+            return 0;
+        const int cur = age.load(std::memory_order_relaxed);
+        size_t used = 0;
+        for (size_t k = 0; k < n; ++k)
+        {
+            const uint64_t data = table[k].data.load(std::memory_order_relaxed);
+            used += data && int((data >> 26) & 0xFF) == cur;
+        }
+        return int(used * 1000 / n);
+    }
+
+  private:
+    struct entry
+    {
+        std::atomic<uint64_t> key{0};
+        std::atomic<uint64_t> data{0};
+    };
+
+    std::unique_ptr<entry[]> table;
+    size_t count = 0;
+    size_t mb;
+    std::atomic<int> age{0};
+};
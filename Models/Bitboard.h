@@ -0,0 +1,140 @@
+﻿#pragma once
+#include <stdint.h>
+#include <vector>
+
+#include "Geometry.h"
+#include "Move.h"
+
+// упакованная позиция: по одной маске на тип фигуры, бит k - k-я тёмная клетка (N/2 на строку)
+template <int N> struct basic_bitboard_pos
+{
+    typedef typename board_geometry<N>::mask_t mask_t;
+
+    mask_t wm = 0; // пешки белых
+    mask_t bm = 0; // пешки черных
+    mask_t wk = 0; // дамки белых
+    mask_t bk = 0; // дамки черных
+};
+
+// позиция доски партии 8x8 (32 клетки)
+typedef basic_bitboard_pos<8> bitboard_pos;
+
+// номер тёмной клетки (i, j) в маске
+inline int square_index(const POS_T i, const POS_T j)
+{
+    return game_geometry::index(i, j);
+}
+
+// строка и столбец тёмной клетки по ее номеру
+inline POS_T square_row(const int sq)
+{
+    return POS_T(game_geometry::row(sq));
+}
+inline POS_T square_col(const int sq)
+{
+    return POS_T(game_geometry::col(sq));
+}
+
+// маска клеток строки row
+constexpr uint32_t row_mask(const int row)
+{
+    return uint32_t(0xF) << (4 * row);
+}
+
+// маска клеток, у которых установлен бит b в номере строки (для взвешенных сумм по строкам)
+constexpr uint32_t row_bit_mask(const int b)
+{
+    uint32_t res = 0;
+    for (int row = 0; row < 8; ++row)
+        if ((row >> b) & 1)
+            res |= row_mask(row);
+    return res;
+}
+
+// центральный квадрат 4x4 (строки и столбцы 2..5)
+constexpr uint32_t center_mask()
+{
+    uint32_t res = 0;
+    for (int sq = 0; sq < 32; ++sq)
+    {
+        const int i = sq / 4, j = (sq % 4) * 2 + 1 - (sq / 4) % 2;
+        if (i >= 2 && i <= 5 && j >= 2 && j <= 5)
+            res |= uint32_t(1) << sq;
+    }
+    return res;
+}
+
+// число установленных битов без зависимости от набора инструкций
+inline int popcount32(uint32_t x)
+{
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    x = (x + (x >> 4)) & 0x0F0F0F0Fu;
+    return int((x * 0x01010101u) >> 24);
+}
+
+inline int popcount64(const uint64_t x)
+{
+    return popcount32(uint32_t(x)) + popcount32(uint32_t(x >> 32));
+}
+
+// номер младшего установленного бита (x != 0)
+inline int lowest_bit(const uint32_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(x);
+#else
+    return popcount32((x & (0u - x)) - 1);
+#endif
+}
+inline int lowest_bit(const uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    return popcount64((x & (0ull - x)) - 1);
+#endif
+}
+
+// упаковка матрицы доски N x N в маски
+template <int N = 8> inline basic_bitboard_pos<N> pack_board(const std::vector<std::vector<POS_T>> &mtx)
+{
+    typedef board_geometry<N> geometry;
+    basic_bitboard_pos<N> res;
+    for (int sq = 0; sq < geometry::squares; ++sq)
+    {
+        const typename geometry::mask_t bit = geometry::bit(sq);
+        switch (mtx[geometry::row(sq)][geometry::col(sq)])
+        {
+        case 1:
+            res.wm |= bit;
+            break;
+        case 2:
+            res.bm |= bit;
+            break;
+        case 3:
+            res.wk |= bit;
+            break;
+        case 4:
+            res.bk |= bit;
+            break;
+        }
+    }
+    return res;
+}
+
+// полный ход на масках: побитые фигуры снимаются все сразу (дамка может закончить серию на исходной клетке)
+inline bitboard_pos make_compound_move(bitboard_pos pos, const compound_move &turn)
+{
+    const uint32_t from = uint32_t(1) << square_index(turn.x, turn.y);
+    const uint32_t to = uint32_t(1) << square_index(turn.x2, turn.y2);
+    const bool white = (pos.wm | pos.wk) & from;
+    uint32_t &men = white ? pos.wm : pos.bm, &kings = white ? pos.wk : pos.bk;
+    const bool king = (kings & from) || turn.promotes;
+    men &= ~from;
+    kings &= ~from;
+    (king ? kings : men) |= to;
+    (white ? pos.bm : pos.wm) &= ~turn.captured;
+    (white ? pos.bk : pos.wk) &= ~turn.captured;
+    return pos;
+}
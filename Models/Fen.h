@@ -0,0 +1,123 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+
+#include "Bitboard.h"
+
+// позиции в нотации FEN из PDN: "W:W21,22,K30:B1,2,K5"
+// первая буква - чей ход, клетки нумеруются от 1 до 32 сверху вниз, слева направо, K - дамка
+
+// распаковка масок в матрицу доски N x N
+template <int N> inline std::vector<std::vector<POS_T>> unpack_board(const basic_bitboard_pos<N> &pos)
+{
+    typedef board_geometry<N> geometry;
+    std::vector<std::vector<POS_T>> mtx(N, std::vector<POS_T>(N, 0));
+    for (int sq = 0; sq < geometry::squares; ++sq)
+    {
+        const typename geometry::mask_t bit = geometry::bit(sq);
+        POS_T &cell = mtx[geometry::row(sq)][geometry::col(sq)];
+        if (pos.wm & bit)
+            cell = 1;
+        else if (pos.bm & bit)
+            cell = 2;
+        else if (pos.wk & bit)
+            cell = 3;
+        else if (pos.bk & bit)
+            cell = 4;
+    }
+    return mtx;
+}
+
+// алгебраическое имя клетки 0..31 ("c3"): буква - столбец, цифра - строка снизу (белые внизу)
+inline std::string square_name(const int sq)
+{
+    return std::string(1, char('a' + square_col(sq))) + char('0' + 8 - square_row(sq));
+}
+
+// разбор FEN, color - чей ход (0 - белые, 1 - черные); клетки номерами 1..32 или алгебраически (c3);
+// false при ошибке формата
+inline bool parse_fen(const std::string &fen, bitboard_pos &pos, bool &color)
+{
+    pos = bitboard_pos();
+    size_t p = 0;
+    while (p < fen.size() && (fen[p] == ' ' || fen[p] == '"'))
+        ++p;
+    if (p >= fen.size() || (fen[p] != 'W' && fen[p] != 'B'))
+        return false;
+    color = fen[p] == 'B';
+    ++p;
+    bool white = false, has_side = false;
+    while (p < fen.size() && fen[p] != '"' && fen[p] != ' ' && fen[p] != '\t' && fen[p] != '\r')
+    {
+        const char c = fen[p];
+        if (c == ':' || c == ',')
+        {
+            ++p;
+            if (c == ':' && p < fen.size() && (fen[p] == 'W' || fen[p] == 'B'))
+            {
+                white = fen[p] == 'W';
+                has_side = true;
+                ++p;
+            }
+            continue;
+        }
+        if (!has_side)
+            return false;
+        bool king = false;
+        if (c == 'K')
+        {
+            king = true;
+            ++p;
+        }
+        int num = 0;
+        if (p + 1 < fen.size() && fen[p] >= 'a' && fen[p] <= 'h' && fen[p + 1] >= '1' && fen[p + 1] <= '8')
+        {
+            const int i = 8 - (fen[p + 1] - '0'), j = fen[p] - 'a';
+            if ((i + j) % 2 == 0)
+                return false;
+            num = square_index(POS_T(i), POS_T(j)) + 1;
+            p += 2;
+        }
+        else
+        {
+            size_t digits = 0;
+            while (p < fen.size() && fen[p] >= '0' && fen[p] <= '9')
+            {
+                num = num * 10 + (fen[p++] - '0');
+                ++digits;
+            }
+            if (!digits || num < 1 || num > 32)
+                return false;
+        }
+        const uint32_t bit = uint32_t(1) << (num - 1);
+        if ((pos.wm | pos.bm | pos.wk | pos.bk) & bit)
+            return false;
+        (white ? (king ? pos.wk : pos.wm) : (king ? pos.bk : pos.bm)) |= bit;
+    }
+    return true;
+}
+
+// запись позиции в FEN; algebraic - клетки алгебраически (как в PDN русских шашек)
+inline std::string to_fen(const bitboard_pos &pos, const bool color, const bool algebraic = false)
+{
+    std::string res(1, color ? 'B' : 'W');
+    for (int side = 0; side < 2; ++side)
+    {
+        const uint32_t men = side ? pos.bm : pos.wm, kings = side ? pos.bk : pos.wk;
+        res += side ? ":B" : ":W";
+        bool first = true;
+        for (int sq = 0; sq < 32; ++sq)
+        {
+            const uint32_t bit = uint32_t(1) << sq;
+            if (!((men | kings) & bit))
+                continue;
+            if (!first)
+                res += ',';
+            first = false;
+            if (kings & bit)
+                res += 'K';
+            res += algebraic ? square_name(sq) : std::to_string(sq + 1);
+        }
+    }
+    return res;
+}
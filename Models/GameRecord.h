@@ -0,0 +1,66 @@
+﻿#pragma once
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Bitboard.h"
+#include "Move.h"
+
+// записанная партия: начальная позиция и ходы, каждый ход - серия перемещений одной шашкой
+struct game_record
+{
+    bitboard_pos start;
+    bool start_color = 0;      // чей первый ход (0 - белые)
+    bool custom_start = false; // партия начата не с начальной расстановки
+    std::vector<std::vector<move_pos>> turns;
+    int result = -1; // -1 - не закончена, 0 - ничья, 1 - победа белых, 2 - победа черных
+    std::map<std::string, std::string> tags;
+};
+
+// начальная расстановка: черные на строках 0..N/2-2, белые на строках N/2+1..N-1 (0-2 и 5-7 на 8x8)
+template <int N = 8> inline basic_bitboard_pos<N> start_position()
+{
+    typedef board_geometry<N> geometry;
+    basic_bitboard_pos<N> pos;
+    for (int r = 0; r < N / 2 - 1; ++r)
+    {
+        pos.bm |= geometry::row_mask(r);
+        pos.wm |= geometry::row_mask(N - 1 - r);
+    }
+    return pos;
+}
+
+// выполнение одного перемещения на матрице (как Logic::make_turn)
+inline void apply_hop(std::vector<std::vector<POS_T>> &mtx, const move_pos &turn)
+{
+    if (turn.xb != -1)
+        mtx[turn.xb][turn.yb] = 0;
+    const POS_T type = mtx[turn.x][turn.y];
+    if ((type == 1 && turn.x2 == game_geometry::promotion_row(0)) ||
+        (type == 2 && turn.x2 == game_geometry::promotion_row(1)))
+        mtx[turn.x][turn.y] += 2;
+    mtx[turn.x2][turn.y2] = mtx[turn.x][turn.y];
+    mtx[turn.x][turn.y] = 0;
+}
+
+// перемещение с клетки from на клетку to (номера 0..31) с поиском побитой шашки на диагонали;
+// x == -1, если перемещение невозможно в позиции mtx
+inline move_pos make_hop(const std::vector<std::vector<POS_T>> &mtx, const int from, const int to)
+{
+    const POS_T x = square_row(from), y = square_col(from), x2 = square_row(to), y2 = square_col(to);
+    const int dx = x2 - x, dy = y2 - y;
+    if (!mtx[x][y] || mtx[x2][y2] || dx == 0 || (dx != dy && dx != -dy))
+        return move_pos(-1, -1, -1, -1);
+    const int sx = dx > 0 ? 1 : -1, sy = dy > 0 ? 1 : -1;
+    POS_T xb = -1, yb = -1;
+    for (POS_T i = POS_T(x + sx), j = POS_T(y + sy); i != x2; i = POS_T(i + sx), j = POS_T(j + sy))
+    {
+        if (!mtx[i][j])
+            continue;
+        if (xb != -1 || mtx[i][j] % 2 == mtx[x][y] % 2)
+            return move_pos(-1, -1, -1, -1);
+        xb = i;
+        yb = j;
+    }
+    return move_pos(x, y, x2, y2, xb, yb);
+}
@@ -0,0 +1,92 @@
+﻿#pragma once
+#include <stdint.h>
+#include <type_traits>
+
+// геометрия доски N x N на этапе компиляции: тёмные клетки нумеруются сверху вниз, слева направо (N/2 на строку),
+// клетка (i, j) тёмная при нечетной i + j; маска фигур - uint32_t для 8x8 и uint64_t для 10x10
+
+// направления по диагоналям: 0 - вверх-влево, 1 - вверх-вправо, 2 - вниз-влево, 3 - вниз-вправо
+const int DIR_UP_LEFT = 0;
+const int DIR_UP_RIGHT = 1;
+const int DIR_DOWN_LEFT = 2;
+const int DIR_DOWN_RIGHT = 3;
+
+template <int N> struct board_geometry
+{
+    static_assert(N >= 4 && N % 2 == 0 && N * N / 2 <= 64, "board must be even and fit into 64 squares");
+
+    static constexpr int size = N;
+    static constexpr int per_row = N / 2;
+    static constexpr int squares = N * N / 2;
+    typedef typename std::conditional<(squares <= 32), uint32_t, uint64_t>::type mask_t;
+
+    // номер тёмной клетки (i, j)
+    static constexpr int index(const int i, const int j)
+    {
+        return i * per_row + j / 2;
+    }
+    static constexpr int row(const int sq)
+    {
+        return sq / per_row;
+    }
+    static constexpr int col(const int sq)
+    {
+        return (sq % per_row) * 2 + 1 - (sq / per_row) % 2;
+    }
+    static constexpr bool on_board(const int i, const int j)
+    {
+        return i >= 0 && i < N && j >= 0 && j < N;
+    }
+
+    static constexpr mask_t bit(const int sq)
+    {
+        return mask_t(1) << sq;
+    }
+    // все клетки доски
+    static constexpr mask_t all_mask()
+    {
+        return mask_t(~mask_t(0)) >> (8 * sizeof(mask_t) - squares);
+    }
+    static constexpr mask_t row_mask(const int r)
+    {
+        return mask_t(mask_t(~mask_t(0)) >> (8 * sizeof(mask_t) - per_row)) << (r * per_row);
+    }
+    // строка превращения для цвета (0 - белые превращаются на строке 0)
+    static constexpr int promotion_row(const bool color)
+    {
+        return color ? N - 1 : 0;
+    }
+
+    // соседние клетки по диагоналям, -1 за краем доски
+    struct step_table
+    {
+        int8_t to[4][squares];
+
+        constexpr step_table() : to()
+        {
+            const int di[4] = {-1, -1, 1, 1}, dj[4] = {-1, 1, -1, 1};
+            for (int d = 0; d < 4; ++d)
+            {
+                for (int sq = 0; sq < squares; ++sq)
+                {
+                    const int i = row(sq) + di[d], j = col(sq) + dj[d];
+                    to[d][sq] = int8_t(on_board(i, j) ? index(i, j) : -1);
+                }
+            }
+        }
+    };
+
+    static constexpr int step(const int dir, const int sq)
+    {
+        return steps.to[dir][sq];
+    }
+
+    static const step_table steps;
+};
+
+template <int N> constexpr typename board_geometry<N>::step_table board_geometry<N>::steps{};
+
+// доска партии в окне, Logic и всех форматов записи (PDN, FEN, корпус)
+typedef board_geometry<8> game_geometry;
+// доска международных шашек 10x10
+typedef board_geometry<10> international_geometry;
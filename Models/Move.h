@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include <stdint.h>
 #include <stdlib.h>
 
 typedef int8_t POS_T;
@@ -28,3 +29,19 @@ struct move_pos
         return !(*this == other);
     }
 };
+
+// полный ход одним перемещением: вся серия взятий задается начальной и конечной клетками,
+// маской побитых клеток (номера 0..31) и превращением в дамку на любом шаге серии
+struct compound_move
+{
+    POS_T x = -1, y = -1;   // from
+    POS_T x2 = -1, y2 = -1; // to
+    uint32_t captured = 0;
+    bool promotes = false;
+
+    bool operator==(const compound_move &other) const
+    {
+        return x == other.x && y == other.y && x2 == other.x2 && y2 == other.y2 && captured == other.captured &&
+               promotes == other.promotes;
+    }
+};
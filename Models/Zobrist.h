@@ -0,0 +1,77 @@
+﻿#pragma once
+#include <stdint.h>
+
+#include "Bitboard.h"
+
+// ключи Zobrist: по одному на фигуру каждого типа на каждой клетке и ключ хода черных
+inline const uint64_t *zobrist_keys()
+{
+    static const struct table
+    {
+        uint64_t keys[4 * 32 + 1];
+        table()
+        {
+            // splitmix64 с фиксированным началом, ключи одинаковы при каждом запуске
+            uint64_t s = 0;
+            for (uint64_t &k : keys)
+            {
+                uint64_t z = (s += 0x9E3779B97F4A7C15ull);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                k = z ^ (z >> 31);
+            }
+        }
+    } t;
+    return t.keys;
+}
+
+// хеш позиции с учетом того, чей ход (color: 0 - белые, 1 - черные)
+inline uint64_t position_hash(const bitboard_pos &pos, const bool color)
+{
+    const uint64_t *keys = zobrist_keys();
+    const uint32_t masks[4] = {pos.wm, pos.bm, pos.wk, pos.bk};
+    uint64_t h = color ? keys[4 * 32] : 0;
+    for (int t = 0; t < 4; ++t)
+    {
+        for (uint32_t m = masks[t]; m; m &= m - 1)
+            h ^= keys[t * 32 + lowest_bit(m)];
+    }
+    return h;
+}
+
+// порядок клеток в маске наоборот: клетка sq переходит в 31 - sq (поворот доски на 180 градусов)
+inline uint32_t reverse_squares(uint32_t m)
+{
+    m = ((m >> 1) & 0x55555555u) | ((m & 0x55555555u) << 1);
+    m = ((m >> 2) & 0x33333333u) | ((m & 0x33333333u) << 2);
+    m = ((m >> 4) & 0x0F0F0F0Fu) | ((m & 0x0F0F0F0Fu) << 4);
+    m = ((m >> 8) & 0x00FF00FFu) | ((m & 0x00FF00FFu) << 8);
+    return (m >> 16) | (m << 16);
+}
+
+// та же позиция для другой стороны: доска повернута, белые и черные поменялись местами
+// (шашки 1 <-> 2, дамки 3 <-> 4); с ходом другой стороны она играется точно так же
+inline bitboard_pos flip_colors(const bitboard_pos &pos)
+{
+    bitboard_pos res;
+    res.wm = reverse_squares(pos.bm);
+    res.bm = reverse_squares(pos.wm);
+    res.wk = reverse_squares(pos.bk);
+    res.bk = reverse_squares(pos.wk);
+    return res;
+}
+
+// канонический ключ: позиция приводится к ходу белых (при ходе черных берется отражение flip_colors), так что
+// позиция и ее отражение с ходом другой стороны попадают в одну запись таблицы; flipped - ключ взят от отражения
+// (сохраненные в записи ходы надо отражать)
+inline uint64_t canonical_hash(const bitboard_pos &pos, const bool color, bool &flipped)
+{
+    flipped = color;
+    return position_hash(color ? flip_colors(pos) : pos, 0);
+}
+
+inline uint64_t canonical_hash(const bitboard_pos &pos, const bool color)
+{
+    bool flipped;
+    return canonical_hash(pos, color, flipped);
+}
@@ -0,0 +1,223 @@
+﻿// Пакетный анализ позиций на пуле потоков без окна: по строке на позицию из файла или stdin,
+// "<FEN> [depth D] [movetime MS] [nodes N]" (лимиты строки заменяют лимиты по умолчанию, прочие слова пропускаются).
+// Результат - строки JSON в порядке завершения:
+//   {"id":N,"fen":"...","bestmove":"22-18","score":S,"depth":D,"nodes":N,"time_ms":T,"pv":["22-18",...]}
+// Запуск: analyze [positions.txt|-] [-t threads] [-depth D] [-movetime MS] [-nodes N] [-hash MB] [-o out.jsonl]
+//                 [-rules russian|english|brazilian|pool]
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Game/Pdn.h"
+#include "../Game/Rules.h"
+#include "../Game/Search.h"
+#include "../Models/Fen.h"
+
+using namespace std;
+
+struct analysis_task
+{
+    int64_t id;
+    string line;
+};
+
+// очередь строк с ограниченным размером: чтение не опережает анализ больше чем на capacity позиций
+class task_queue
+{
+  public:
+    explicit task_queue(const size_t capacity) : capacity(capacity)
+    {
+    }
+
+    void push(analysis_task task)
+    {
+        unique_lock<mutex> lock(m);
+        not_full.wait(lock, [&] { return tasks.size() < capacity; });
+        tasks.push_back(move(task));
+        not_empty.notify_one();
+    }
+
+    // false - очередь закрыта и пуста
+    bool pop(analysis_task &task)
+    {
+        unique_lock<mutex> lock(m);
+        not_empty.wait(lock, [&] { return !tasks.empty() || closed; });
+        if (tasks.empty())
+            return false;
+        task = move(tasks.front());
+        tasks.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        lock_guard<mutex> lock(m);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+  private:
+    size_t capacity;
+    deque<analysis_task> tasks;
+    bool closed = false;
+    mutex m;
+    condition_variable not_empty, not_full;
+};
+
+struct analysis_options
+{
+    int threads = 0;
+    search_limits limits;
+    size_t hash_mb = 16;
+    string rules = russian_rules::name();
+};
+
+// разбор строки; false - строка не содержит позиции
+static bool parse_task(const string &line, const search_limits &defaults, bitboard_pos &pos, bool &color,
+                       search_limits &limits, string &fen)
+{
+    istringstream in(line);
+    if (!(in >> fen) || fen[0] == '#' || !parse_fen(fen, pos, color))
+        return false;
+    limits = defaults;
+    string token;
+    while (in >> token)
+    {
+        int64_t value;
+        if (token == "depth" && in >> value)
+            limits.depth = int(value);
+        else if (token == "movetime" && in >> value)
+            limits.move_time_ms = int(value);
+        else if (token == "nodes" && in >> value)
+            limits.nodes = value;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    analysis_options opt;
+    opt.limits.depth = 8;
+    // первый аргумент - файл позиций ("-" или без аргументов - stdin)
+    string in_path = argc > 1 && argv[1][0] != '-' ? argv[1] : "-", out_path;
+    for (int i = in_path == "-" && (argc < 2 || string(argv[1]) != "-") ? 1 : 2; i + 1 < argc; i += 2)
+    {
+        const string key = argv[i], value = argv[i + 1];
+        if (key == "-t")
+            opt.threads = stoi(value);
+        else if (key == "-depth")
+            opt.limits.depth = stoi(value);
+        else if (key == "-movetime")
+            opt.limits.move_time_ms = stoi(value);
+        else if (key == "-nodes")
+            opt.limits.nodes = stoll(value);
+        else if (key == "-hash")
+            opt.hash_mb = size_t(max(1, stoi(value)));
+        else if (key == "-o")
+            out_path = value;
+        else if (key == "-rules")
+            opt.rules = value;
+    }
+    if (!with_rules(opt.rules, [](auto) {}))
+    {
+        cerr << "unknown rules " << opt.rules << "\n";
+        return 1;
+    }
+    if (opt.threads <= 0)
+        opt.threads = max(1, int(thread::hardware_concurrency()));
+
+    ifstream fin;
+    if (in_path != "-")
+    {
+        fin.open(in_path);
+        if (!fin)
+        {
+            cerr << "can't open " << in_path << "\n";
+            return 1;
+        }
+    }
+    istream &in = in_path == "-" ? cin : fin;
+    ofstream fout;
+    if (!out_path.empty())
+        fout.open(out_path);
+    ostream &out = out_path.empty() ? cout : fout;
+
+    Config config;
+    task_queue queue(size_t(opt.threads) * 64);
+    mutex out_mutex;
+    atomic<int64_t> done{0}, total_nodes{0}, bad{0};
+    const auto start = chrono::steady_clock::now();
+
+    // каждый поток держит свой поиск и свою таблицу, позиции независимы; поиск собран под выбранные правила
+    auto worker = [&](auto rules) {
+        TranspositionTable tt(opt.hash_mb);
+        BasicSearch<decltype(rules)> search(&config, &tt);
+        analysis_task task;
+        while (queue.pop(task))
+        {
+            bitboard_pos pos;
+            bool color;
+            search_limits limits;
+            string fen;
+            if (!parse_task(task.line, opt.limits, pos, color, limits, fen))
+            {
+                if (!fen.empty() && fen[0] != '#')
+                    bad++;
+                continue;
+            }
+            const auto best = search.go(pos, color, limits);
+            const search_info &info = search.last;
+            json res;
+            res["id"] = task.id;
+            res["fen"] = fen;
+            res["bestmove"] = best.empty() ? string() : Pdn::move_string(best);
+            res["score"] = info.score;
+            res["depth"] = info.depth;
+            res["nodes"] = search.node_count();
+            res["time_ms"] = info.time_ms;
+            json pv = json::array();
+            for (const auto &turn : info.pv)
+                pv.push_back(Pdn::move_string(turn));
+            res["pv"] = pv;
+            const string text = res.dump();
+            {
+                lock_guard<mutex> lock(out_mutex);
+                out << text << "\n";
+            }
+            total_nodes += search.node_count();
+            done++;
+        }
+    };
+    vector<thread> pool;
+    for (int t = 0; t < opt.threads; ++t)
+        pool.emplace_back([&]() { with_rules(opt.rules, worker); });
+
+    string line;
+    int64_t id = 0;
+    while (getline(in, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+        queue.push({id++, line});
+    }
+    queue.close();
+    for (auto &th : pool)
+        th.join();
+    out.flush();
+
+    const double sec = max(1e-3, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    cerr << done << " positions (" << bad << " bad lines) in " << sec << " s, " << int64_t(double(done) / sec)
+         << " positions/s, " << int64_t(double(total_nodes) / sec) << " nodes/s, threads " << opt.threads << "\n";
+    return 0;
+}
@@ -0,0 +1,154 @@
+﻿// Сборка атласа текстур для встраивания в игру: PNG из Textures/ декодируются, уменьшаются до размеров
+// отрисовки и записываются в заголовок массивами пикселей ARGB со сжатием повторов (RLE).
+// Board.h подключает Textures/Atlas.h, если он есть, и тогда не читает картинки с диска.
+// Запуск: atlas [Textures/] [Textures/Atlas.h]
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __APPLE__
+    #include <SDL2/SDL.h>
+    #include <SDL2/SDL_image.h>
+#else
+    #include <SDL.h>
+    #include <SDL_image.h>
+#endif
+
+using namespace std;
+
+// спрайт атласа: файл и место в атласе
+struct sprite
+{
+    const char *file;
+    int x, y, w, h;
+};
+
+// основной атлас загружается при старте одной текстурой: доска и под ней ряд шашек и кнопок
+// (порядок как в atlas_sprite из Board.h)
+static const sprite main_sprites[] = {
+    {"board.png", 0, 0, 1024, 1024},        {"piece_white.png", 0, 1024, 128, 128},
+    {"piece_black.png", 128, 1024, 128, 128}, {"queen_white.png", 256, 1024, 128, 128},
+    {"queen_black.png", 384, 1024, 128, 128}, {"back.png", 512, 1024, 128, 128},
+    {"replay.png", 640, 1024, 128, 128},
+};
+
+// картинки результата, по номеру результата партии (0 - ничья, 1 - белые, 2 - черные); загружаются
+// при первом показе
+static const sprite result_sprites[] = {
+    {"draw.png", 0, 0, 750, 450},
+    {"white_wins.png", 0, 450, 750, 450},
+    {"black_wins.png", 0, 900, 750, 450},
+};
+
+// уменьшение усреднением по области; цвет усредняется с весом прозрачности, чтобы края не темнели
+static void downscale(const SDL_Surface *src, vector<uint32_t> &atlas, const int atlas_w, const sprite &s)
+{
+    const uint32_t *pixels = static_cast<const uint32_t *>(src->pixels);
+    const int pitch = src->pitch / 4;
+    for (int y = 0; y < s.h; ++y)
+    {
+        const int y0 = y * src->h / s.h, y1 = max(y0 + 1, (y + 1) * src->h / s.h);
+        for (int x = 0; x < s.w; ++x)
+        {
+            const int x0 = x * src->w / s.w, x1 = max(x0 + 1, (x + 1) * src->w / s.w);
+            uint64_t a = 0, r = 0, g = 0, b = 0;
+            for (int i = y0; i < y1; ++i)
+            {
+                for (int j = x0; j < x1; ++j)
+                {
+                    const uint32_t p = pixels[i * pitch + j];
+                    const uint32_t pa = p >> 24;
+                    a += pa;
+                    r += pa * ((p >> 16) & 255);
+                    g += pa * ((p >> 8) & 255);
+                    b += pa * (p & 255);
+                }
+            }
+            const uint64_t n = uint64_t(y1 - y0) * uint64_t(x1 - x0);
+            uint32_t out = 0;
+            if (a)
+                out = uint32_t((a + n / 2) / n) << 24 | uint32_t((r + a / 2) / a) << 16 |
+                      uint32_t((g + a / 2) / a) << 8 | uint32_t((b + a / 2) / a);
+            atlas[size_t(s.y + y) * atlas_w + s.x + x] = out;
+        }
+    }
+}
+
+// атлас из спрайтов в заголовок: размер, прямоугольники и пиксели парами (число повторов, пиксель)
+static bool write_atlas(ofstream &fout, const string &dir, const string &name, const sprite *sprites,
+                        const size_t count)
+{
+    int w = 0, h = 0;
+    for (size_t k = 0; k < count; ++k)
+    {
+        w = max(w, sprites[k].x + sprites[k].w);
+        h = max(h, sprites[k].y + sprites[k].h);
+    }
+    vector<uint32_t> atlas(size_t(w) * h, 0);
+    for (size_t k = 0; k < count; ++k)
+    {
+        const string path = dir + sprites[k].file;
+        SDL_Surface *loaded = IMG_Load(path.c_str());
+        if (!loaded)
+        {
+            cout << "can't load " << path << ": " << IMG_GetError() << "\n";
+            return false;
+        }
+        SDL_Surface *argb = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_FreeSurface(loaded);
+        if (!argb)
+        {
+            cout << "can't convert " << path << ": " << SDL_GetError() << "\n";
+            return false;
+        }
+        SDL_LockSurface(argb);
+        downscale(argb, atlas, w, sprites[k]);
+        SDL_UnlockSurface(argb);
+        SDL_FreeSurface(argb);
+    }
+    fout << "static const int atlas_" << name << "_size[2] = {" << w << ", " << h << "};\n";
+    fout << "static const int atlas_" << name << "_rects[" << count << "][4] = {\n";
+    for (size_t k = 0; k < count; ++k)
+        fout << "    {" << sprites[k].x << ", " << sprites[k].y << ", " << sprites[k].w << ", " << sprites[k].h
+             << "}, // " << sprites[k].file << "\n";
+    fout << "};\n";
+    fout << "static const uint32_t atlas_" << name << "_rle[] = {";
+    size_t pairs = 0;
+    for (size_t p = 0; p < atlas.size();)
+    {
+        size_t run = 1;
+        while (p + run < atlas.size() && atlas[p + run] == atlas[p])
+            ++run;
+        fout << (pairs % 6 ? " " : "\n    ") << run << "u, 0x" << hex << atlas[p] << dec << "u,";
+        ++pairs;
+        p += run;
+    }
+    fout << "\n};\n";
+    cout << name << ": " << w << "x" << h << ", " << pairs << " runs (" << pairs * 8 / 1024 << " KB, raw "
+         << atlas.size() * 4 / 1024 << " KB)\n";
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const string dir = argc > 1 ? argv[1] : "Textures/";
+    const string out_path = argc > 2 ? argv[2] : dir + "Atlas.h";
+    ofstream fout(out_path, ios_base::trunc);
+    if (!fout)
+    {
+        cout << "can't open " << out_path << "\n";
+        return 1;
+    }
+    fout << "// сгенерировано Tools/atlas.cpp из " << dir << "*.png, не редактировать\n";
+    fout << "#pragma once\n#include <stdint.h>\n\n";
+    if (!write_atlas(fout, dir, "main", main_sprites, sizeof(main_sprites) / sizeof(main_sprites[0])) ||
+        !write_atlas(fout, dir, "result", result_sprites, sizeof(result_sprites) / sizeof(result_sprites[0])))
+    {
+        fout.close();
+        remove(out_path.c_str());
+        return 1;
+    }
+    return 0;
+}
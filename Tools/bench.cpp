@@ -0,0 +1,366 @@
+﻿// Бенчмарк оценки позиций: число оценок в секунду для calc_score (Eval) и NNUE,
+// плюс проверка совпадения путей вычисления (AVX2 и скалярный, инкрементальный и полный, квантованный и float).
+// Генератор ходов на масках (Movegen) сверяется с Logic::find_full_turns, perft замеряется для досок 8x8 и 10x10
+// и для вариантов правил (Rules.h). С -selective ms сравнивается глубина, до которой AlphaBeta с O1 и O2 успевает
+// досчитать за ms на позицию.
+// Запуск: bench [-n positions] [-nnue nnue.bin] [-write-default nnue.bin] [-perft depth] [-selective ms]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../Game/Eval.h"
+#include "../Game/Logic.h"
+#include "../Game/Movegen.h"
+#include "../Game/Nnue.h"
+#include "../Models/Fen.h"
+#include "../Models/GameRecord.h"
+
+using namespace std;
+
+// случайная позиция: до 12 фигур каждого цвета, пешки не стоят на строке превращения
+static bitboard_pos random_position(mt19937 &rng)
+{
+    bitboard_pos pos;
+    uint32_t used = 0;
+    for (int side = 0; side < 2; ++side)
+    {
+        const int cnt = 1 + int(rng() % 12);
+        for (int k = 0; k < cnt; ++k)
+        {
+            const int sq = int(rng() % 32);
+            const uint32_t bit = uint32_t(1) << sq;
+            if (used & bit)
+                continue;
+            const bool king = rng() % 6 == 0;
+            if (!king && sq / 4 == (side ? 7 : 0))
+                continue;
+            used |= bit;
+            (side ? (king ? pos.bk : pos.bm) : (king ? pos.wk : pos.wm)) |= bit;
+        }
+    }
+    return pos;
+}
+
+// случайный тихий ход фигуры на соседнюю свободную клетку (для проверки обновлений), или -1
+static move_pos random_step(const vector<vector<POS_T>> &mtx, mt19937 &rng)
+{
+    for (int attempt = 0; attempt < 64; ++attempt)
+    {
+        const POS_T x = POS_T(rng() % 8), y = POS_T(rng() % 8);
+        if (!mtx[x][y])
+            continue;
+        const POS_T x2 = POS_T(x + (rng() % 2 ? 1 : -1)), y2 = POS_T(y + (rng() % 2 ? 1 : -1));
+        if (x2 < 0 || x2 > 7 || y2 < 0 || y2 > 7 || mtx[x2][y2])
+            continue;
+        return move_pos(x, y, x2, y2);
+    }
+    return move_pos(-1, -1, -1, -1);
+}
+
+// ход в виде строки с побитыми клетками для сравнения наборов ходов
+static string turn_key(const vector<move_pos> &turn)
+{
+    string res;
+    for (const auto &mv : turn)
+        res += to_string(square_index(mv.x, mv.y)) + ">" + to_string(square_index(mv.x2, mv.y2)) + "x" +
+               to_string(mv.xb == -1 ? -1 : square_index(mv.xb, mv.yb)) + " ";
+    return res;
+}
+
+static vector<string> turn_keys(const vector<vector<move_pos>> &turns)
+{
+    vector<string> res;
+    for (const auto &turn : turns)
+        res.push_back(turn_key(turn));
+    sort(res.begin(), res.end());
+    return res;
+}
+
+// perft через генератор Logic на матрицах (для сравнения скорости)
+static uint64_t logic_perft(Logic &logic, const vector<vector<POS_T>> &mtx, const bool color, const int depth)
+{
+    const auto turns = logic.find_full_turns(mtx, color);
+    if (depth <= 1)
+        return depth == 1 ? turns.size() : 1;
+    uint64_t res = 0;
+    for (const auto &turn : turns)
+    {
+        auto child = mtx;
+        for (const auto &mv : turn)
+            child = logic.make_turn(child, mv);
+        res += logic_perft(logic, child, !color, depth - 1);
+    }
+    return res;
+}
+
+// позиции из случайных партий от начальной расстановки (каждая четвертая)
+static vector<pair<vector<vector<POS_T>>, bool>> game_positions(Logic &logic, mt19937 &rng, const size_t count)
+{
+    vector<pair<vector<vector<POS_T>>, bool>> res;
+    while (res.size() < count)
+    {
+        auto mtx = unpack_board(start_position<8>());
+        bool color = 0;
+        for (int ply = 0; ply < 80 && res.size() < count; ++ply)
+        {
+            const auto turns = logic.find_full_turns(mtx, color);
+            if (turns.empty())
+                break;
+            if (ply % 4 == 3)
+                res.emplace_back(mtx, color);
+            for (const auto &mv : turns[rng() % turns.size()])
+                mtx = logic.make_turn(mtx, mv);
+            color = !color;
+        }
+    }
+    return res;
+}
+
+// итеративное углубление AlphaBeta на уровне optimization: средняя глубина, досчитанная за ms на позицию,
+// лучшие ходы последней досчитанной глубины
+static double reached_depth(Config &config, const string &optimization,
+                            const vector<pair<vector<vector<POS_T>>, bool>> &positions, const int ms,
+                            vector<vector<move_pos>> &best)
+{
+    config.set("Bot", "Optimization", optimization);
+    config.set("Bot", "NoRandom", true);
+    Logic logic(&config);
+    double total = 0;
+    best.assign(positions.size(), {});
+    for (size_t k = 0; k < positions.size(); ++k)
+    {
+        const auto start = chrono::steady_clock::now();
+        int done = 0;
+        for (int depth = 1; depth <= 30; ++depth)
+        {
+            logic.Max_depth = depth;
+            auto line = logic.find_best_turns(positions[k].first, positions[k].second);
+            if (chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() > ms)
+                break;
+            done = depth;
+            best[k] = line;
+        }
+        total += done;
+    }
+    return total / double(positions.size());
+}
+
+template <class F> static double measure(const char *name, const size_t n, F &&f)
+{
+    auto start = chrono::steady_clock::now();
+    volatile double sink = f();
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    (void)sink;
+    cout << name << ": " << (int64_t)(double(n) / sec) << " evals/s\n";
+    return sec;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = 1000000;
+    int perft_depth = 6, selective_ms = 0;
+    string nnue_path, default_path;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const string key = argv[i], value = argv[i + 1];
+        if (key == "-n")
+            n = stoul(value);
+        else if (key == "-nnue")
+            nnue_path = value;
+        else if (key == "-write-default")
+            default_path = value;
+        else if (key == "-perft")
+            perft_depth = stoi(value);
+        else if (key == "-selective")
+            selective_ms = stoi(value);
+    }
+    Nnue nnue;
+    if (!default_path.empty())
+    {
+        cout << (nnue.save(default_path) ? "default network written to " : "can't write ") << default_path << "\n";
+        return 0;
+    }
+    if (!nnue_path.empty() && !nnue.load(nnue_path))
+        cout << "can't load " << nnue_path << ", using material network\n";
+    Eval eval(Eval::weights_for("NumberAndPotential"));
+    cout << "AVX2: " << (Eval::has_avx2() ? "yes" : "no") << "\n";
+
+    mt19937 rng(42);
+    vector<bitboard_pos> pos(n);
+    vector<vector<vector<POS_T>>> boards;
+    vector<move_pos> steps;
+    for (size_t k = 0; k < n; ++k)
+        pos[k] = random_position(rng);
+    const size_t nb = min(n, size_t(100000));
+    for (size_t k = 0; k < nb; ++k)
+    {
+        boards.push_back(unpack_board(pos[k]));
+        steps.push_back(random_step(boards.back(), rng));
+    }
+
+    // проверки совпадения
+    vector<eval_features> fa(n);
+    Eval::features_batch(pos.data(), n, fa.data());
+    vector<double> batch_scores(n);
+    eval.score_batch(pos.data(), n, true, batch_scores.data());
+    size_t eval_mismatch = 0, nnue_mismatch = 0, simd_mismatch = 0;
+    double max_float_diff = 0;
+    for (size_t k = 0; k < n; ++k)
+    {
+        const double single = eval.score(pos[k], true);
+        eval_mismatch += eval.score(fa[k], true) != single || batch_scores[k] != single;
+        const nnue_accumulator acc = nnue.refresh(pos[k]);
+        simd_mismatch += Nnue::forward_scalar(nnue, acc) != Nnue::forward_avx2(nnue, acc);
+        if (k < nb)
+            max_float_diff = max(max_float_diff, fabs(Nnue::to_logit(nnue.forward(acc)) - nnue.forward_float(pos[k])));
+    }
+    for (size_t k = 0; k < nb; ++k)
+    {
+        if (steps[k].x == -1)
+            continue;
+        nnue_accumulator acc = nnue.refresh(pos[k]);
+        nnue.apply_move(acc, boards[k], steps[k]);
+        auto child = boards[k];
+        child[steps[k].x2][steps[k].y2] = child[steps[k].x][steps[k].y];
+        child[steps[k].x][steps[k].y] = 0;
+        if ((child[steps[k].x2][steps[k].y2] == 1 && steps[k].x2 == 0) ||
+            (child[steps[k].x2][steps[k].y2] == 2 && steps[k].x2 == 7))
+            child[steps[k].x2][steps[k].y2] += 2;
+        const nnue_accumulator full = nnue.refresh(pack_board(child));
+        nnue_mismatch += !equal(acc.v, acc.v + NNUE_HIDDEN1, full.v) || acc.white != full.white ||
+                         acc.black != full.black;
+    }
+    cout << "eval batch/scalar mismatches: " << eval_mismatch << "\n";
+    cout << "nnue avx2/scalar mismatches: " << simd_mismatch << "\n";
+    cout << "nnue incremental/refresh mismatches: " << nnue_mismatch << "\n";
+    cout << "nnue quantized vs float max logit diff: " << max_float_diff << "\n";
+
+    // генератор на масках против Logic: одинаковые наборы полных ходов и позиции после них
+    Config config;
+    Logic logic(&config);
+    size_t movegen_mismatch = 0;
+    vector<vector<move_pos>> turns;
+    for (size_t k = 0; k < nb; ++k)
+    {
+        for (int color = 0; color < 2; ++color)
+        {
+            const auto expected = logic.find_full_turns(boards[k], color);
+            Movegen<8>::full_turns(pos[k], color, turns);
+            bool same = turn_keys(expected) == turn_keys(turns);
+            for (size_t t = 0; same && t < turns.size(); ++t)
+            {
+                auto child = boards[k];
+                for (const auto &mv : turns[t])
+                    child = logic.make_turn(child, mv);
+                const bitboard_pos a = pack_board(child), b = Movegen<8>::make_turn(pos[k], turns[t]);
+                same = a.wm == b.wm && a.bm == b.bm && a.wk == b.wk && a.bk == b.bk;
+            }
+            movegen_mismatch += !same;
+        }
+    }
+    cout << "movegen/Logic mismatches: " << movegen_mismatch << "\n";
+
+    // скорость
+    measure("calc_score (pack + Eval::score)", nb, [&]() {
+        double s = 0;
+        for (size_t k = 0; k < nb; ++k)
+            s += eval.score(pack_board(boards[k]), true);
+        return s;
+    });
+    measure("Eval::score on bitboards", n, [&]() {
+        double s = 0;
+        for (size_t k = 0; k < n; ++k)
+            s += eval.score(pos[k], true);
+        return s;
+    });
+    vector<double> out(n);
+    measure("Eval::score_batch", n, [&]() {
+        eval.score_batch(pos.data(), n, true, out.data());
+        return out[n / 2];
+    });
+    measure("NNUE refresh + forward", n, [&]() {
+        double s = 0;
+        for (size_t k = 0; k < n; ++k)
+            s += nnue.score(nnue.refresh(pos[k]), true);
+        return s;
+    });
+    vector<nnue_accumulator> parents(nb);
+    for (size_t k = 0; k < nb; ++k)
+        parents[k] = nnue.refresh(pos[k]);
+    measure("NNUE incremental update + forward", nb, [&]() {
+        double s = 0;
+        for (size_t k = 0; k < nb; ++k)
+        {
+            if (steps[k].x == -1)
+                continue;
+            nnue_accumulator acc = parents[k];
+            nnue.apply_move(acc, boards[k], steps[k]);
+            s += nnue.score(acc, true);
+        }
+        return s;
+    });
+    measure("NNUE forward scalar", n, [&]() {
+        int64_t s = 0;
+        for (size_t k = 0; k < n; ++k)
+            s += Nnue::forward_scalar(nnue, parents[k % nb]);
+        return double(s);
+    });
+    measure("NNUE forward AVX2", n, [&]() {
+        int64_t s = 0;
+        for (size_t k = 0; k < n; ++k)
+            s += Nnue::forward_avx2(nnue, parents[k % nb]);
+        return double(s);
+    });
+    measure("NNUE float reference", nb, [&]() {
+        double s = 0;
+        for (size_t k = 0; k < nb; ++k)
+            s += nnue.forward_float(pos[k]);
+        return s;
+    });
+
+    // perft из начальной позиции: генератор на масках для обеих досок и Logic для 8x8
+    auto timed_perft = [](const char *name, const int depth, auto &&f) {
+        const auto start = chrono::steady_clock::now();
+        const uint64_t cnt = f();
+        const double sec = max(1e-9, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        cout << name << " perft(" << depth << ") = " << cnt << ", " << int64_t(double(cnt) / sec) << " leaves/s\n";
+        return cnt;
+    };
+    const uint64_t fast = timed_perft("Movegen<8>", perft_depth,
+                                      [&]() { return Movegen<8>::perft(start_position<8>(), 0, perft_depth); });
+    const uint64_t ref = timed_perft("Logic 8x8", perft_depth, [&]() {
+        return logic_perft(logic, unpack_board(start_position<8>()), 0, perft_depth);
+    });
+    timed_perft("Movegen<10>", perft_depth - 1,
+                [&]() { return Movegen<10>::perft(start_position<10>(), 0, perft_depth - 1); });
+    // варианты правил на 8x8 и международные шашки
+    timed_perft("english", perft_depth,
+                [&]() { return Movegen<8, english_rules>::perft(start_position<8>(), 0, perft_depth); });
+    timed_perft("brazilian", perft_depth,
+                [&]() { return Movegen<8, brazilian_rules>::perft(start_position<8>(), 0, perft_depth); });
+    timed_perft("pool", perft_depth,
+                [&]() { return Movegen<8, pool_rules>::perft(start_position<8>(), 0, perft_depth); });
+    timed_perft("international 10x10", perft_depth - 1, [&]() {
+        return Movegen<10, international_rules>::perft(start_position<10>(), 0, perft_depth - 1);
+    });
+    movegen_mismatch += fast != ref;
+
+    // выборочный поиск O2 против O1 при одинаковом времени
+    if (selective_ms > 0)
+    {
+        const auto positions = game_positions(logic, rng, 100);
+        vector<vector<move_pos>> best1, best2;
+        const double d1 = reached_depth(config, "O1", positions, selective_ms, best1);
+        const double d2 = reached_depth(config, "O2", positions, selective_ms, best2);
+        size_t same = 0;
+        for (size_t k = 0; k < positions.size(); ++k)
+            same += !best1[k].empty() && !best2[k].empty() && best1[k].front() == best2[k].front();
+        cout << "AlphaBeta depth in " << selective_ms << " ms: O1 " << d1 << ", O2 " << d2 << " (same move "
+             << same << "/" << positions.size() << ")\n";
+    }
+    return eval_mismatch || simd_mismatch || nnue_mismatch || movegen_mismatch ? 1 : 0;
+}
@@ -0,0 +1,304 @@
+﻿// Преобразование партий между PDN и бинарным корпусом (Game/Corpus.h) и статистика корпуса.
+// Запуск: corpus pdn2bin games.pdn games.ckg
+//         corpus bin2pdn games.ckg games.pdn
+//         corpus stats games.ckg
+//         corpus positions games.ckg corpus.txt
+//         corpus index games.ckg games.idx
+//         corpus find games.idx FEN
+//         corpus moves games.idx FEN
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../Game/Corpus.h"
+#include "../Game/Movegen.h"
+#include "../Game/Pdn.h"
+#include "../Game/PositionIndex.h"
+#include "../Models/Fen.h"
+#include "../Models/Zobrist.h"
+
+using namespace std;
+
+static int pdn_to_bin(const string &in_path, const string &out_path)
+{
+    ifstream fin(in_path);
+    if (!fin)
+    {
+        cout << "can't open " << in_path << "\n";
+        return 1;
+    }
+    CorpusWriter corpus;
+    if (!corpus.open(out_path))
+    {
+        cout << "can't open " << out_path << "\n";
+        return 1;
+    }
+    game_record game;
+    string error;
+    size_t games = 0, bad = 0;
+    while (Pdn::read(fin, game, error))
+    {
+        if (!error.empty())
+        {
+            // партия записывается до первого ошибочного хода
+            ++bad;
+            cout << "game " << games + 1 << ": " << error << "\n";
+        }
+        corpus.add(game);
+        ++games;
+    }
+    cout << games << " games written (" << bad << " with errors), corpus size " << corpus.size() << "\n";
+    return 0;
+}
+
+static int bin_to_pdn(const string &in_path, const string &out_path)
+{
+    CorpusReader corpus;
+    if (!corpus.open(in_path))
+    {
+        cout << "can't open " << in_path << "\n";
+        return 1;
+    }
+    ofstream fout(out_path);
+    game_record game;
+    size_t bad = 0;
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        if (!corpus.get(i, game))
+            ++bad;
+        game.tags["Round"] = to_string(i + 1);
+        Pdn::write(fout, game);
+    }
+    cout << corpus.size() << " games written (" << bad << " with errors)\n";
+    return 0;
+}
+
+// позиции партии перед каждым ходом и после последнего: f(pos, color)
+template <class F> static void for_each_position(const game_record &game, F f)
+{
+    auto mtx = unpack_board(game.start);
+    bool color = game.start_color;
+    f(game.start, color);
+    for (const auto &turn : game.turns)
+    {
+        for (const auto &hop : turn)
+            apply_hop(mtx, hop);
+        color = !color;
+        f(pack_board(mtx), color);
+    }
+}
+
+static int stats(const string &path)
+{
+    CorpusReader corpus;
+    if (!corpus.open(path))
+    {
+        cout << "can't open " << path << "\n";
+        return 1;
+    }
+    size_t results[4] = {0, 0, 0, 0}, plies = 0, hops = 0, bad = 0, positions = 0;
+    // различные позиции: точно и с точностью до отражения с переставленными цветами
+    unordered_set<uint64_t> exact, canonical;
+    auto start = chrono::steady_clock::now();
+    game_record game;
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        if (!corpus.get(i, game))
+            ++bad;
+        ++results[game.result == -1 ? 3 : game.result];
+        plies += game.turns.size();
+        for (const auto &turn : game.turns)
+            hops += turn.size();
+        for_each_position(game, [&](const bitboard_pos &pos, const bool color) {
+            ++positions;
+            exact.insert(position_hash(pos, color));
+            canonical.insert(canonical_hash(pos, color));
+        });
+    }
+    const double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "games: " << corpus.size() << " (white " << results[1] << ", black " << results[2] << ", draw "
+         << results[0] << ", unfinished " << results[3] << ", errors " << bad << ")\n";
+    cout << "plies: " << plies << ", moves: " << hops << "\n";
+    cout << "positions: " << positions << ", unique " << exact.size() << ", unique up to color flip "
+         << canonical.size() << "\n";
+    if (sec > 0)
+        cout << "decode: " << (int64_t)(double(plies) / sec) << " plies/s\n";
+    return 0;
+}
+
+// корпус для tuner: "<FEN> <result>" для каждой позиции законченных партий; позиция и ее отражение
+// с переставленными цветами записываются один раз (в виде первого вхождения) со средним результатом
+// всех партий, где она встречалась (1 - победа белых, 0.5 - ничья, 0 - победа черных)
+static int positions(const string &in_path, const string &out_path)
+{
+    CorpusReader corpus;
+    if (!corpus.open(in_path))
+    {
+        cout << "can't open " << in_path << "\n";
+        return 1;
+    }
+    ofstream fout(out_path);
+    if (!fout)
+    {
+        cout << "can't open " << out_path << "\n";
+        return 1;
+    }
+    // результат для белых по game.result (0 - ничья, 1 - белые, 2 - черные)
+    static const double white_score[3] = {0.5, 1.0, 0.0};
+    struct labeled
+    {
+        bitboard_pos pos;
+        bool color;
+        double sum; // сумма результатов для белых позиции pos
+        uint32_t count;
+    };
+    unordered_map<uint64_t, size_t> seen;
+    vector<labeled> labels;
+    size_t total = 0;
+    game_record game;
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        if (!corpus.get(i, game) || game.result == -1)
+            continue;
+        for_each_position(game, [&](const bitboard_pos &pos, const bool color) {
+            ++total;
+            const uint64_t key = canonical_hash(pos, color);
+            const auto it = seen.emplace(key, labels.size());
+            if (it.second)
+                labels.push_back({pos, color, 0.0, 0});
+            labeled &l = labels[it.first->second];
+            // отражение с переставленными цветами: победа белых в нем - победа черных в записанной позиции
+            const double score = white_score[game.result];
+            l.sum += l.color == color ? score : 1 - score;
+            ++l.count;
+        });
+    }
+    for (const labeled &l : labels)
+        fout << to_fen(l.pos, l.color) << " " << l.sum / l.count << "\n";
+    cout << labels.size() << " of " << total << " positions written\n";
+    return 0;
+}
+
+// дописать в индекс позиций новые партии корпуса и дождаться слияния сегментов
+static int build_index(const string &corpus_path, const string &index_path)
+{
+    CorpusReader corpus;
+    if (!corpus.open(corpus_path))
+    {
+        cout << "can't open " << corpus_path << "\n";
+        return 1;
+    }
+    PositionIndex index;
+    if (!index.open(index_path))
+    {
+        cout << "can't open " << index_path << " (delete it to rebuild)\n";
+        return 1;
+    }
+    auto start = chrono::steady_clock::now();
+    const size_t added = index.update(corpus);
+    index.wait();
+    const double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << added << " games indexed in " << sec << " s, " << index.indexed_games() << " games in "
+         << index.segment_count() << " segments\n";
+    return 0;
+}
+
+static bool open_index(PositionIndex &index, const string &index_path, const string &fen, bitboard_pos &pos,
+                       bool &color)
+{
+    if (!parse_fen(fen, pos, color))
+    {
+        cout << "bad FEN " << fen << "\n";
+        return false;
+    }
+    if (!index.open(index_path) || !index.indexed_games())
+    {
+        cout << "can't open " << index_path << "\n";
+        return false;
+    }
+    return true;
+}
+
+// партии, прошедшие через позицию: номер партии, номер хода, результат
+static int find_position(const string &index_path, const string &fen)
+{
+    PositionIndex index;
+    bitboard_pos pos;
+    bool color;
+    if (!open_index(index, index_path, fen, pos, color))
+        return 1;
+    auto start = chrono::steady_clock::now();
+    const auto entries = index.find(pos, color);
+    const double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    const size_t shown = min(entries.size(), size_t(50));
+    for (size_t k = 0; k < shown; ++k)
+    {
+        cout << "game " << entries[k].game + 1 << " ply " << entries[k].ply() << " "
+             << Pdn::result_string(entries[k].result()) << "\n";
+    }
+    if (shown < entries.size())
+        cout << "...\n";
+    cout << entries.size() << " occurrences in " << ms << " ms\n";
+    return 0;
+}
+
+// результаты партий по ходам из позиции
+static int position_moves(const string &index_path, const string &fen)
+{
+    PositionIndex index;
+    bitboard_pos pos;
+    bool color;
+    if (!open_index(index, index_path, fen, pos, color))
+        return 1;
+    auto start = chrono::steady_clock::now();
+    const auto stats = index.move_stats(pos, color);
+    const double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    vector<vector<move_pos>> turns;
+    Movegen<8>::full_turns(pos, color, turns);
+    uint64_t total = 0;
+    for (const auto &s : stats)
+    {
+        string name = "(end)";
+        if (s.has_move)
+        {
+            name = "?";
+            for (const auto &turn : turns)
+            {
+                if (position_move_code(turn) == s.move)
+                    name = Pdn::move_string(turn);
+            }
+        }
+        cout << name << ": " << s.games << " games, white " << s.results[1] << ", black " << s.results[2]
+             << ", draw " << s.results[0] << ", unfinished " << s.results[3] << "\n";
+        total += s.games;
+    }
+    cout << total << " games in " << ms << " ms\n";
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const string cmd = argc > 1 ? argv[1] : "";
+    if (cmd == "pdn2bin" && argc > 3)
+        return pdn_to_bin(argv[2], argv[3]);
+    if (cmd == "bin2pdn" && argc > 3)
+        return bin_to_pdn(argv[2], argv[3]);
+    if (cmd == "stats" && argc > 2)
+        return stats(argv[2]);
+    if (cmd == "positions" && argc > 3)
+        return positions(argv[2], argv[3]);
+    if (cmd == "index" && argc > 3)
+        return build_index(argv[2], argv[3]);
+    if (cmd == "find" && argc > 3)
+        return find_position(argv[2], argv[3]);
+    if (cmd == "moves" && argc > 3)
+        return position_moves(argv[2], argv[3]);
+    cout << "usage: corpus pdn2bin games.pdn games.ckg | bin2pdn games.ckg games.pdn | stats games.ckg | "
+            "positions games.ckg corpus.txt | index games.ckg games.idx | find games.idx FEN | "
+            "moves games.idx FEN\n";
+    return 1;
+}
@@ -0,0 +1,337 @@
+﻿// Текстовый протокол движка в стиле UCI через stdin/stdout (без окна SDL).
+// Команды:
+//   uci, isready, ucinewgame, setoption name Hash value <MB>, quit
+//   position startpos|fen <FEN> [moves 22-18 11-15 ...] - позиция и история ходов
+//   go [depth D] [nodes N] [movetime MS] [wtime MS] [btime MS] [winc MS] [binc MS] [movestogo N] [infinite] [ponder]
+//   solve [movetime MS] [nodes N] [threads T] - доказательство выигрыша или проигрыша решателем df-pn
+//   stop, ponderhit, d (вывести позицию)
+// Ответы: info depth D score cp S|win N nodes N nps N time MS hashfull H pv ..., bestmove <ход> [ponder <ход>]
+//         info solve win|loss|unknown nodes N proven P disproven D time MS pv ... (после solve)
+// Ходы записываются номерами клеток PDN: "22-18", "11x18x25". Таблица транспозиций сохраняется между командами.
+// При непустом Game/TraceFile в settings.json пишется трасса поиска в формате Chrome trace events.
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Game/Dfpn.h"
+#include "../Game/Pdn.h"
+#include "../Game/Search.h"
+#include "../Game/Trace.h"
+#include "../Models/Fen.h"
+#include "../Models/GameRecord.h"
+
+using namespace std;
+
+// вывод из потока поиска и основного потока не перемешивается
+static mutex out_mutex;
+
+static void send(const string &line)
+{
+    lock_guard<mutex> lock(out_mutex);
+    cout << line << endl;
+}
+
+static string score_string(const int score)
+{
+    if (abs(score) >= SEARCH_WIN_BOUND)
+    {
+        // число своих ходов до выигрыша (отрицательное - до проигрыша)
+        const int plies = SEARCH_WIN - abs(score);
+        return "win " + to_string(score > 0 ? (plies + 1) / 2 : -(plies + 1) / 2);
+    }
+    return "cp " + to_string(score);
+}
+
+class Engine
+{
+  public:
+    Engine() : tt(64), search(&config, &tt), solver_table(64), solver(&config, &solver_table)
+    {
+        pos = start_position();
+        // трасса поиска (итерации, ходы корня) по настройкам Game/TraceFile, файл пишется при выходе
+        Tracer::instance().start(project_path + string(config("Game", "TraceFile")), config("Game", "TraceSampleRate"));
+    }
+
+    ~Engine()
+    {
+        stop();
+    }
+
+    // разбор одной команды; false - выход
+    bool command(const string &line)
+    {
+        istringstream in(line);
+        string cmd;
+        in >> cmd;
+        if (cmd == "uci")
+        {
+            send("id name Checkers");
+            send("option name Hash type spin default 64 min 1 max 4096");
+            send("uciok");
+        }
+        else if (cmd == "isready")
+            send("readyok");
+        else if (cmd == "ucinewgame")
+        {
+            stop();
+            search.clear();
+        }
+        else if (cmd == "setoption")
+            set_option(in);
+        else if (cmd == "position")
+        {
+            stop();
+            set_position(in);
+        }
+        else if (cmd == "go")
+        {
+            stop();
+            go(in);
+        }
+        else if (cmd == "solve")
+        {
+            stop();
+            solve(in);
+        }
+        else if (cmd == "stop")
+            stop();
+        else if (cmd == "ponderhit")
+        {
+            // продолжаем тот же поиск, но уже со временем на ход (без ограничений - сразу отвечаем)
+            if (ponder_unbounded)
+                search.stop();
+            else
+            {
+                // время ставится после того, как go применил свои лимиты, иначе они бы его перекрыли
+                while (worker.joinable() && worker_is_search && search.started_searches() == ponder_search)
+                    this_thread::sleep_for(chrono::milliseconds(1));
+                search.set_move_time(ponder_time);
+                search.set_soft_time(ponder_soft_time);
+            }
+            hold = false;
+        }
+        else if (cmd == "d")
+            send(to_fen(pos, color));
+        else if (cmd == "quit")
+            return false;
+        else if (!cmd.empty())
+            send("info string unknown command " + cmd);
+        return true;
+    }
+
+  private:
+    void set_option(istringstream &in)
+    {
+        string token, name, value;
+        in >> token >> name >> token >> value;
+        if (name == "Hash" && !value.empty())
+        {
+            stop();
+            tt.resize(max(1, stoi(value)));
+        }
+    }
+
+    void set_position(istringstream &in)
+    {
+        string token;
+        in >> token;
+        pos = start_position();
+        color = 0;
+        history.clear();
+        if (token == "fen")
+        {
+            string fen;
+            in >> fen;
+            if (!parse_fen(fen, pos, color))
+                send("info string bad fen " + fen);
+            in >> token;
+        }
+        else
+            in >> token;
+        if (token != "moves")
+            return;
+        auto mtx = unpack_board(pos);
+        Logic logic(&config);
+        history.clear();
+        history.push(pos, color);
+        while (in >> token)
+        {
+            // ход проверяется по списку допустимых полных ходов (обязательное взятие, продолжение серии)
+            auto next = mtx;
+            vector<move_pos> turn;
+            const auto legal = logic.find_full_turns(mtx, color);
+            if (!Pdn::parse_move(token, next, turn) || find(legal.begin(), legal.end(), turn) == legal.end())
+            {
+                send("info string illegal move " + token);
+                break;
+            }
+            mtx = next;
+            color = !color;
+            history.push(pack_board(mtx), color);
+        }
+        pos = pack_board(mtx);
+    }
+
+    void go(istringstream &in)
+    {
+        search_limits limits;
+        int time_left[2] = {0, 0}, inc[2] = {0, 0}, moves_to_go = 0;
+        bool infinite = false, ponder = false;
+        string token;
+        while (in >> token)
+        {
+            if (token == "infinite")
+                infinite = true;
+            else if (token == "ponder")
+                ponder = true;
+            else
+            {
+                int64_t value = 0;
+                in >> value;
+                if (token == "depth")
+                    limits.depth = int(value);
+                else if (token == "nodes")
+                    limits.nodes = value;
+                else if (token == "movetime")
+                    limits.move_time_ms = int(value);
+                else if (token == "wtime")
+                    time_left[0] = int(value);
+                else if (token == "btime")
+                    time_left[1] = int(value);
+                else if (token == "winc")
+                    inc[0] = int(value);
+                else if (token == "binc")
+                    inc[1] = int(value);
+                else if (token == "movestogo")
+                    moves_to_go = int(value);
+            }
+        }
+        // часы: время на ход по фазе партии (Timeman.h), поиск продлевает его при смене лучшего хода
+        if (!limits.move_time_ms && time_left[color])
+        {
+            vector<vector<move_pos>> turns;
+            Movegen<8>::full_turns(pos, color, turns);
+            const int pieces = popcount32(pos.wm | pos.bm | pos.wk | pos.bk);
+            const time_budget budget = allocate_time(time_left[color], inc[color], moves_to_go, pieces, int(turns.size()));
+            limits.move_time_ms = budget.hard_ms;
+            limits.soft_time_ms = budget.soft_ms;
+        }
+        // при обдумывании на время соперника время на ход (и жесткое, и рассчитанное) начинает идти только
+        // после ponderhit
+        ponder_time = limits.move_time_ms;
+        ponder_soft_time = limits.soft_time_ms;
+        ponder_unbounded = !ponder_time && !limits.nodes && limits.depth >= SEARCH_MAX_PLY - 1;
+        if (ponder)
+            limits.move_time_ms = limits.soft_time_ms = 0;
+        hold = infinite || ponder;
+
+        const bitboard_pos root = pos;
+        const bool side = color;
+        // история партии нужна поиску для правил ничьей
+        search.history = history;
+        if (search.history.empty())
+            search.history.push(pos, color);
+        // запрос остановки снимается до запуска потока: stop, пришедший сразу после go, не теряется
+        search.clear_stop();
+        ponder_search = search.started_searches();
+        worker_is_search = true;
+        worker = thread([this, root, side, limits]() {
+            const auto best = search.go(root, side, limits, [&](const search_info &info) {
+                const int nps = info.time_ms ? int(info.nodes * 1000 / info.time_ms) : 0;
+                string line = "info depth " + to_string(info.depth) + " score " + score_string(info.score) +
+                              " nodes " + to_string(info.nodes) + " nps " + to_string(nps) + " time " +
+                              to_string(info.time_ms) + " hashfull " + to_string(tt.hashfull()) + " pv";
+                for (const auto &turn : info.pv)
+                    line += " " + Pdn::move_string(turn);
+                send(line);
+            });
+            // в режиме infinite и ponder ответ отправляется только после stop или ponderhit
+            while (hold)
+                this_thread::sleep_for(chrono::milliseconds(1));
+            string line = "bestmove " + (best.empty() ? string("(none)") : Pdn::move_string(best));
+            if (search.last.pv.size() > 1 && search.last.pv[0] == best)
+                line += " ponder " + Pdn::move_string(search.last.pv[1]);
+            send(line);
+        });
+    }
+
+    // решатель в отдельном потоке, как и go: stop прерывает его
+    void solve(istringstream &in)
+    {
+        dfpn_limits limits;
+        int threads = 1;
+        string token;
+        int64_t value;
+        while (in >> token >> value)
+        {
+            if (token == "movetime")
+                limits.time_ms = int(value);
+            else if (token == "nodes")
+                limits.nodes = value;
+            else if (token == "threads")
+                threads = max(1, int(value));
+        }
+        const bitboard_pos root = pos;
+        const bool side = color;
+        solver.clear_stop();
+        worker_is_search = false;
+        worker = thread([this, root, side, limits, threads]() {
+            const dfpn_result res = solver.solve(root, side, history, limits, threads);
+            string line = "info solve " + string(res.outcome > 0 ? "win" : res.outcome < 0 ? "loss" : "unknown") +
+                          " nodes " + to_string(res.nodes) + " proven " + to_string(res.proven) + " disproven " +
+                          to_string(res.disproven) + " time " + to_string(res.time_ms) + " pv";
+            for (const auto &turn : res.line)
+                line += " " + Pdn::move_string(turn);
+            send(line);
+            send("bestmove " + (res.line.empty() ? string("(none)") : Pdn::move_string(res.line[0])));
+        });
+    }
+
+    // остановка поиска с ожиданием ответа bestmove
+    void stop()
+    {
+        if (!worker.joinable())
+            return;
+        search.stop();
+        solver.stop();
+        hold = false;
+        worker.join();
+    }
+
+    Config config;
+    TranspositionTable tt;
+    Search search;
+    DfpnTable solver_table;
+    Dfpn solver;
+    bitboard_pos pos;
+    bool color = 0;
+    HashHistory history;
+    thread worker;
+    atomic<bool> hold{false};
+    int ponder_time = 0;
+    int ponder_soft_time = 0;
+    // started_searches до запуска текущего go; worker_is_search - в worker идет go, а не solve
+    int64_t ponder_search = 0;
+    bool worker_is_search = false;
+    bool ponder_unbounded = false;
+};
+
+int main()
+{
+    ios::sync_with_stdio(false);
+    Engine engine;
+    string line;
+    while (getline(cin, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (!engine.command(line))
+            break;
+    }
+    return 0;
+}
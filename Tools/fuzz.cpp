@@ -0,0 +1,606 @@
+﻿// Дифференциальная проверка генераторов ходов: случайные партии играются по эталонным правилам (копия
+// Logic::find_turns и Logic::make_turn, снятая вместе с этой проверкой), и в каждой позиции с эталоном сверяются
+// Logic::find_full_turns, Logic::find_compound_turns, Logic::turn_path, Movegen<8> и обновления позиции:
+// make_turn на матрице и на масках, make_compound_move, инкрементальный аккумулятор NNUE и оценка Eval
+// (скалярно и пачкой) против исходной calc_score, до бита.
+// Найденное расхождение уменьшается (фигуры снимаются, дамки становятся шашками, пока расхождение остается)
+// и печатается позицией FEN с различающимися ходами; -fen проверяет одну позицию.
+// Запуск: fuzz [-seconds S] [-games N] [-t threads] [-seed X] [-random-start percent] [-fen FEN]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "../Game/Logic.h"
+#include "../Game/Movegen.h"
+#include "../Game/Nnue.h"
+#include "../Models/Fen.h"
+#include "../Models/GameRecord.h"
+
+using namespace std;
+
+typedef vector<vector<POS_T>> board_t;
+
+// эталонные правила: find_turns и make_turn из Logic без перемешивания ходов. Это намеренно копия,
+// а не вызов Logic: ускорения самого Logic проверяются этой же программой, поэтому здесь ничего не менять
+
+// ходы фигуры с клетки (x, y); true - есть взятия (тогда в turns только они)
+static bool ref_piece_turns(const board_t &mtx, const POS_T x, const POS_T y, vector<move_pos> &turns)
+{
+    turns.clear();
+    const POS_T type = mtx[x][y];
+    if (type == 1 || type == 2)
+    {
+        for (POS_T i = x - 2; i <= x + 2; i += 4)
+        {
+            for (POS_T j = y - 2; j <= y + 2; j += 4)
+            {
+                if (!game_geometry::on_board(i, j))
+                    continue;
+                const POS_T xb = (x + i) / 2, yb = (y + j) / 2;
+                if (mtx[i][j] || !mtx[xb][yb] || mtx[xb][yb] % 2 == type % 2)
+                    continue;
+                turns.emplace_back(x, y, i, j, xb, yb);
+            }
+        }
+    }
+    else
+    {
+        for (POS_T i = -1; i <= 1; i += 2)
+        {
+            for (POS_T j = -1; j <= 1; j += 2)
+            {
+                POS_T xb = -1, yb = -1;
+                for (POS_T i2 = x + i, j2 = y + j; game_geometry::on_board(i2, j2); i2 += i, j2 += j)
+                {
+                    if (mtx[i2][j2])
+                    {
+                        if (mtx[i2][j2] % 2 == type % 2 || xb != -1)
+                            break;
+                        xb = i2;
+                        yb = j2;
+                    }
+                    if (xb != -1 && xb != i2)
+                        turns.emplace_back(x, y, i2, j2, xb, yb);
+                }
+            }
+        }
+    }
+    if (!turns.empty())
+        return true;
+    if (type == 1 || type == 2)
+    {
+        const POS_T i = type % 2 ? x - 1 : x + 1;
+        for (POS_T j = y - 1; j <= y + 1; j += 2)
+        {
+            if (game_geometry::on_board(i, j) && !mtx[i][j])
+                turns.emplace_back(x, y, i, j);
+        }
+    }
+    else
+    {
+        for (POS_T i = -1; i <= 1; i += 2)
+        {
+            for (POS_T j = -1; j <= 1; j += 2)
+            {
+                for (POS_T i2 = x + i, j2 = y + j; game_geometry::on_board(i2, j2) && !mtx[i2][j2]; i2 += i, j2 += j)
+                    turns.emplace_back(x, y, i2, j2);
+            }
+        }
+    }
+    return false;
+}
+
+// ходы цвета color: если у какой-то фигуры есть взятия, то только взятия
+static bool ref_turns(const board_t &mtx, const bool color, vector<move_pos> &turns)
+{
+    turns.clear();
+    bool beats = false;
+    vector<move_pos> piece;
+    for (POS_T i = 0; i < game_geometry::size; ++i)
+    {
+        for (POS_T j = 0; j < game_geometry::size; ++j)
+        {
+            if (!mtx[i][j] || mtx[i][j] % 2 == color)
+                continue;
+            const bool piece_beats = ref_piece_turns(mtx, i, j, piece);
+            if (piece_beats && !beats)
+            {
+                beats = true;
+                turns.clear();
+            }
+            if (piece_beats || !beats)
+                turns.insert(turns.end(), piece.begin(), piece.end());
+        }
+    }
+    return beats;
+}
+
+static board_t ref_make_turn(board_t mtx, const move_pos &turn)
+{
+    if (turn.xb != -1)
+        mtx[turn.xb][turn.yb] = 0;
+    if ((mtx[turn.x][turn.y] == 1 && turn.x2 == game_geometry::promotion_row(0)) ||
+        (mtx[turn.x][turn.y] == 2 && turn.x2 == game_geometry::promotion_row(1)))
+        mtx[turn.x][turn.y] += 2;
+    mtx[turn.x2][turn.y2] = mtx[turn.x][turn.y];
+    mtx[turn.x][turn.y] = 0;
+    return mtx;
+}
+
+// полные ходы: серия взятий продолжается той же фигурой, пока у нее есть взятия
+static void ref_full_turns(const board_t &mtx, const bool color, const POS_T x, const POS_T y,
+                           vector<move_pos> &series, vector<vector<move_pos>> &res)
+{
+    vector<move_pos> turns;
+    const bool beats = x == -1 ? ref_turns(mtx, color, turns) : ref_piece_turns(mtx, x, y, turns);
+    if (x != -1 && !beats)
+    {
+        res.push_back(series);
+        return;
+    }
+    for (const auto &mv : turns)
+    {
+        series.push_back(mv);
+        if (beats)
+            ref_full_turns(ref_make_turn(mtx, mv), color, mv.x2, mv.y2, series, res);
+        else
+            res.push_back(series);
+        series.pop_back();
+    }
+}
+
+// эталонная оценка: calc_score из Logic до перехода на признаки Eval (копия по тем же причинам),
+// potential - режим NumberAndPotential
+static double ref_calc_score(const board_t &mtx, const bool first_bot_color, const bool potential)
+{
+    double w = 0, wq = 0, b = 0, bq = 0;
+    for (POS_T i = 0; i < 8; ++i)
+    {
+        for (POS_T j = 0; j < 8; ++j)
+        {
+            w += (mtx[i][j] == 1);
+            wq += (mtx[i][j] == 3);
+            b += (mtx[i][j] == 2);
+            bq += (mtx[i][j] == 4);
+            if (potential)
+            {
+                w += 0.05 * (mtx[i][j] == 1) * (7 - i);
+                b += 0.05 * (mtx[i][j] == 2) * (i);
+            }
+        }
+    }
+    if (!first_bot_color)
+    {
+        swap(b, w);
+        swap(bq, wq);
+    }
+    if (w + wq == 0)
+        return INF;
+    if (b + bq == 0)
+        return 0;
+    const int q_coef = potential ? 5 : 4;
+    return (b + bq * q_coef) / (w + wq * q_coef);
+}
+
+// полный ход для сравнения: ключ хода и позиция после него. Для серии ключ - перемещения
+// (откуда, куда, побитая клетка), для хода одним перемещением - откуда, куда, маска побитых, превращение
+struct turn_result
+{
+    vector<uint32_t> key;
+    bitboard_pos child;
+
+    bool operator<(const turn_result &other) const
+    {
+        return tie(key, child.wm, child.bm, child.wk, child.bk) <
+               tie(other.key, other.child.wm, other.child.bm, other.child.wk, other.child.bk);
+    }
+    bool operator==(const turn_result &other) const
+    {
+        return key == other.key && child.wm == other.child.wm && child.bm == other.child.bm &&
+               child.wk == other.child.wk && child.bk == other.child.bk;
+    }
+};
+
+static vector<uint32_t> series_key(const vector<move_pos> &series)
+{
+    vector<uint32_t> res;
+    for (const auto &mv : series)
+        res.push_back(uint32_t(square_index(mv.x, mv.y)) << 12 | uint32_t(square_index(mv.x2, mv.y2)) << 6 |
+                      uint32_t(mv.xb == -1 ? 0 : square_index(mv.xb, mv.yb) + 1));
+    return res;
+}
+
+static vector<uint32_t> compound_key(const compound_move &turn)
+{
+    return {uint32_t(square_index(turn.x, turn.y)), uint32_t(square_index(turn.x2, turn.y2)), turn.captured,
+            uint32_t(turn.promotes)};
+}
+
+// ключ в записи PDN: клетки 1..32, "x" между клетками серии взятий, для хода одним перемещением -
+// побитые клетки в скобках и K при превращении
+static string key_text(const vector<uint32_t> &key, const bool compound)
+{
+    string res;
+    if (compound)
+    {
+        res = to_string(key[0] + 1) + (key[2] ? "x" : "-") + to_string(key[1] + 1);
+        if (key[2])
+        {
+            res += " (";
+            for (uint32_t m = key[2]; m; m &= m - 1)
+                res += to_string(lowest_bit(m) + 1) + (m & (m - 1) ? "," : ")");
+        }
+        return res + (key[3] ? " K" : "");
+    }
+    for (size_t k = 0; k < key.size(); ++k)
+    {
+        if (!k)
+            res += to_string((key[k] >> 12) + 1);
+        res += ((key[k] & 63) ? "x" : "-") + to_string(((key[k] >> 6) & 63) + 1);
+    }
+    return res;
+}
+
+// проверяемая позиция и ответы эталона для нее
+struct fuzz_case
+{
+    bitboard_pos pos;
+    bool color = 0;
+    board_t mtx;
+    vector<vector<move_pos>> series;   // полные ходы эталона
+    vector<board_t> children;          // позиции после них
+    vector<turn_result> full;          // серии с позициями после них
+    vector<turn_result> compound;      // ходы одним перемещением (одинаковые серии - один ход)
+    vector<compound_move> compound_turns;
+
+    fuzz_case(const bitboard_pos &pos, const bool color) : pos(pos), color(color), mtx(unpack_board(pos))
+    {
+        vector<move_pos> path;
+        ref_full_turns(mtx, color, -1, -1, path, series);
+        for (const auto &s : series)
+        {
+            board_t child = mtx;
+            compound_move turn;
+            turn.x = s.front().x;
+            turn.y = s.front().y;
+            turn.x2 = s.back().x2;
+            turn.y2 = s.back().y2;
+            for (const auto &mv : s)
+            {
+                if (mv.xb != -1)
+                    turn.captured |= uint32_t(1) << square_index(mv.xb, mv.yb);
+                child = ref_make_turn(child, mv);
+            }
+            turn.promotes = child[turn.x2][turn.y2] != mtx[turn.x][turn.y];
+            children.push_back(child);
+            full.push_back({series_key(s), pack_board(child)});
+            if (find(compound_turns.begin(), compound_turns.end(), turn) == compound_turns.end())
+            {
+                compound_turns.push_back(turn);
+                compound.push_back({compound_key(turn), pack_board(child)});
+            }
+        }
+        sort(full.begin(), full.end());
+        sort(compound.begin(), compound.end());
+    }
+};
+
+// сравнение наборов ходов; при расхождении в details - ходы, которые есть только у одной стороны
+static bool same_turns(const vector<turn_result> &expected, vector<turn_result> actual, const bool compound,
+                       string *details)
+{
+    sort(actual.begin(), actual.end());
+    if (expected == actual)
+        return true;
+    if (details)
+    {
+        vector<turn_result> missing, extra;
+        set_difference(expected.begin(), expected.end(), actual.begin(), actual.end(), back_inserter(missing));
+        set_difference(actual.begin(), actual.end(), expected.begin(), expected.end(), back_inserter(extra));
+        for (const auto &t : missing)
+            *details += "  missing: " + key_text(t.key, compound) + " -> " + to_fen(t.child, 0).substr(2) + "\n";
+        for (const auto &t : extra)
+            *details += "  extra:   " + key_text(t.key, compound) + " -> " + to_fen(t.child, 0).substr(2) + "\n";
+    }
+    return false;
+}
+
+static bool same_accumulator(const nnue_accumulator &a, const nnue_accumulator &b)
+{
+    return equal(a.v, a.v + NNUE_HIDDEN1, b.v) && a.white == b.white && a.black == b.black;
+}
+
+// имя первой проверки, не совпавшей с эталоном, или пустая строка
+static string failed_check(Logic &logic, const Nnue &nnue, const fuzz_case &c, string *details = nullptr)
+{
+    vector<turn_result> actual;
+    for (const auto &s : logic.find_full_turns(c.mtx, c.color))
+    {
+        auto child = c.mtx;
+        for (const auto &mv : s)
+            child = logic.make_turn(child, mv);
+        actual.push_back({series_key(s), pack_board(child)});
+    }
+    if (!same_turns(c.full, actual, false, details))
+        return "Logic::find_full_turns";
+
+    actual.clear();
+    for (const auto &turn : logic.find_compound_turns(c.mtx, c.color))
+        actual.push_back({compound_key(turn), pack_board(logic.make_turn(c.mtx, turn))});
+    if (!same_turns(c.compound, actual, true, details))
+        return "Logic::find_compound_turns";
+
+    actual.clear();
+    for (const auto &turn : c.compound_turns)
+        actual.push_back({compound_key(turn), make_compound_move(c.pos, turn)});
+    if (!same_turns(c.compound, actual, true, details))
+        return "make_compound_move";
+
+    // серия, восстановленная по ходу одним перемещением, должна быть одной из серий эталона, дающих этот ход;
+    // turn_path перебирает все серии, поэтому проверяется только в позициях со взятиями
+    actual.clear();
+    const bool beats = !c.compound_turns.empty() && c.compound_turns.front().captured;
+    for (const auto &turn : beats ? c.compound_turns : vector<compound_move>())
+    {
+        const auto path = logic.turn_path(c.mtx, c.color, turn);
+        const auto it = find(c.series.begin(), c.series.end(), path);
+        const bool found = it != c.series.end() && series_key(*it) == series_key(path);
+        actual.push_back({compound_key(found ? logic.compound_of(c.mtx, path) : compound_move()),
+                          found ? pack_board(c.children[size_t(it - c.series.begin())]) : bitboard_pos()});
+    }
+    if (beats && !same_turns(c.compound, actual, true, details))
+        return "Logic::turn_path";
+
+    vector<vector<move_pos>> turns;
+    Movegen<8>::full_turns(c.pos, c.color, turns);
+    actual.clear();
+    for (const auto &s : turns)
+        actual.push_back({series_key(s), Movegen<8>::make_turn(c.pos, s)});
+    if (!same_turns(c.full, actual, false, details))
+        return "Movegen<8>";
+
+    // аккумулятор NNUE: обновления по перемещениям серии и одним ходом против пересчета позиции после хода
+    const nnue_accumulator root = nnue.refresh(c.pos);
+    for (size_t k = 0; k < c.series.size(); ++k)
+    {
+        nnue_accumulator acc = root;
+        auto mtx = c.mtx;
+        for (const auto &mv : c.series[k])
+        {
+            nnue.apply_move(acc, mtx, mv);
+            mtx = ref_make_turn(mtx, mv);
+        }
+        if (!same_accumulator(acc, nnue.refresh(pack_board(c.children[k]))))
+        {
+            if (details)
+                *details += "  after " + key_text(series_key(c.series[k]), false) + "\n";
+            return "Nnue::apply_move(move_pos)";
+        }
+    }
+    for (const auto &turn : c.compound_turns)
+    {
+        nnue_accumulator acc = root;
+        nnue.apply_move(acc, c.mtx, turn);
+        if (!same_accumulator(acc, nnue.refresh(make_compound_move(c.pos, turn))))
+        {
+            if (details)
+                *details += "  after " + key_text(compound_key(turn), true) + "\n";
+            return "Nnue::apply_move(compound_move)";
+        }
+    }
+
+    // оценка позиции и детей: по одной и пачкой (не меньше 8 позиций, чтобы работала ветка AVX2)
+    vector<bitboard_pos> leaves(1, c.pos);
+    for (const auto &child : c.children)
+        leaves.push_back(pack_board(child));
+    while (leaves.size() < 8)
+        leaves.push_back(c.pos);
+    vector<double> batch(leaves.size());
+    for (const bool potential : {false, true})
+    {
+        const Eval eval(Eval::weights_for(potential ? "NumberAndPotential" : "NumberOnly"));
+        for (const bool side : {false, true})
+        {
+            eval.score_batch(leaves.data(), leaves.size(), side, batch.data());
+            for (size_t k = 0; k < leaves.size(); ++k)
+            {
+                const double expected = ref_calc_score(unpack_board(leaves[k]), side, potential);
+                if (eval.score(leaves[k], side) == expected && batch[k] == expected)
+                    continue;
+                if (details)
+                    *details += "  " + to_fen(leaves[k], k ? !c.color : c.color) + (potential ? " NumberAndPotential" : " NumberOnly") +
+                                " for " + (side ? "black" : "white") + "\n";
+                return "Eval::score";
+            }
+        }
+    }
+    return "";
+}
+
+// уменьшение позиции с расхождением: снимаем фигуры и превращаем дамки в шашки, пока та же проверка не сходится
+static bitboard_pos shrink(Logic &logic, const Nnue &nnue, bitboard_pos pos, const bool color, const string &check)
+{
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (int sq = 0; sq < 32; ++sq)
+        {
+            const uint32_t bit = uint32_t(1) << sq;
+            if (!((pos.wm | pos.bm | pos.wk | pos.bk) & bit))
+                continue;
+            bitboard_pos removed = pos;
+            removed.wm &= ~bit;
+            removed.bm &= ~bit;
+            removed.wk &= ~bit;
+            removed.bk &= ~bit;
+            vector<bitboard_pos> candidates = {removed};
+            // дамка становится шашкой, если шашка не окажется на строке своего превращения
+            if ((pos.wk & bit) && square_row(sq) != game_geometry::promotion_row(0))
+            {
+                candidates.push_back(removed);
+                candidates.back().wm |= bit;
+            }
+            if ((pos.bk & bit) && square_row(sq) != game_geometry::promotion_row(1))
+            {
+                candidates.push_back(removed);
+                candidates.back().bm |= bit;
+            }
+            for (const auto &next : candidates)
+            {
+                if (failed_check(logic, nnue, fuzz_case(next, color)) == check)
+                {
+                    pos = next;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+    return pos;
+}
+
+// случайная позиция: до 12 фигур каждого цвета, пешки не стоят на строке превращения
+static bitboard_pos random_position(mt19937 &rng)
+{
+    bitboard_pos pos;
+    uint32_t used = 0;
+    for (int side = 0; side < 2; ++side)
+    {
+        const int cnt = 1 + int(rng() % 12);
+        for (int k = 0; k < cnt; ++k)
+        {
+            const int sq = int(rng() % 32);
+            const uint32_t bit = uint32_t(1) << sq;
+            if (used & bit)
+                continue;
+            const bool king = rng() % 4 == 0;
+            if (!king && sq / 4 == (side ? 7 : 0))
+                continue;
+            used |= bit;
+            (side ? (king ? pos.bk : pos.bm) : (king ? pos.wk : pos.wm)) |= bit;
+        }
+    }
+    return pos;
+}
+
+// отчет о расхождении: исходная и уменьшенная позиции и различия в уменьшенной
+static void report(Logic &logic, const Nnue &nnue, const bitboard_pos &pos, const bool color, const string &check)
+{
+    const bitboard_pos small = shrink(logic, nnue, pos, color, check);
+    string details;
+    failed_check(logic, nnue, fuzz_case(small, color), &details);
+    cout << "mismatch in " << check << "\n  position: " << to_fen(pos, color) << "\n  shrunk:   " << to_fen(small, color)
+         << "\n" << details;
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = 60;
+    long long max_games = 0;
+    int threads = 0, random_start = 50;
+    unsigned seed = unsigned(time(0));
+    string fen;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const string key = argv[i], value = argv[i + 1];
+        if (key == "-seconds")
+            seconds = stod(value);
+        else if (key == "-games")
+            max_games = stoll(value);
+        else if (key == "-t")
+            threads = stoi(value);
+        else if (key == "-seed")
+            seed = unsigned(stoul(value));
+        else if (key == "-random-start")
+            random_start = stoi(value);
+        else if (key == "-fen")
+            fen = value;
+    }
+    if (threads <= 0)
+        threads = max(1, int(thread::hardware_concurrency()));
+    Config config;
+    const Nnue nnue;
+
+    if (!fen.empty())
+    {
+        bitboard_pos pos;
+        bool color;
+        if (!parse_fen(fen, pos, color))
+        {
+            cout << "bad FEN: " << fen << "\n";
+            return 2;
+        }
+        Logic logic(&config);
+        const string check = failed_check(logic, nnue, fuzz_case(pos, color));
+        if (check.empty())
+        {
+            cout << "ok: " << fuzz_case(pos, color).series.size() << " turns\n";
+            return 0;
+        }
+        report(logic, nnue, pos, color, check);
+        return 1;
+    }
+
+    // у каждого потока свой Logic (в нем буферы ходов) и свой генератор случайных чисел
+    vector<unique_ptr<Logic>> logics;
+    for (int t = 0; t < threads; ++t)
+        logics.push_back(make_unique<Logic>(&config));
+    atomic<long long> positions{0}, games{0};
+    atomic<bool> failed{false};
+    mutex out;
+    const auto start = chrono::steady_clock::now();
+    auto worker = [&](const int t) {
+        Logic &logic = *logics[size_t(t)];
+        mt19937 rng(seed + unsigned(t) * 7919u);
+        vector<move_pos> path;
+        while (!failed && (max_games ? games++ < max_games
+                                     : chrono::duration<double>(chrono::steady_clock::now() - start).count() < seconds))
+        {
+            if (!max_games)
+                ++games;
+            // партия от начальной расстановки или от случайной позиции с дамками
+            const bool random = int(rng() % 100) < random_start;
+            bitboard_pos pos = random ? random_position(rng) : start_position<8>();
+            bool color = random ? bool(rng() % 2) : 0;
+            long long count = 0;
+            for (int ply = 0; ply < 300 && !failed; ++ply)
+            {
+                const fuzz_case c(pos, color);
+                ++count;
+                const string check = failed_check(logic, nnue, c);
+                if (!check.empty())
+                {
+                    if (!failed.exchange(true))
+                    {
+                        lock_guard<mutex> lock(out);
+                        report(logic, nnue, pos, color, check);
+                    }
+                    break;
+                }
+                if (c.series.empty())
+                    break;
+                pos = pack_board(c.children[rng() % c.children.size()]);
+                color = !color;
+            }
+            positions += count;
+        }
+    };
+    vector<thread> pool;
+    for (int t = 0; t < threads; ++t)
+        pool.emplace_back(worker, t);
+    for (auto &th : pool)
+        th.join();
+    const double sec = max(1e-9, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    cout << (failed ? "failed" : "ok") << ": " << positions << " positions in "
+         << (max_games ? min(games.load(), max_games) : games.load()) << " games, "
+         << int64_t(double(positions) / sec * 60) << " positions/min, seed " << seed << "\n";
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,395 @@
+﻿// Турнир двух конфигураций движка A и B на пуле потоков: каждый дебют играется парой партий со сменой цветов,
+// результат - Эло A относительно B с 95% интервалом и досрочная остановка по SPRT (H0: elo <= elo0, H1: elo >= elo1).
+// Конфигурация - раздел Bot из settings.json с заменами key=value через запятую, BotLevel задает уровень обоим цветам:
+//   match -a Engine=Search,BotLevel=7 -b Engine=Search,BotLevel=6
+// Каждая партия играется новыми экземплярами движков (своя таблица транспозиций, история, дерево MCTS),
+// поэтому партии не влияют друг на друга. Дебюты - -random-plies случайных ходов или позиции FEN из файла -openings.
+// Запуск: match -a SPEC -b SPEC [-games N] [-t threads] [-openings file] [-random-plies R] [-seed S]
+//               [-elo0 E] [-elo1 E] [-alpha A] [-beta B] [-pdn games.pdn] [-report seconds]
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Game/History.h"
+#include "../Game/Logic.h"
+#include "../Game/Mcts.h"
+#include "../Game/Movegen.h"
+#include "../Game/Pdn.h"
+#include "../Game/Search.h"
+#include "../Game/Tt.h"
+#include "../Models/Fen.h"
+#include "../Models/GameRecord.h"
+
+using namespace std;
+
+struct match_options
+{
+    string spec[2];
+    int games = 1000;
+    int threads = 0;
+    string openings;
+    int random_plies = 6;
+    unsigned seed = unsigned(time(0));
+    double elo0 = 0, elo1 = 10;
+    double alpha = 0.05, beta = 0.05;
+    string pdn;
+    int report = 10;
+};
+
+// замены настроек Bot из строки "key=value,key=value"; числа и true/false записываются как числа и логические
+static bool apply_spec(Config &config, const string &spec)
+{
+    stringstream in(spec);
+    string item;
+    while (getline(in, item, ','))
+    {
+        const size_t eq = item.find('=');
+        if (eq == string::npos)
+            return false;
+        const string key = item.substr(0, eq), text = item.substr(eq + 1);
+        json value = text;
+        if (text == "true" || text == "false")
+            value = text == "true";
+        else if (!text.empty() && text.find_first_not_of("-.0123456789") == string::npos)
+            value = text.find('.') == string::npos ? json(stoi(text)) : json(stod(text));
+        if (key == "BotLevel")
+        {
+            config.set("Bot", "WhiteBotLevel", value);
+            config.set("Bot", "BlackBotLevel", value);
+        }
+        else
+            config.set("Bot", key, value);
+    }
+    return true;
+}
+
+// участник одной партии: движок по настройке Engine, как бот в Game::bot_turn
+class Player
+{
+  public:
+    explicit Player(const Config &base)
+        : config(base), logic(&config), mcts(&config), tt(size_t(int(config("Bot", "HashMB"))), true),
+          search(&config, &tt)
+    {
+        engine = string(config("Bot", "Engine"));
+    }
+
+    vector<move_pos> move(const bitboard_pos &pos, const bool color, const HashHistory &history)
+    {
+        const auto mtx = unpack_board(pos);
+        const int level = config("Bot", string(color ? "Black" : "White") + "BotLevel");
+        if (engine == "MCTS")
+            return mcts.find_best_turns(mtx, color, config("Bot", "MoveTimeMS"), history);
+        if (engine == "Search")
+        {
+            search.history = history;
+            search_limits limits;
+            limits.depth = level + 1;
+            limits.move_time_ms = config("Bot", "MoveTimeMS");
+            return search.go(pos, color, limits);
+        }
+        logic.history = history;
+        logic.Max_depth = level;
+        return logic.find_best_turns(mtx, color);
+    }
+
+  private:
+    Config config;
+    string engine;
+    Logic logic;
+    Mcts mcts;
+    TranspositionTable tt;
+    Search search;
+};
+
+// итоги турнира с точки зрения A; пары считаются пентаномиально: очки пары 0, 0.5, ..., 2
+struct match_stats
+{
+    int64_t wins = 0, draws = 0, losses = 0;
+    int64_t pairs[5] = {0, 0, 0, 0, 0};
+
+    int64_t pair_count() const
+    {
+        return pairs[0] + pairs[1] + pairs[2] + pairs[3] + pairs[4];
+    }
+
+    // средние очки пары (0..1) и их дисперсия
+    void score(double &mean, double &var) const
+    {
+        const double n = double(max<int64_t>(1, pair_count()));
+        mean = var = 0;
+        for (int k = 0; k < 5; ++k)
+            mean += pairs[k] * (k / 4.0) / n;
+        for (int k = 0; k < 5; ++k)
+            var += pairs[k] * (k / 4.0 - mean) * (k / 4.0 - mean) / n;
+    }
+};
+
+static double elo_from_score(const double s)
+{
+    const double c = min(1 - 1e-6, max(1e-6, s));
+    return -400 * log10(1 / c - 1);
+}
+
+static double score_from_elo(const double elo)
+{
+    return 1 / (1 + pow(10, -elo / 400));
+}
+
+// логарифм отношения правдоподобия H1 к H0 (обобщенный SPRT в нормальном приближении по парам)
+static double sprt_llr(const match_stats &st, const double elo0, const double elo1)
+{
+    double mean, var;
+    st.score(mean, var);
+    if (!st.pair_count())
+        return 0;
+    // одинаковые детерминированные движки дают все пары 1:1 и нулевую дисперсию; нижняя граница
+    // дисперсии позволяет и тогда принять H0, а для обычных матчей ничего не меняет
+    var = max(var, 0.01);
+    const double s0 = score_from_elo(elo0), s1 = score_from_elo(elo1);
+    return double(st.pair_count()) * (s1 - s0) * (2 * mean - s0 - s1) / (2 * var);
+}
+
+static string stats_line(const match_stats &st, const match_options &opt)
+{
+    double mean, var;
+    st.score(mean, var);
+    const double n = double(max<int64_t>(1, st.pair_count()));
+    const double margin = 1.96 * sqrt(var / n);
+    const double elo = elo_from_score(mean);
+    const double err = (elo_from_score(mean + margin) - elo_from_score(mean - margin)) / 2;
+    char buf[256];
+    snprintf(buf, sizeof(buf), "games %lld +%lld -%lld =%lld score %.1f%% elo %.1f +- %.1f LLR %.2f (%.2f, %.2f)",
+             (long long)(st.wins + st.draws + st.losses), (long long)st.wins, (long long)st.losses,
+             (long long)st.draws, 100 * mean, elo, err, sprt_llr(st, opt.elo0, opt.elo1),
+             log(opt.beta / (1 - opt.alpha)), log((1 - opt.beta) / opt.alpha));
+    return buf;
+}
+
+// дебют пары number: позиция из файла по кругу или случайные ходы от начальной расстановки
+static void opening(const match_options &opt, const vector<string> &fens, const int number, bitboard_pos &pos,
+                    bool &color)
+{
+    if (!fens.empty() && parse_fen(fens[size_t(number) % fens.size()], pos, color))
+        return;
+    pos = start_position();
+    color = 0;
+    mt19937 rng(opt.seed + unsigned(number) * 7919u);
+    vector<vector<move_pos>> turns;
+    for (int ply = 0; ply < opt.random_plies; ++ply)
+    {
+        Movegen<8>::full_turns(pos, color, turns);
+        if (turns.empty())
+            break;
+        pos = Movegen<8>::make_turn(pos, turns[rng() % turns.size()]);
+        color = !color;
+    }
+}
+
+// партия с позиции pos: players[0] играет цветом a_color; результат в формате game_record
+static game_record play_game(const Config configs[2], const bitboard_pos &start, const bool start_color,
+                             const bool a_color, const int max_turns, const int repeat_limit, const int no_progress)
+{
+    // свежие экземпляры движков на каждую партию
+    unique_ptr<Player> players[2] = {make_unique<Player>(configs[0]), make_unique<Player>(configs[1])};
+    game_record game;
+    game.start = start;
+    game.start_color = start_color;
+    game.custom_start = true;
+    game.tags[a_color ? "Black" : "White"] = "A";
+    game.tags[a_color ? "White" : "Black"] = "B";
+    bitboard_pos pos = start;
+    bool color = start_color;
+    HashHistory history;
+    history.push(pos, color);
+    vector<vector<move_pos>> turns;
+    for (int turn = 0; turn < max_turns; ++turn)
+    {
+        Movegen<8>::full_turns(pos, color, turns);
+        if (turns.empty())
+        {
+            game.result = color ? 1 : 2;
+            return game;
+        }
+        const auto line = players[color == a_color ? 0 : 1]->move(pos, color, history);
+        // недопустимый ход - поражение
+        if (find(turns.begin(), turns.end(), line) == turns.end())
+        {
+            game.result = color ? 1 : 2;
+            return game;
+        }
+        pos = Movegen<8>::make_turn(pos, line);
+        color = !color;
+        game.turns.push_back(line);
+        history.push(pos, color);
+        if (history.is_draw(repeat_limit - 1, no_progress))
+            break;
+    }
+    game.result = 0;
+    return game;
+}
+
+// очки A в партии: 0 - поражение, 1 - ничья, 2 - победа
+static int a_points(const game_record &game, const bool a_color)
+{
+    if (game.result == 0)
+        return 1;
+    return (game.result == 1) == !a_color ? 2 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    match_options opt;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const string key = argv[i], value = argv[i + 1];
+        if (key == "-a")
+            opt.spec[0] = value;
+        else if (key == "-b")
+            opt.spec[1] = value;
+        else if (key == "-games")
+            opt.games = max(2, stoi(value));
+        else if (key == "-t")
+            opt.threads = stoi(value);
+        else if (key == "-openings")
+            opt.openings = value;
+        else if (key == "-random-plies")
+            opt.random_plies = max(0, stoi(value));
+        else if (key == "-seed")
+            opt.seed = unsigned(stoul(value));
+        else if (key == "-elo0")
+            opt.elo0 = stod(value);
+        else if (key == "-elo1")
+            opt.elo1 = stod(value);
+        else if (key == "-alpha")
+            opt.alpha = stod(value);
+        else if (key == "-beta")
+            opt.beta = stod(value);
+        else if (key == "-pdn")
+            opt.pdn = value;
+        else if (key == "-report")
+            opt.report = max(1, stoi(value));
+    }
+    if (opt.threads <= 0)
+        opt.threads = max(1, int(thread::hardware_concurrency()));
+
+    Config configs[2];
+    for (int k = 0; k < 2; ++k)
+    {
+        if (!apply_spec(configs[k], opt.spec[k]))
+        {
+            cerr << "bad engine spec " << opt.spec[k] << "\n";
+            return 1;
+        }
+        // подобранные веса и сеть NNUE должны загрузиться, иначе матч сравнивал бы оценку по умолчанию
+        const Logic check(&configs[k]);
+        if (!check.eval_error.empty())
+        {
+            cerr << opt.spec[k] << ": " << check.eval_error << "\n";
+            return 1;
+        }
+    }
+    vector<string> fens;
+    if (!opt.openings.empty())
+    {
+        ifstream fin(opt.openings);
+        if (!fin)
+        {
+            cerr << "can't open " << opt.openings << "\n";
+            return 1;
+        }
+        string line, fen;
+        while (getline(fin, line))
+        {
+            istringstream in(line);
+            if (in >> fen && fen[0] != '#')
+                fens.push_back(fen);
+        }
+    }
+    ofstream pdn;
+    if (!opt.pdn.empty())
+        pdn.open(opt.pdn, ios_base::app);
+
+    const int max_turns = configs[0]("Game", "MaxNumTurns");
+    const int repeat_limit = configs[0]("Game", "RepetitionLimit");
+    const int no_progress = configs[0]("Game", "NoProgressLimit");
+    const double lower = log(opt.beta / (1 - opt.alpha)), upper = log((1 - opt.beta) / opt.alpha);
+    const int total_pairs = opt.games / 2;
+
+    mutex m;
+    match_stats st;
+    atomic<int> next_pair{0};
+    atomic<bool> decided{false};
+    // решение SPRT и число партий в момент решения: доигранные после него пары в решение не входят
+    int verdict = 0;
+    int64_t decided_games = 0;
+    atomic<int> running{opt.threads};
+    // поток берет следующую пару, пока SPRT не принял решение; партии, которые уже идут, доигрываются и учитываются
+    auto worker = [&]() {
+        int number;
+        while (!decided && (number = next_pair++) < total_pairs)
+        {
+            bitboard_pos start;
+            bool start_color;
+            opening(opt, fens, number, start, start_color);
+            int points = 0;
+            game_record games[2];
+            for (int g = 0; g < 2; ++g)
+            {
+                games[g] = play_game(configs, start, start_color, g == 1, max_turns, repeat_limit, no_progress);
+                points += a_points(games[g], g == 1);
+            }
+            lock_guard<mutex> lock(m);
+            for (int g = 0; g < 2; ++g)
+            {
+                const int p = a_points(games[g], g == 1);
+                (p == 2 ? st.wins : p == 1 ? st.draws : st.losses)++;
+                if (pdn)
+                    Pdn::write(pdn, games[g]);
+            }
+            st.pairs[points]++;
+            const double llr = sprt_llr(st, opt.elo0, opt.elo1);
+            if (!decided && (llr <= lower || llr >= upper))
+            {
+                verdict = llr >= upper ? 1 : -1;
+                decided_games = st.pair_count() * 2;
+                decided = true;
+            }
+        }
+        running--;
+    };
+    vector<thread> pool;
+    for (int t = 0; t < opt.threads; ++t)
+        pool.emplace_back(worker);
+
+    while (running > 0)
+    {
+        for (int k = 0; k < opt.report * 10 && running > 0; ++k)
+            this_thread::sleep_for(chrono::milliseconds(100));
+        lock_guard<mutex> lock(m);
+        cout << stats_line(st, opt) << endl;
+    }
+    for (auto &th : pool)
+        th.join();
+
+    cout << "A: " << opt.spec[0] << "\nB: " << opt.spec[1] << "\n" << stats_line(st, opt) << "\n";
+    if (verdict > 0)
+        cout << "SPRT: H1 accepted after " << decided_games << " games, A is stronger by at least " << opt.elo1
+             << " Elo\n";
+    else if (verdict < 0)
+        cout << "SPRT: H0 accepted after " << decided_games << " games, A is not stronger by more than " << opt.elo0
+             << " Elo\n";
+    else
+        cout << "SPRT: inconclusive after " << st.pair_count() * 2 << " games\n";
+    return 0;
+}
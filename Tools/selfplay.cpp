@@ -0,0 +1,259 @@
+﻿// Генерация партий самоигры на всех ядрах: каждый поток играет своим экземпляром Logic,
+// первые ходы выбираются случайно, партии присуждаются по материалу, правилам ничьей и MaxNumTurns.
+// Вывод дописывается в шарды потоков: <out>-<поток>-<номер>.txt - позиции "<FEN> <результат> <оценка>"
+// (читается Tools/tuner), <out>-<поток>.ckg - партии в бинарном корпусе (Tools/corpus).
+// Запуск: selfplay [-games N] [-t threads] [-depth D] [-random-plies R] [-margin M] [-margin-plies P]
+//                  [-shard-mb MB] [-out selfplay] [-seed S] [-report seconds]
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Game/Corpus.h"
+#include "../Game/Logic.h"
+#include "../Models/Fen.h"
+
+using namespace std;
+
+struct selfplay_options
+{
+    int games = 1000;
+    int threads = 0;
+    int depth = 3;
+    int random_plies = 6;  // случайные ходы в начале партии
+    int margin = 5;        // перевес в материале (шашка 1, дамка 3) для присуждения победы, 0 - не присуждать
+    int margin_plies = 8;  // сколько ходов подряд должен держаться перевес
+    int shard_mb = 64;     // размер шарда позиций
+    int report = 5;        // период вывода статистики в секундах
+    string out = "selfplay";
+    unsigned seed = unsigned(time(0));
+};
+
+// общие счетчики потоков
+struct selfplay_stats
+{
+    atomic<int> next_game{0};
+    atomic<int> games{0};
+    atomic<int64_t> positions{0};
+    atomic<int> results[3] = {{0}, {0}, {0}}; // ничья, белые, черные
+    atomic<int> by_margin{0};
+    atomic<int> by_draw_rule{0};
+    atomic<int> by_max_turns{0};
+};
+
+// позиция, ожидающая результата партии
+struct pending_pos
+{
+    string fen;
+    double score; // ln(оценка) с точки зрения белых
+};
+
+static int material(const bitboard_pos &pos)
+{
+    return popcount32(pos.wm) + 3 * popcount32(pos.wk) - popcount32(pos.bm) - 3 * popcount32(pos.bk);
+}
+
+// заведомая ничья: остались только дамки, не больше двух у каждой стороны
+// (таблиц окончаний нет, поэтому вместо них используется это правило)
+static bool known_draw(const bitboard_pos &pos)
+{
+    return !pos.wm && !pos.bm && popcount32(pos.wk) <= 2 && popcount32(pos.bk) <= 2;
+}
+
+// шард позиций потока: файлы дописываются, новый файл начинается при достижении размера
+class position_shard
+{
+  public:
+    position_shard(const string &prefix, const int64_t limit) : prefix(prefix), limit(limit)
+    {
+        next();
+    }
+
+    void write(const string &text)
+    {
+        if (written >= limit)
+            next();
+        fout << text;
+        fout.flush();
+        written += int64_t(text.size());
+    }
+
+  private:
+    // первый шард, который еще не заполнен
+    void next()
+    {
+        fout.close();
+        while (true)
+        {
+            const string path = prefix + "-" + to_string(index++) + ".txt";
+            ifstream fin(path, ios::binary | ios::ate);
+            written = fin ? int64_t(fin.tellg()) : 0;
+            if (written < limit)
+            {
+                fout.open(path, ios::app);
+                return;
+            }
+        }
+    }
+
+    string prefix;
+    int64_t limit;
+    int index = 0;
+    int64_t written = 0;
+    ofstream fout;
+};
+
+static void worker(const int id, const selfplay_options &opt, Config &config, const int max_turns, selfplay_stats &st)
+{
+    Logic logic(&config);
+    logic.Max_depth = opt.depth;
+    const int repeat_limit = config("Game", "RepetitionLimit");
+    const int no_progress = config("Game", "NoProgressLimit");
+    mt19937 rng(opt.seed + unsigned(id) * 7919u);
+    const string prefix = opt.out + "-" + to_string(id);
+    position_shard shard(prefix, int64_t(opt.shard_mb) << 20);
+    CorpusWriter corpus;
+    if (!corpus.open(prefix + ".ckg"))
+        cout << "can't open " << prefix << ".ckg\n";
+    // память ограничена одной партией на поток
+    vector<pending_pos> positions;
+    string text;
+    while (st.next_game++ < opt.games)
+    {
+        game_record game;
+        game.start = start_position();
+        auto mtx = unpack_board(game.start);
+        // поиск знает позиции партии и не повторяет их
+        logic.history.clear();
+        logic.history.push(game.start, 0);
+        positions.clear();
+        int result = -1, lead = 0, turn = 0;
+        for (; turn < max_turns && result == -1; ++turn)
+        {
+            const bool color = turn % 2;
+            const auto full_turns = logic.find_full_turns(mtx, color);
+            if (full_turns.empty())
+            {
+                result = color ? 1 : 2;
+                break;
+            }
+            vector<move_pos> line;
+            if (turn < opt.random_plies)
+                line = full_turns[rng() % full_turns.size()];
+            else
+            {
+                line = logic.find_best_turns(mtx, color);
+                const double s = log(max(1e-9, min(1e9, logic.last_score)));
+                positions.push_back({to_fen(pack_board(mtx), color), color ? -s : s});
+            }
+            for (const auto &mv : line)
+                mtx = logic.make_turn(mtx, mv);
+            game.turns.push_back(line);
+
+            // присуждение
+            const bitboard_pos pos = pack_board(mtx);
+            logic.history.push(pos, !color);
+            if (known_draw(pos) || logic.history.is_draw(repeat_limit - 1, no_progress))
+            {
+                result = 0;
+                st.by_draw_rule++;
+                break;
+            }
+            const int diff = material(pos);
+            if (opt.margin > 0 && abs(diff) >= opt.margin)
+                lead = (lead > 0) == (diff > 0) ? lead + (diff > 0 ? 1 : -1) : (diff > 0 ? 1 : -1);
+            else
+                lead = 0;
+            if (opt.margin > 0 && abs(lead) >= opt.margin_plies)
+            {
+                result = lead > 0 ? 1 : 2;
+                st.by_margin++;
+            }
+        }
+        if (result == -1)
+        {
+            result = 0;
+            st.by_max_turns++;
+        }
+        game.result = result;
+
+        const char *res = result == 1 ? "1-0" : result == 2 ? "0-1" : "1/2-1/2";
+        text.clear();
+        for (const auto &p : positions)
+        {
+            char buf[32];
+            snprintf(buf, sizeof(buf), " %s %.3f\n", res, p.score);
+            text += p.fen + buf;
+        }
+        shard.write(text);
+        corpus.add(game);
+        st.results[result]++;
+        st.positions += int64_t(positions.size());
+        st.games++;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    selfplay_options opt;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const string key = argv[i], value = argv[i + 1];
+        if (key == "-games")
+            opt.games = stoi(value);
+        else if (key == "-t")
+            opt.threads = stoi(value);
+        else if (key == "-depth")
+            opt.depth = stoi(value);
+        else if (key == "-random-plies")
+            opt.random_plies = stoi(value);
+        else if (key == "-margin")
+            opt.margin = stoi(value);
+        else if (key == "-margin-plies")
+            opt.margin_plies = stoi(value);
+        else if (key == "-shard-mb")
+            opt.shard_mb = max(1, stoi(value));
+        else if (key == "-out")
+            opt.out = value;
+        else if (key == "-seed")
+            opt.seed = unsigned(stoul(value));
+        else if (key == "-report")
+            opt.report = max(1, stoi(value));
+    }
+    if (opt.threads <= 0)
+        opt.threads = max(1, int(thread::hardware_concurrency()));
+    Config config;
+    const int max_turns = config("Game", "MaxNumTurns");
+    cout << "games: " << opt.games << ", threads: " << opt.threads << ", depth: " << opt.depth
+         << ", max turns: " << max_turns << "\n";
+
+    selfplay_stats st;
+    vector<thread> pool;
+    for (int t = 0; t < opt.threads; ++t)
+        pool.emplace_back(worker, t, cref(opt), ref(config), max_turns, ref(st));
+
+    const auto start = chrono::steady_clock::now();
+    auto print = [&]() {
+        const double sec = max(1e-3, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        cout << "games " << st.games << "/" << opt.games << ", " << int64_t(st.games / sec * 3600) << " games/h, "
+             << int64_t(double(st.positions) / sec) << " positions/s, +" << st.results[1] << " -" << st.results[2]
+             << " =" << st.results[0] << " (margin " << st.by_margin << ", draw rule " << st.by_draw_rule
+             << ", max turns " << st.by_max_turns << ")" << endl;
+    };
+    while (st.games < opt.games)
+    {
+        for (int k = 0; k < opt.report * 10 && st.games < opt.games; ++k)
+            this_thread::sleep_for(chrono::milliseconds(100));
+        print();
+    }
+    for (auto &th : pool)
+        th.join();
+    return 0;
+}
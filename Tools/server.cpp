@@ -0,0 +1,651 @@
+﻿// Сервер партий: много одновременных партий без окна по TCP, одна сессия на соединение.
+// Ходы движка считает общий пул потоков поиска с общей таблицей транспозиций; сессия хранит только позицию,
+// историю партии и буферы строк, поэтому память на сессию мала и ограничена (строка - до 1 КБ, вывод - до 64 КБ,
+// история - до MaxNumTurns позиций). Сессии обслуживаются по очереди: у каждой не больше одного хода в очереди,
+// а время хода ограничено -movetime, поэтому ни одна партия не задерживает остальные.
+// Протокол - строки текста, ходы номерами клеток PDN ("22-18", "11x18x25"):
+//   new [white|black] [fen FEN] [movetime MS] - новая партия, клиент играет указанным цветом (по умолчанию белыми),
+//                                             если первый ход за движком, он ходит сразу
+//   move <ход> - ход клиента, в ответ движок присылает свой ход
+//   go         - ход движка за сторону, которая ходит (движок против движка)
+//   moves      - допустимые ходы, d - позиция в FEN, stats - нагрузка сервера, quit
+// Ответы: ready, ok, move <ход> score S nodes N wait MS time MS, moves ..., result 1-0|0-1|1/2-1/2,
+//         illegal <ход>, busy (движок еще думает), error <текст>
+// Запуск: server [-host 127.0.0.1] [-port 7777] [-t threads] [-hash MB] [-movetime MS] [-depth D]
+//                [-max-sessions N] [-rules russian|english|brazilian|pool] [-report seconds]
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../Game/Pdn.h"
+#include "../Game/Rules.h"
+#include "../Game/Search.h"
+#include "../Models/Fen.h"
+#include "../Models/GameRecord.h"
+
+using namespace std;
+
+struct server_options
+{
+    string host = "127.0.0.1";
+    int port = 7777;
+    int threads = 0;
+    size_t hash_mb = 256;
+    int move_time_ms = 100; // наибольшее время хода движка, клиент может попросить меньше
+    int depth = SEARCH_MAX_PLY - 1;
+    int max_sessions = 1024;
+    int report = 10; // период вывода нагрузки в stderr, секунды
+    string rules = russian_rules::name();
+};
+
+const size_t MAX_LINE = 1024;
+const size_t MAX_OUTPUT = 64 * 1024;
+
+// ход движка для сессии slot; gen отличает сессию от следующей в том же слоте
+struct engine_job
+{
+    int slot;
+    uint32_t gen;
+    bitboard_pos pos;
+    bool color;
+    HashHistory history;
+    search_limits limits;
+    chrono::steady_clock::time_point queued;
+};
+
+struct engine_result
+{
+    int slot;
+    uint32_t gen;
+    vector<move_pos> best;
+    int score;
+    int64_t nodes;
+    int wait_ms;
+    int time_ms;
+};
+
+// пул потоков поиска: общая очередь ходов в порядке поступления и общая таблица транспозиций,
+// у каждого потока свой поиск (таблица истории, буферы ходов); готовые ходы будят цикл сервера через pipe
+template <class Rules> class EnginePool
+{
+  public:
+    EnginePool(Config *config, const int threads, const size_t hash_mb, const int wake_fd)
+        : tt(hash_mb), wake_fd(wake_fd)
+    {
+        for (int t = 0; t < threads; ++t)
+            pool.emplace_back([this, config]() { work(config); });
+    }
+
+    ~EnginePool()
+    {
+        {
+            lock_guard<mutex> lock(m);
+            closed = true;
+        }
+        has_jobs.notify_all();
+        for (auto &th : pool)
+            th.join();
+    }
+
+    void push(engine_job job)
+    {
+        {
+            lock_guard<mutex> lock(m);
+            jobs.push_back(move(job));
+        }
+        has_jobs.notify_one();
+    }
+
+    // готовые ходы, накопившиеся с прошлого вызова
+    void take_results(vector<engine_result> &res)
+    {
+        lock_guard<mutex> lock(m);
+        res.assign(results.begin(), results.end());
+        results.clear();
+    }
+
+    size_t queued()
+    {
+        lock_guard<mutex> lock(m);
+        return jobs.size();
+    }
+
+    int hashfull() const
+    {
+        return tt.hashfull();
+    }
+
+  private:
+    void work(Config *config)
+    {
+        BasicSearch<Rules> search(config, &tt);
+        engine_job job;
+        while (true)
+        {
+            {
+                unique_lock<mutex> lock(m);
+                has_jobs.wait(lock, [&] { return !jobs.empty() || closed; });
+                if (jobs.empty())
+                    return;
+                job = move(jobs.front());
+                jobs.pop_front();
+            }
+            const auto begin = chrono::steady_clock::now();
+            engine_result res;
+            res.slot = job.slot;
+            res.gen = job.gen;
+            res.wait_ms = int(chrono::duration_cast<chrono::milliseconds>(begin - job.queued).count());
+            search.history = move(job.history);
+            res.best = search.go(job.pos, job.color, job.limits);
+            res.score = search.last.score;
+            res.nodes = search.node_count();
+            res.time_ms =
+                int(chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - begin).count());
+            {
+                lock_guard<mutex> lock(m);
+                results.push_back(move(res));
+            }
+            const char byte = 0;
+            if (write(wake_fd, &byte, 1) < 0)
+            {
+                // pipe переполнен - цикл сервера и так проснется и заберет все результаты
+            }
+        }
+    }
+
+    TranspositionTable tt;
+    int wake_fd;
+    vector<thread> pool;
+    mutex m;
+    condition_variable has_jobs;
+    deque<engine_job> jobs;
+    deque<engine_result> results;
+    bool closed = false;
+};
+
+// одна партия одного клиента
+struct session
+{
+    int fd = -1;
+    uint32_t gen = 0;
+    bitboard_pos pos;
+    bool color = 0;        // чей ход
+    bool human = 0;        // цвет клиента
+    bool started = false;  // партия идет
+    bool thinking = false; // ход движка в очереди или считается
+    int plies = 0;
+    int move_time_ms = 0;
+    HashHistory history;
+    string in, out;
+};
+
+// нагрузка с прошлого отчета
+struct server_stats
+{
+    int64_t games = 0;
+    int64_t moves = 0;
+    int64_t wait_sum = 0, time_sum = 0;
+    int wait_max = 0, time_max = 0;
+};
+
+static bool set_nonblocking(const int fd)
+{
+    const int flags = fcntl(fd, F_GETFL, 0);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// цикл сервера в одном потоке на poll: прием соединений, разбор команд, отправка ответов и ходов движка
+template <class Rules> class Server
+{
+  public:
+    typedef Movegen<8, Rules> movegen;
+
+    Server(const server_options &opt, Config *config) : opt(opt), config(config), sessions(size_t(opt.max_sessions))
+    {
+        max_turns = (*config)("Game", "MaxNumTurns");
+        no_progress_limit = (*config)("Game", "NoProgressLimit");
+        repetition_limit = (*config)("Game", "RepetitionLimit");
+        for (int k = opt.max_sessions - 1; k >= 0; --k)
+            free_slots.push_back(k);
+    }
+
+    ~Server()
+    {
+        for (auto &s : sessions)
+        {
+            if (s.fd != -1)
+                close(s.fd);
+        }
+        if (listener != -1)
+            close(listener);
+    }
+
+    // false - не удалось открыть порт
+    bool run()
+    {
+        int wake[2];
+        if (pipe(wake) != 0 || !set_nonblocking(wake[0]) || !set_nonblocking(wake[1]))
+            return false;
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        const int yes = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(uint16_t(opt.port));
+        if (listener == -1 || inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr) != 1 ||
+            ::bind(listener, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 256) != 0 ||
+            !set_nonblocking(listener))
+        {
+            cerr << "can't listen on " << opt.host << ":" << opt.port << "\n";
+            return false;
+        }
+        EnginePool<Rules> engines(config, opt.threads, opt.hash_mb, wake[1]);
+        pool = &engines;
+        cerr << "listening on " << opt.host << ":" << opt.port << ", " << opt.threads << " search threads, "
+             << opt.max_sessions << " sessions, rules " << Rules::name() << endl;
+
+        vector<pollfd> fds;
+        vector<int> slots;
+        vector<engine_result> results;
+        auto next_report = chrono::steady_clock::now() + chrono::seconds(opt.report);
+        while (true)
+        {
+            fds.clear();
+            slots.clear();
+            fds.push_back({wake[0], POLLIN, 0});
+            fds.push_back({listener, POLLIN, 0});
+            for (size_t k = 0; k < sessions.size(); ++k)
+            {
+                if (sessions[k].fd == -1)
+                    continue;
+                fds.push_back({sessions[k].fd, short(POLLIN | (sessions[k].out.empty() ? 0 : POLLOUT)), 0});
+                slots.push_back(int(k));
+            }
+            const auto now = chrono::steady_clock::now();
+            const int timeout = int(max<int64_t>(
+                0, chrono::duration_cast<chrono::milliseconds>(next_report - now).count()));
+            if (poll(fds.data(), fds.size(), timeout) < 0)
+                continue;
+
+            if (fds[0].revents & POLLIN)
+            {
+                char buf[256];
+                while (read(wake[0], buf, sizeof(buf)) > 0)
+                {
+                }
+                pool->take_results(results);
+                for (const auto &res : results)
+                    engine_done(res);
+            }
+            if (fds[1].revents & POLLIN)
+                accept_all();
+            for (size_t k = 2; k < fds.size(); ++k)
+            {
+                session &s = sessions[size_t(slots[k - 2])];
+                if (s.fd != fds[k].fd)
+                    continue;
+                if (fds[k].revents & (POLLERR | POLLNVAL))
+                    close_session(s);
+                else if (fds[k].revents & (POLLIN | POLLHUP))
+                    receive(s);
+                if (s.fd != -1 && (fds[k].revents & POLLOUT))
+                    flush(s);
+            }
+            if (chrono::steady_clock::now() >= next_report)
+            {
+                cerr << stats_line() << endl;
+                period = server_stats();
+                next_report = chrono::steady_clock::now() + chrono::seconds(opt.report);
+            }
+        }
+    }
+
+  private:
+    void accept_all()
+    {
+        while (true)
+        {
+            const int fd = accept(listener, nullptr, nullptr);
+            if (fd == -1)
+                return;
+            if (free_slots.empty() || !set_nonblocking(fd))
+            {
+                const string full = "error server full\n";
+                if (send(fd, full.data(), full.size(), 0) < 0)
+                {
+                }
+                close(fd);
+                continue;
+            }
+            const int yes = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+            session &s = sessions[size_t(free_slots.back())];
+            free_slots.pop_back();
+            s.fd = fd;
+            s.started = s.thinking = false;
+            reply(s, "ready");
+        }
+    }
+
+    void close_session(session &s)
+    {
+        close(s.fd);
+        s.fd = -1;
+        // ход движка, который еще считается, будет отброшен по номеру поколения
+        ++s.gen;
+        s.started = s.thinking = false;
+        s.history.clear();
+        string().swap(s.in);
+        string().swap(s.out);
+        free_slots.push_back(int(&s - sessions.data()));
+    }
+
+    void receive(session &s)
+    {
+        char buf[4096];
+        while (true)
+        {
+            const ssize_t n = recv(s.fd, buf, sizeof(buf), 0);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                close_session(s);
+                return;
+            }
+            if (n < 0)
+                break;
+            s.in.append(buf, size_t(n));
+            size_t start = 0, end;
+            while (s.fd != -1 && (end = s.in.find('\n', start)) != string::npos)
+            {
+                string line = s.in.substr(start, end - start);
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                start = end + 1;
+                command(s, line);
+            }
+            if (s.fd == -1)
+                return;
+            s.in.erase(0, start);
+            if (s.in.size() > MAX_LINE)
+            {
+                close_session(s);
+                return;
+            }
+        }
+    }
+
+    // ответ клиенту; медленный клиент, не читающий ответы, отключается
+    void reply(session &s, const string &line)
+    {
+        if (s.fd == -1)
+            return;
+        s.out += line;
+        s.out += '\n';
+        if (s.out.size() > MAX_OUTPUT)
+        {
+            close_session(s);
+            return;
+        }
+        flush(s);
+    }
+
+    void flush(session &s)
+    {
+        while (!s.out.empty())
+        {
+            const ssize_t n = send(s.fd, s.out.data(), s.out.size(), 0);
+            if (n < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    close_session(s);
+                return;
+            }
+            s.out.erase(0, size_t(n));
+        }
+    }
+
+    void command(session &s, const string &line)
+    {
+        istringstream in(line);
+        string cmd;
+        in >> cmd;
+        if (cmd == "quit")
+        {
+            flush(s);
+            close_session(s);
+        }
+        else if (cmd == "stats")
+            reply(s, stats_line());
+        else if (cmd == "d")
+            reply(s, s.started ? to_fen(s.pos, s.color) : "error no game");
+        else if (s.thinking)
+            reply(s, "busy");
+        else if (cmd == "new")
+            new_game(s, in);
+        else if (!s.started && (cmd == "move" || cmd == "go" || cmd == "moves"))
+            reply(s, "error no game");
+        else if (cmd == "moves")
+        {
+            vector<vector<move_pos>> turns;
+            movegen::full_turns(s.pos, s.color, turns);
+            string res = "moves";
+            for (const auto &turn : turns)
+                res += " " + Pdn::move_string(turn);
+            reply(s, res);
+        }
+        else if (cmd == "move")
+        {
+            string token;
+            in >> token;
+            vector<move_pos> turn;
+            if (!find_turn(s, token, turn))
+            {
+                reply(s, "illegal " + token);
+                return;
+            }
+            play(s, turn);
+            if (s.started && s.color != s.human)
+                think(s);
+        }
+        else if (cmd == "go")
+            think(s);
+        else if (!cmd.empty())
+            reply(s, "error unknown command " + cmd);
+    }
+
+    void new_game(session &s, istringstream &in)
+    {
+        s.pos = start_position();
+        s.color = 0;
+        s.human = 0;
+        s.plies = 0;
+        s.move_time_ms = opt.move_time_ms;
+        string token;
+        while (in >> token)
+        {
+            if (token == "white" || token == "black")
+                s.human = token == "black";
+            else if (token == "fen")
+            {
+                string fen;
+                if (!(in >> fen) || !parse_fen(fen, s.pos, s.color))
+                {
+                    reply(s, "error bad fen " + fen);
+                    return;
+                }
+            }
+            else if (token == "movetime")
+            {
+                int ms = 0;
+                in >> ms;
+                s.move_time_ms = max(1, min(ms, opt.move_time_ms));
+            }
+        }
+        s.history.clear();
+        s.history.push(s.pos, s.color);
+        s.started = true;
+        ++period.games;
+        reply(s, "ok");
+        if (game_over(s))
+            return;
+        if (s.color != s.human)
+            think(s);
+    }
+
+    // ход клиента по списку допустимых полных ходов
+    bool find_turn(const session &s, const string &token, vector<move_pos> &turn) const
+    {
+        auto mtx = unpack_board(s.pos);
+        if (!Pdn::parse_move(token, mtx, turn))
+            return false;
+        vector<vector<move_pos>> turns;
+        movegen::full_turns(s.pos, s.color, turns);
+        return find(turns.begin(), turns.end(), turn) != turns.end();
+    }
+
+    void play(session &s, const vector<move_pos> &turn)
+    {
+        s.pos = movegen::make_turn(s.pos, turn);
+        s.color = !s.color;
+        ++s.plies;
+        s.history.push(s.pos, s.color);
+        game_over(s);
+    }
+
+    // проверка конца партии после хода; результат отправляется клиенту
+    bool game_over(session &s)
+    {
+        vector<vector<move_pos>> turns;
+        movegen::full_turns(s.pos, s.color, turns);
+        int result = -1;
+        // сторона без ходов проигрывает
+        if (turns.empty())
+            result = s.color ? 1 : 2;
+        else if (s.plies >= max_turns || s.history.is_draw(repetition_limit - 1, no_progress_limit))
+            result = 0;
+        if (result == -1)
+            return false;
+        s.started = false;
+        reply(s, "result " + Pdn::result_string(result));
+        return true;
+    }
+
+    void think(session &s)
+    {
+        if (s.fd == -1)
+            return;
+        engine_job job;
+        job.slot = int(&s - sessions.data());
+        job.gen = s.gen;
+        job.pos = s.pos;
+        job.color = s.color;
+        job.history = s.history;
+        job.limits.depth = opt.depth;
+        job.limits.move_time_ms = s.move_time_ms;
+        job.queued = chrono::steady_clock::now();
+        s.thinking = true;
+        pool->push(move(job));
+    }
+
+    void engine_done(const engine_result &res)
+    {
+        session &s = sessions[size_t(res.slot)];
+        ++period.moves;
+        period.wait_sum += res.wait_ms;
+        period.time_sum += res.time_ms;
+        period.wait_max = max(period.wait_max, res.wait_ms);
+        period.time_max = max(period.time_max, res.time_ms);
+        // клиент отключился, пока движок думал
+        if (s.fd == -1 || s.gen != res.gen)
+            return;
+        s.thinking = false;
+        if (res.best.empty())
+        {
+            game_over(s);
+            return;
+        }
+        reply(s, "move " + Pdn::move_string(res.best) + " score " + to_string(res.score) + " nodes " +
+                     to_string(res.nodes) + " wait " + to_string(res.wait_ms) + " time " + to_string(res.time_ms));
+        play(s, res.best);
+    }
+
+    string stats_line()
+    {
+        const int64_t n = max<int64_t>(1, period.moves);
+        return "stats sessions " + to_string(opt.max_sessions - int(free_slots.size())) + " queued " +
+               to_string(pool->queued()) + " games " + to_string(period.games) + " moves " +
+               to_string(period.moves) + " wait_avg " + to_string(period.wait_sum / n) + " wait_max " +
+               to_string(period.wait_max) + " time_avg " + to_string(period.time_sum / n) + " time_max " +
+               to_string(period.time_max) + " hashfull " + to_string(pool->hashfull());
+    }
+
+    server_options opt;
+    Config *config;
+    EnginePool<Rules> *pool = nullptr;
+    vector<session> sessions;
+    vector<int> free_slots;
+    int listener = -1;
+    int max_turns = 0;
+    int no_progress_limit = 0;
+    int repetition_limit = 0;
+    server_stats period;
+};
+
+int main(int argc, char *argv[])
+{
+    server_options opt;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const string key = argv[i], value = argv[i + 1];
+        if (key == "-host")
+            opt.host = value;
+        else if (key == "-port")
+            opt.port = stoi(value);
+        else if (key == "-t")
+            opt.threads = stoi(value);
+        else if (key == "-hash")
+            opt.hash_mb = size_t(max(1, stoi(value)));
+        else if (key == "-movetime")
+            opt.move_time_ms = max(1, stoi(value));
+        else if (key == "-depth")
+            opt.depth = max(1, min(SEARCH_MAX_PLY - 1, stoi(value)));
+        else if (key == "-max-sessions")
+            opt.max_sessions = max(1, stoi(value));
+        else if (key == "-rules")
+            opt.rules = value;
+        else if (key == "-report")
+            opt.report = max(1, stoi(value));
+    }
+    if (opt.threads <= 0)
+        opt.threads = max(1, int(thread::hardware_concurrency()));
+    // запись в закрытое клиентом соединение не должна завершать сервер
+    signal(SIGPIPE, SIG_IGN);
+
+    Config config;
+    bool ok = false;
+    if (!with_rules(opt.rules, [&](auto rules) {
+            Server<decltype(rules)> server(opt, &config);
+            ok = server.run();
+        }))
+    {
+        cerr << "unknown rules " << opt.rules << "\n";
+        return 1;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+﻿// Подбор весов оценки (Eval) по размеченным позициям методом Texel:
+// минимизируется квадратичная ошибка между результатом партии и sigmoid(K * ln(оценка)).
+// Формат корпуса: по строке на позицию "<FEN> <результат>", результат - 1-0, 0-1, 1/2-1/2 или число
+// от 0 до 1 (для белых, 1 - победа, 0.5 - ничья).
+// Запуск: tuner corpus.txt [-o weights.json] [-t threads] [-i iterations] [-lr rate] [-mode NumberAndPotential]
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Game/Eval.h"
+#include "../Models/Fen.h"
+
+using namespace std;
+
+// число подбираемых параметров: дамка, продвижение, первая строка, центр
+const int NUM_PARAMS = 4;
+
+struct labeled_pos
+{
+    eval_features f;
+    float result; // 1 - победа белых, 0.5 - ничья, 0 - победа черных
+};
+
+static void to_params(const eval_weights &w, double *p)
+{
+    p[0] = w.king;
+    p[1] = w.advance;
+    p[2] = w.back_rank;
+    p[3] = w.center;
+}
+
+static eval_weights from_params(const double *p)
+{
+    eval_weights w;
+    w.king = p[0];
+    w.advance = p[1];
+    w.back_rank = p[2];
+    w.center = p[3];
+    return w;
+}
+
+static bool parse_result(const string &token, float &result)
+{
+    if (token == "1-0" || token == "2-0" || token == "1")
+        result = 1;
+    else if (token == "0-1" || token == "0-2" || token == "0")
+        result = 0;
+    else if (token == "1/2-1/2" || token == "1-1" || token == "0.5")
+        result = 0.5;
+    else
+    {
+        // средний результат позиции из нескольких партий (corpus positions)
+        char *end = nullptr;
+        const double value = strtod(token.c_str(), &end);
+        if (token.empty() || *end || !(value >= 0 && value <= 1))
+            return false;
+        result = float(value);
+    }
+    return true;
+}
+
+// чтение корпуса, признаки считаются пачками
+static vector<labeled_pos> load_corpus(const string &path, size_t &bad_lines)
+{
+    ifstream fin(path);
+    vector<labeled_pos> res;
+    vector<bitboard_pos> batch_pos;
+    vector<float> batch_res;
+    vector<eval_features> batch_f;
+    bad_lines = 0;
+    auto flush = [&]() {
+        batch_f.resize(batch_pos.size());
+        Eval::features_batch(batch_pos.data(), batch_pos.size(), batch_f.data());
+        for (size_t k = 0; k < batch_pos.size(); ++k)
+        {
+            const eval_features &f = batch_f[k];
+            // позиции без фигур у одной из сторон не несут информации о весах
+            if (f.w.men + f.w.kings == 0 || f.b.men + f.b.kings == 0)
+                continue;
+            res.push_back({f, batch_res[k]});
+        }
+        batch_pos.clear();
+        batch_res.clear();
+    };
+    string line;
+    while (getline(fin, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        istringstream in(line);
+        string fen, token;
+        in >> fen >> token;
+        bitboard_pos pos;
+        bool color;
+        float result;
+        if (!parse_fen(fen, pos, color) || !parse_result(token, result))
+        {
+            ++bad_lines;
+            continue;
+        }
+        batch_pos.push_back(pos);
+        batch_res.push_back(result);
+        if (batch_pos.size() == 4096)
+            flush();
+    }
+    flush();
+    return res;
+}
+
+// ошибка и градиент по части корпуса [from, to)
+static void loss_range(const vector<labeled_pos> &data, size_t from, size_t to, const double *p, const double K,
+                       double &loss, double *grad)
+{
+    loss = 0;
+    for (int k = 0; k < NUM_PARAMS; ++k)
+        grad[k] = 0;
+    for (size_t n = from; n < to; ++n)
+    {
+        const eval_features &f = data[n].f;
+        const double fw[NUM_PARAMS] = {double(f.w.kings), double(f.w.advance), double(f.w.back_rank),
+                                       double(f.w.center)};
+        const double fb[NUM_PARAMS] = {double(f.b.kings), double(f.b.advance), double(f.b.back_rank),
+                                       double(f.b.center)};
+        double sw = f.w.men, sb = f.b.men;
+        for (int k = 0; k < NUM_PARAMS; ++k)
+        {
+            sw += p[k] * fw[k];
+            sb += p[k] * fb[k];
+        }
+        if (sw <= 0 || sb <= 0)
+            continue;
+        const double prob = 1 / (1 + exp(-K * log(sw / sb)));
+        const double err = data[n].result - prob;
+        loss += err * err;
+        // d(loss)/d(ln r) = -2 * err * K * p * (1 - p), d(ln r)/dp_k = fw_k / sw - fb_k / sb
+        const double common = -2 * err * K * prob * (1 - prob);
+        for (int k = 0; k < NUM_PARAMS; ++k)
+            grad[k] += common * (fw[k] / sw - fb[k] / sb);
+    }
+}
+
+// средняя ошибка и градиент по всему корпусу на нескольких потоках
+static double loss_all(const vector<labeled_pos> &data, const double *p, const double K, double *grad,
+                       const unsigned threads)
+{
+    vector<double> losses(threads);
+    vector<double> grads(threads * NUM_PARAMS);
+    vector<thread> pool;
+    const size_t part = (data.size() + threads - 1) / threads;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        const size_t from = min(data.size(), t * part), to = min(data.size(), from + part);
+        pool.emplace_back(loss_range, cref(data), from, to, p, K, ref(losses[t]), grads.data() + t * NUM_PARAMS);
+    }
+    for (auto &th : pool)
+        th.join();
+    double loss = 0;
+    for (int k = 0; k < NUM_PARAMS; ++k)
+        grad[k] = 0;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        loss += losses[t];
+        for (int k = 0; k < NUM_PARAMS; ++k)
+            grad[k] += grads[t * NUM_PARAMS + k];
+    }
+    for (int k = 0; k < NUM_PARAMS; ++k)
+        grad[k] /= double(data.size());
+    return loss / double(data.size());
+}
+
+// подбор масштаба K при фиксированных весах (золотое сечение)
+static double fit_scale(const vector<labeled_pos> &data, const double *p, const unsigned threads)
+{
+    double grad[NUM_PARAMS];
+    double lo = 0.1, hi = 30;
+    const double phi = (sqrt(5.0) - 1) / 2;
+    double a = hi - phi * (hi - lo), b = lo + phi * (hi - lo);
+    double la = loss_all(data, p, a, grad, threads), lb = loss_all(data, p, b, grad, threads);
+    for (int it = 0; it < 40; ++it)
+    {
+        if (la < lb)
+        {
+            hi = b;
+            b = a;
+            lb = la;
+            a = hi - phi * (hi - lo);
+            la = loss_all(data, p, a, grad, threads);
+        }
+        else
+        {
+            lo = a;
+            a = b;
+            la = lb;
+            b = lo + phi * (hi - lo);
+            lb = loss_all(data, p, b, grad, threads);
+        }
+    }
+    return (lo + hi) / 2;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "usage: tuner corpus.txt [-o weights.json] [-t threads] [-i iterations] [-lr rate] [-mode "
+                "NumberOnly|NumberAndPotential]\n";
+        return 1;
+    }
+    string corpus_path = argv[1], out_path = "weights.json", mode = "NumberAndPotential";
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    int iterations = 500;
+    double lr = 0.01;
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        const string key = argv[i], value = argv[i + 1];
+        if (key == "-o")
+            out_path = value;
+        else if (key == "-t")
+            threads = max(1, stoi(value));
+        else if (key == "-i")
+            iterations = stoi(value);
+        else if (key == "-lr")
+            lr = stod(value);
+        else if (key == "-mode")
+            mode = value;
+    }
+
+    auto start = chrono::steady_clock::now();
+    size_t bad_lines = 0;
+    const vector<labeled_pos> data = load_corpus(corpus_path, bad_lines);
+    double load_sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << "loaded " << data.size() << " positions (" << bad_lines << " bad lines) in " << load_sec << " s\n";
+    if (data.empty())
+        return 1;
+
+    double p[NUM_PARAMS], grad[NUM_PARAMS];
+    to_params(Eval::weights_for(mode), p);
+    const double K = fit_scale(data, p, threads);
+    cerr << "scale K = " << K << ", initial loss = " << loss_all(data, p, K, grad, threads) << "\n";
+
+    // Adam
+    double m[NUM_PARAMS] = {0}, v[NUM_PARAMS] = {0};
+    const double beta1 = 0.9, beta2 = 0.999, eps = 1e-8;
+    start = chrono::steady_clock::now();
+    double loss = 0;
+    for (int it = 1; it <= iterations; ++it)
+    {
+        loss = loss_all(data, p, K, grad, threads);
+        for (int k = 0; k < NUM_PARAMS; ++k)
+        {
+            m[k] = beta1 * m[k] + (1 - beta1) * grad[k];
+            v[k] = beta2 * v[k] + (1 - beta2) * grad[k] * grad[k];
+            const double mh = m[k] / (1 - pow(beta1, it)), vh = v[k] / (1 - pow(beta2, it));
+            p[k] -= lr * mh / (sqrt(vh) + eps);
+        }
+        // дамка не может стоить меньше пешки
+        p[0] = max(p[0], 1.0);
+        if (it % 50 == 0 || it == iterations)
+        {
+            const double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cerr << "iter " << it << " loss " << loss << " king " << p[0] << " advance " << p[1] << " back_rank "
+                 << p[2] << " center " << p[3] << " | " << (int64_t)(double(data.size()) * it / max(sec, 1e-9))
+                 << " positions/s\n";
+        }
+    }
+    if (!Eval::save_weights(out_path, from_params(p)))
+    {
+        cerr << "can't write " << out_path << "\n";
+        return 1;
+    }
+    cerr << "final loss " << loss << ", weights written to " << out_path << "\n";
+    return 0;
+}